@@ -0,0 +1,425 @@
+// Asynchronous logger: binary records on per-thread rings, formatted and
+// written by a background thread
+#ifndef ASYNC_LOGGER_HPP_
+#define ASYNC_LOGGER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "ring_buffer.hpp"
+#include "utils.hpp"
+
+// ASYNC_LOG(logger, "fmt", args...) costs the caller a timestamp and a copy
+// of the raw arguments into the SpscRing of its thread, no formatting and no
+// system call:
+//  * every call site registers its format string once (a function-local
+//    static) and gets an id; the record is the id, a time stamp counter
+//    reading and the arguments as bytes (strings copied with their length)
+//  * the background thread drains the rings, formats each record with
+//    snprintf into one text segment per ring and writes all segments with
+//    one writev
+// A full ring drops the record and counts it; lines of different threads
+// are in time order within a thread, not across threads.
+//
+// Take-aways
+//  ** a synchronous logger puts formatting, a lock and a write() on the hot
+//     path, and its tail latency is the slowest of those
+//  ** hand the work to another thread through memory the caller owns: a
+//     per-thread ring needs no lock and no atomic read-modify-write
+//  ** batch the system calls: one writev per round for all threads
+namespace async_log {
+
+// bytes of the ring of every thread
+#define LOG_RING_BYTES (1 << 20)
+// most registered formats and logging threads
+#define LOG_MAX_FORMATS (4096)
+#define LOG_MAX_THREADS (256)
+// longest string argument kept, and formatted line
+#define LOG_MAX_STRING (256)
+#define LOG_MAX_LINE (1024)
+// text per writev
+#define LOG_BATCH_BYTES (256 << 10)
+// sleep of the background thread when all rings are empty
+#define LOG_IDLE_US (50)
+
+using Ring = ring_buffer::SpscRing<LOG_RING_BYTES>;
+
+namespace detail {
+
+inline uint64_t stamp() {
+#ifdef HAS_RDTSC
+    return __rdtsc();
+#else
+    return ns_now();
+#endif
+}
+
+// raw encoding of one argument
+template <typename T>
+struct arg {
+    static_assert(std::is_arithmetic<T>::value || std::is_pointer<T>::value,
+            "log arguments are numbers, pointers or strings");
+    static size_t size(const T &) { return sizeof(T); }
+    static char *write(char *p, const T &v) {
+        memcpy(p, &v, sizeof(T));
+        return p + sizeof(T);
+    }
+    static T read(const char *&p) {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+};
+
+// strings: length, bytes and the terminating zero, read back in place
+template <>
+struct arg<const char *> {
+    static size_t length(const char *s) { return strnlen(s, LOG_MAX_STRING); }
+    static size_t size(const char *s) {
+        return sizeof(uint32_t) + length(s) + 1;
+    }
+    static char *write(char *p, const char *s) {
+        uint32_t n = static_cast<uint32_t>(length(s));
+        memcpy(p, &n, sizeof(n));
+        memcpy(p + sizeof(n), s, n);
+        p[sizeof(n) + n] = '\0';
+        return p + sizeof(n) + n + 1;
+    }
+    static const char *read(const char *&p) {
+        uint32_t n;
+        memcpy(&n, p, sizeof(n));
+        const char *s = p + sizeof(n);
+        p += sizeof(n) + n + 1;
+        return s;
+    }
+};
+
+template <>
+struct arg<char *> : arg<const char *> {};
+
+template <>
+struct arg<std::string> : arg<const char *> {
+    static size_t size(const std::string &s) {
+        return arg<const char *>::size(s.c_str());
+    }
+    static char *write(char *p, const std::string &s) {
+        return arg<const char *>::write(p, s.c_str());
+    }
+};
+
+template <typename... Args>
+struct Signature {};
+
+template <typename... Args>
+Signature<typename std::decay<Args>::type...> signature(const Args &...);
+
+template <typename Tuple, size_t... I>
+int format_tuple(const char *fmt, char *out, size_t cap, const Tuple &t,
+        std::index_sequence<I...>) {
+    // the trailing 0 keeps a format without arguments a printf call with
+    // arguments; printf ignores the extra one
+    return snprintf(out, cap, fmt, std::get<I>(t)..., 0);
+}
+
+// format the arguments of a record, returns the characters written
+template <typename... Args>
+int format(const char *fmt, const char *p, char *out, size_t cap) {
+    // braced initialization reads the arguments left to right
+    std::tuple<decltype(arg<Args>::read(p))...> t {arg<Args>::read(p)...};
+    (void)p;
+    return format_tuple(fmt, out, cap, t, std::index_sequence_for<Args...>());
+}
+
+struct Format {
+    const char *fmt;
+    int (*format)(const char *, const char *, char *, size_t);
+};
+
+// the formats of all call sites, append-only
+struct Registry {
+    Format formats[LOG_MAX_FORMATS];
+    std::atomic<uint32_t> count {0};
+    std::mutex mutex;
+
+    static Registry &get() {
+        static Registry r;
+        return r;
+    }
+};
+
+struct Header {
+    uint32_t id;
+    uint32_t pad;
+    uint64_t stamp;
+};
+
+} // namespace detail
+
+// id of a format with the given argument types, 0 if there are too many
+template <typename... Args>
+uint32_t register_format(const char *fmt, detail::Signature<Args...>) {
+    detail::Registry &r = detail::Registry::get();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    uint32_t n = r.count.load(std::memory_order_relaxed);
+    if (n == LOG_MAX_FORMATS) return 0;
+    r.formats[n] = {fmt, detail::format<Args...>};
+    r.count.store(n + 1, std::memory_order_release);
+    return n + 1;
+}
+
+class Logger {
+public:
+    // write to fd, which stays open after the logger is gone
+    explicit Logger(int fd)
+        : fd_(fd), id_(next_id()), start_(detail::stamp()),
+          ns_per_tick_(1. / tsc_ghz()) {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~Logger() {
+        stop_.store(true, std::memory_order_release);
+        thread_.join();
+    }
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    // the hot path: false if the record was dropped
+    template <typename... Args>
+    bool log(uint32_t id, const Args &...args) {
+        Producer *p = producer();
+        if (!p || id == 0) {
+            // no ring for the thread, or no id for the format
+            lost_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        size_t sizes[] = {0, detail::arg<typename std::decay<Args>::type>::size(
+                                     args)...};
+        size_t n = sizeof(detail::Header);
+        for (size_t s : sizes)
+            n += s;
+        char *dst = p->ring.prepare(n);
+        if (!dst) {
+            p->dropped.store(p->dropped.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+            return false;
+        }
+        detail::Header h {id, 0, detail::stamp()};
+        memcpy(dst, &h, sizeof(h));
+        char *q = dst + sizeof(h);
+        int expand[] = {0,
+                (q = detail::arg<typename std::decay<Args>::type>::write(
+                         q, args),
+                        0)...};
+        (void)expand;
+        // the sizes above and the encoders agree
+        assert(q == dst + n);
+        (void)q;
+        p->ring.commit();
+        return true;
+    }
+
+    // wait until every record logged before the call is written
+    void flush() {
+        uint64_t target = flush_requested_.fetch_add(1) + 1;
+        while (flush_done_.load(std::memory_order_acquire) < target)
+            std::this_thread::sleep_for(std::chrono::microseconds(LOG_IDLE_US));
+    }
+
+    // records dropped: on full rings, from threads beyond LOG_MAX_THREADS
+    // and with formats beyond LOG_MAX_FORMATS
+    uint64_t dropped() const {
+        uint64_t d = lost_.load(std::memory_order_relaxed);
+        size_t n = num_producers_.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; ++i)
+            d += producers_[i]->dropped.load(std::memory_order_relaxed);
+        return d;
+    }
+
+    uint64_t written_bytes() const {
+        return written_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Producer {
+        Ring ring;
+        uint32_t thread_index {0};
+        std::atomic<uint64_t> dropped {0};
+    };
+
+    // new does not honour the ring's over-alignment before C++17
+    struct ProducerDelete {
+        void operator()(Producer *p) const {
+            p->~Producer();
+            free(p);
+        }
+    };
+    using ProducerPtr = std::unique_ptr<Producer, ProducerDelete>;
+
+    static Producer *new_producer() {
+        void *mem = nullptr;
+        if (posix_memalign(&mem, alignof(Producer), sizeof(Producer)))
+            throw std::bad_alloc();
+        return new (mem) Producer();
+    }
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> id {0};
+        return ++id;
+    }
+
+    // the ring of the calling thread, created on its first record
+    Producer *producer() {
+        struct Cache {
+            uint64_t logger;
+            Producer *p;
+        };
+        thread_local Cache cache {0, nullptr};
+        if (cache.logger == id_) return cache.p;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = by_thread_.find(std::this_thread::get_id());
+        Producer *p = nullptr;
+        if (it != by_thread_.end()) {
+            p = it->second;
+        } else {
+            size_t n = num_producers_.load(std::memory_order_relaxed);
+            if (n == LOG_MAX_THREADS) return nullptr;
+            producers_[n].reset(new_producer());
+            p = producers_[n].get();
+            p->thread_index = static_cast<uint32_t>(n);
+            by_thread_[std::this_thread::get_id()] = p;
+            num_producers_.store(n + 1, std::memory_order_release);
+        }
+        cache = {id_, p};
+        return p;
+    }
+
+    void write_all(std::vector<struct iovec> &iov) {
+        size_t first = 0;
+        while (first < iov.size()) {
+            size_t cnt = std::min<size_t>(iov.size() - first, IOV_MAX);
+            ssize_t w = writev(fd_, iov.data() + first, static_cast<int>(cnt));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            written_.fetch_add(w, std::memory_order_relaxed);
+            // skip what was written, resume within a partial segment
+            size_t left = static_cast<size_t>(w);
+            while (first < iov.size() && left >= iov[first].iov_len)
+                left -= iov[first++].iov_len;
+            if (first < iov.size()) {
+                iov[first].iov_base = static_cast<char *>(iov[first].iov_base)
+                        + left;
+                iov[first].iov_len -= left;
+            }
+        }
+        iov.clear();
+    }
+
+    // one pass over all rings, returns the records formatted
+    size_t drain(std::vector<char> &text, std::vector<struct iovec> &iov) {
+        const detail::Registry &reg = detail::Registry::get();
+        size_t used = 0;
+        size_t records = 0;
+        size_t n = num_producers_.load(std::memory_order_acquire);
+        uint32_t formats = reg.count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; ++i) {
+            Producer *p = producers_[i].get();
+            size_t begin = used;
+            records += p->ring.consume([&](const char *rec, size_t) {
+                if (text.size() - used < LOG_MAX_LINE) {
+                    // the segment so far, then start over
+                    if (used > begin)
+                        iov.push_back({text.data() + begin, used - begin});
+                    write_all(iov);
+                    used = begin = 0;
+                }
+                detail::Header h;
+                memcpy(&h, rec, sizeof(h));
+                char *out = text.data() + used;
+                size_t cap = LOG_MAX_LINE - 1;
+                int len = snprintf(out, cap, "%.6f [%u] ",
+                        (h.stamp - start_) * ns_per_tick_ * 1e-9,
+                        p->thread_index);
+                if (h.id > 0 && h.id <= formats) {
+                    const detail::Format &f = reg.formats[h.id - 1];
+                    int m = f.format(
+                            f.fmt, rec + sizeof(h), out + len, cap - len);
+                    if (m > 0) len += m;
+                }
+                len = std::min<int>(len, static_cast<int>(cap) - 1);
+                out[len++] = '\n';
+                used += len;
+            });
+            if (used > begin) iov.push_back({text.data() + begin, used - begin});
+        }
+        write_all(iov);
+        return records;
+    }
+
+    void run() {
+        std::vector<char> text(LOG_BATCH_BYTES);
+        std::vector<struct iovec> iov;
+        for (;;) {
+            bool stop = stop_.load(std::memory_order_acquire);
+            uint64_t requested = flush_requested_.load(std::memory_order_acquire);
+            size_t records = drain(text, iov);
+            flush_done_.store(requested, std::memory_order_release);
+            if (stop) return;
+            if (records == 0)
+                std::this_thread::sleep_for(
+                        std::chrono::microseconds(LOG_IDLE_US));
+        }
+    }
+
+    int fd_;
+    uint64_t id_;
+    uint64_t start_;
+    double ns_per_tick_;
+    ProducerPtr producers_[LOG_MAX_THREADS];
+    std::atomic<size_t> num_producers_ {0};
+    std::map<std::thread::id, Producer *> by_thread_;
+    std::mutex mutex_;
+    std::atomic<uint64_t> flush_requested_ {0};
+    std::atomic<uint64_t> flush_done_ {0};
+    std::atomic<uint64_t> written_ {0};
+    std::atomic<uint64_t> lost_ {0};
+    std::atomic<bool> stop_ {false};
+    std::thread thread_;
+};
+
+} // namespace async_log
+
+// log through logger from any thread; the arguments are numbers, pointers,
+// C strings or std::string
+#define ASYNC_LOG(logger, fmt, ...) \
+    do { \
+        static const uint32_t async_log_id_ = ::async_log::register_format( \
+                fmt, decltype(::async_log::detail::signature(__VA_ARGS__))()); \
+        (logger).log(async_log_id_, ##__VA_ARGS__); \
+    } while (0)
+
+#endif // ASYNC_LOGGER_HPP_
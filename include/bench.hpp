@@ -0,0 +1,483 @@
+// Benchmark harness shared by the examples under tests/
+#ifndef BENCH_HPP_
+#define BENCH_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "perf_counters.hpp"
+#include "utils.hpp"
+
+// Every benchmark case goes through the same steps:
+//  * parameters come from the command line (--key=value), with defaults
+//  * setup (e.g. reset output, clear cache) and teardown run outside of the
+//    timed region
+//  * warmup repetitions are run and discarded
+//  * timed repetitions run until both --reps and --min-time are satisfied
+//  * statistics (min/median/mean/p99/stddev) are reported as text, CSV or JSON
+//
+// Regions shorter than ~10us are timed with the calibrated TSC, longer ones
+// with clock_gettime(CLOCK_MONOTONIC_RAW); --timer=clock|tsc forces one.
+//
+// Hardware counters (perf_counters.hpp) are started and stopped around every
+// timed repetition, and derived metrics (IPC, misses per op, bytes per cycle)
+// are reported next to the time. Without perf access only time is reported.
+namespace bench {
+
+// keep the compiler from optimizing away a computed value
+template <typename T>
+inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// force pending writes to memory to be considered visible
+inline void clobber_memory() {
+    asm volatile("" : : : "memory");
+}
+
+// Command line options in the form of --key=value or --flag
+// Sizes accept k/m/g suffixes (powers of 1024), lists are comma separated.
+class Options {
+public:
+    Options(int argc, char **argv) : prog_(argc > 0 ? argv[0] : "bench") {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg.compare(0, 2, "--") != 0) {
+                fprintf(stderr, "ignoring argument '%s'\n", argv[i]);
+                continue;
+            }
+            arg = arg.substr(2);
+            size_t eq = arg.find('=');
+            if (eq == std::string::npos)
+                values_[arg] = "1";
+            else
+                values_[arg.substr(0, eq)] = arg.substr(eq + 1);
+        }
+        help_ = values_.count("help") > 0;
+        used_.insert("help");
+    }
+
+    long get_int(const std::string &key, long def, const char *help = "") {
+        add_usage(key, std::to_string(def), help);
+        auto it = values_.find(key);
+        return it == values_.end() ? def : parse_size(it->second);
+    }
+
+    double get_double(
+            const std::string &key, double def, const char *help = "") {
+        std::ostringstream os;
+        os << def;
+        add_usage(key, os.str(), help);
+        auto it = values_.find(key);
+        return it == values_.end() ? def : std::atof(it->second.c_str());
+    }
+
+    std::string get_string(const std::string &key, const std::string &def,
+            const char *help = "") {
+        add_usage(key, def, help);
+        auto it = values_.find(key);
+        return it == values_.end() ? def : it->second;
+    }
+
+    bool get_flag(const std::string &key, const char *help = "") {
+        add_usage(key, "off", help);
+        auto it = values_.find(key);
+        return it != values_.end() && it->second != "0";
+    }
+
+    std::vector<long> get_list(const std::string &key,
+            const std::vector<long> &def, const char *help = "") {
+        std::string def_str;
+        for (size_t i = 0; i < def.size(); ++i)
+            def_str += (i ? "," : "") + std::to_string(def[i]);
+        add_usage(key, def_str, help);
+        auto it = values_.find(key);
+        if (it == values_.end()) return def;
+        std::vector<long> list;
+        std::stringstream ss(it->second);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            if (!item.empty()) list.push_back(parse_size(item));
+        return list;
+    }
+
+    // Print usage if --help was given, and warn about unknown options.
+    // Call after all parameters are queried; returns true if main should
+    // exit without running.
+    bool help() {
+        for (const auto &kv : values_)
+            if (!used_.count(kv.first))
+                fprintf(stderr, "unknown option --%s\n", kv.first.c_str());
+        if (!help_) return false;
+        printf("usage: %s [--key=value ...]\n", prog_.c_str());
+        for (const auto &line : usage_)
+            printf("%s\n", line.c_str());
+        return true;
+    }
+
+    static long parse_size(const std::string &s) {
+        char *end = nullptr;
+        double v = std::strtod(s.c_str(), &end);
+        switch (end && *end ? *end : ' ') {
+            case 'k':
+            case 'K': v *= 1024.; break;
+            case 'm':
+            case 'M': v *= 1024. * 1024.; break;
+            case 'g':
+            case 'G': v *= 1024. * 1024. * 1024.; break;
+            default: break;
+        }
+        return static_cast<long>(v);
+    }
+
+private:
+    void add_usage(
+            const std::string &key, const std::string &def, const char *help) {
+        if (used_.count(key)) return;
+        used_.insert(key);
+        usage_.push_back("  --" + key + " (default: " + def + ") " + help);
+    }
+
+    std::string prog_;
+    std::map<std::string, std::string> values_;
+    std::set<std::string> used_;
+    std::vector<std::string> usage_;
+    bool help_ {false};
+};
+
+// Summary statistics of the timed repetitions, in nanoseconds
+struct Stats {
+    size_t reps {0};
+    double min {0.};
+    double median {0.};
+    double mean {0.};
+    double p99 {0.};
+    double stddev {0.};
+
+    static Stats compute(std::vector<double> samples) {
+        Stats s;
+        s.reps = samples.size();
+        if (samples.empty()) return s;
+        std::sort(samples.begin(), samples.end());
+        size_t n = samples.size();
+        s.min = samples.front();
+        s.median = (n % 2) ? samples[n / 2]
+                           : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+        double sum = 0.;
+        for (double v : samples)
+            sum += v;
+        s.mean = sum / n;
+        // nearest-rank percentile
+        size_t rank = static_cast<size_t>(std::ceil(0.99 * n));
+        s.p99 = samples[std::max<size_t>(rank, 1) - 1];
+        double var = 0.;
+        for (double v : samples)
+            var += (v - s.mean) * (v - s.mean);
+        s.stddev = n > 1 ? std::sqrt(var / (n - 1)) : 0.;
+        return s;
+    }
+};
+
+// Description of one benchmark case
+struct Case {
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> params;
+    // work items per repetition (elements, innermost iterations, loads ...)
+    double ops {0.};
+    // bytes moved per repetition
+    double bytes {0.};
+
+    explicit Case(const std::string &n) : name(n) {}
+
+    template <typename T>
+    Case &param(const std::string &key, const T &value) {
+        std::ostringstream os;
+        os << value;
+        params.emplace_back(key, os.str());
+        return *this;
+    }
+    Case &set_ops(double n) {
+        ops = n;
+        return *this;
+    }
+    Case &set_bytes(double n) {
+        bytes = n;
+        return *this;
+    }
+};
+
+struct Result {
+    std::string suite;
+    Case info;
+    Stats stats;
+    // derived metrics, in reporting order
+    std::vector<std::pair<std::string, double>> metrics;
+
+    Result(const std::string &s, const Case &c) : suite(s), info(c) {}
+
+    double metric(const std::string &key, double def = 0.) const {
+        for (const auto &kv : metrics)
+            if (kv.first == key) return kv.second;
+        return def;
+    }
+};
+
+class Runner {
+public:
+    Runner(const char *suite, int argc, char **argv, long reps = 10,
+            long warmup = 1)
+        : suite_(suite), opts_(argc, argv) {
+        reps_ = opts_.get_int("reps", reps, "timed repetitions per case");
+        if (reps_ < 1) {
+            // without a sample every metric would be 0 or inf
+            fprintf(stderr, "--reps=%ld, running 1 repetition\n", reps_);
+            reps_ = 1;
+        }
+        warmup_ = opts_.get_int(
+                "warmup", warmup, "discarded repetitions per case");
+        min_time_ms_ = opts_.get_double("min-time", 0.,
+                "minimum total timed duration per case in ms");
+        format_ = opts_.get_string("format", "text", "text, csv or json");
+        timer_ = opts_.get_string("timer", "auto", "auto, clock or tsc");
+        std::string path
+                = opts_.get_string("output", "", "write results to file");
+        if (opts_.get_int("counters", 1, "hardware counters, 0 to disable")) {
+            counters_.reset(new perf::CounterGroup());
+            if (!counters_->available()) {
+                fprintf(stderr,
+                        "hardware counters unavailable, reporting time "
+                        "only\n");
+                counters_.reset();
+            }
+        }
+        if (!path.empty()) {
+            out_ = fopen(path.c_str(), "w");
+            if (!out_) {
+                fprintf(stderr, "cannot open %s, using stdout\n",
+                        path.c_str());
+                out_ = stdout;
+            }
+        }
+    }
+
+    ~Runner() {
+        if (format_ == "json") print_json();
+        if (out_ != stdout) fclose(out_);
+    }
+
+    Options &options() { return opts_; }
+
+    // "text", "csv" or "json"
+    const std::string &format() const { return format_; }
+
+    // run body() under the harness, setup() is called before and teardown()
+    // after every repetition (including warmup), neither is timed
+    template <typename Setup, typename Body, typename Teardown>
+    const Result &run(
+            const Case &c, Setup setup, Body body, Teardown teardown) {
+        bool use_tsc = timer_ == "tsc";
+        for (long w = 0; w < warmup_; ++w) {
+            setup();
+            uint64_t t0 = ns_now();
+            body();
+            uint64_t t1 = ns_now();
+            teardown();
+            if (w == 0 && timer_ == "auto") use_tsc = (t1 - t0) < 10000;
+        }
+        if (use_tsc) tsc_ghz();
+
+        std::vector<double> samples;
+        double timed_ms = 0.;
+        if (counters_) counters_->reset();
+        const size_t max_reps = 100000000;
+        while ((static_cast<long>(samples.size()) < reps_
+                       || timed_ms < min_time_ms_)
+                && samples.size() < max_reps) {
+            setup();
+            if (counters_) counters_->start();
+            double ns;
+            if (use_tsc) {
+                uint64_t c0 = tsc_begin();
+                body();
+                uint64_t c1 = tsc_end();
+                ns = static_cast<double>(c1 - c0) / tsc_ghz();
+            } else {
+                uint64_t t0 = ns_now();
+                body();
+                uint64_t t1 = ns_now();
+                ns = static_cast<double>(t1 - t0);
+            }
+            if (counters_) counters_->stop();
+            teardown();
+            samples.push_back(ns);
+            timed_ms += ns * 1e-6;
+        }
+
+        results_.emplace_back(suite_, c);
+        Result &r = results_.back();
+        r.stats = Stats::compute(samples);
+        if (c.ops > 0.) {
+            double ns_per_op = r.stats.median / c.ops;
+            r.metrics.emplace_back("ns/op", ns_per_op);
+            r.metrics.emplace_back("cycles/op", ns_per_op * tsc_ghz());
+        }
+        if (c.bytes > 0.)
+            r.metrics.emplace_back("GB/s", c.bytes / r.stats.median);
+        if (counters_) add_counter_metrics(r, samples.size());
+        report(r);
+        return r;
+    }
+
+    template <typename Setup, typename Body>
+    const Result &run(const Case &c, Setup setup, Body body) {
+        return run(c, setup, body, [] {});
+    }
+
+    template <typename Body>
+    const Result &run(const Case &c, Body body) {
+        return run(c, [] {}, body);
+    }
+
+    const std::deque<Result> &results() const { return results_; }
+
+private:
+    // counts are averaged per repetition, then normalized by ops if known
+    void add_counter_metrics(Result &r, size_t reps) {
+        const perf::CounterGroup &pc = *counters_;
+        double cycles = pc.value(perf::CYCLES) / reps;
+        double per = r.info.ops > 0. ? r.info.ops : 1.;
+        const char *suffix = r.info.ops > 0. ? "/op" : "";
+        if (pc.has(perf::CYCLES) && pc.has(perf::INSTRUCTIONS) && cycles > 0.)
+            r.metrics.emplace_back(
+                    "IPC", pc.value(perf::INSTRUCTIONS) / reps / cycles);
+        if (pc.has(perf::CYCLES) && r.info.ops > 0.)
+            r.metrics.emplace_back("core-cycles/op", cycles / per);
+        for (int e = perf::L1D_MISSES; e < perf::NUM_EVENTS; ++e) {
+            if (!pc.has(e)) continue;
+            r.metrics.emplace_back(std::string(perf::event_name(e)) + suffix,
+                    pc.value(e) / reps / per);
+        }
+        if (pc.has(perf::CYCLES) && r.info.bytes > 0. && cycles > 0.)
+            r.metrics.emplace_back("bytes/cycle", r.info.bytes / cycles);
+    }
+
+    static std::string pretty_time(double ns) {
+        char buf[32];
+        if (ns < 1e3)
+            snprintf(buf, sizeof(buf), "%.2f ns", ns);
+        else if (ns < 1e6)
+            snprintf(buf, sizeof(buf), "%.3f us", ns * 1e-3);
+        else if (ns < 1e9)
+            snprintf(buf, sizeof(buf), "%.3f ms", ns * 1e-6);
+        else
+            snprintf(buf, sizeof(buf), "%.3f s", ns * 1e-9);
+        return buf;
+    }
+
+    static std::string join_params(const Case &c, const char *sep) {
+        std::string s;
+        for (size_t i = 0; i < c.params.size(); ++i)
+            s += (i ? sep : "") + c.params[i].first + "="
+                    + c.params[i].second;
+        return s;
+    }
+
+    static std::string escape(const std::string &s) {
+        std::string e;
+        for (char ch : s) {
+            if (ch == '"' || ch == '\\') e += '\\';
+            e += ch;
+        }
+        return e;
+    }
+
+    void report(const Result &r) {
+        if (format_ == "csv") {
+            if (!csv_header_) {
+                fprintf(out_,
+                        "suite,case,params,reps,min_ns,median_ns,mean_ns,"
+                        "p99_ns,stddev_ns,metrics\n");
+                csv_header_ = true;
+            }
+            std::string metrics;
+            for (size_t i = 0; i < r.metrics.size(); ++i) {
+                char buf[64];
+                snprintf(buf, sizeof(buf), "%s%s=%.6g", i ? ";" : "",
+                        r.metrics[i].first.c_str(), r.metrics[i].second);
+                metrics += buf;
+            }
+            fprintf(out_, "%s,%s,%s,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%s\n",
+                    r.suite.c_str(), r.info.name.c_str(),
+                    join_params(r.info, ";").c_str(), r.stats.reps,
+                    r.stats.min, r.stats.median, r.stats.mean, r.stats.p99,
+                    r.stats.stddev, metrics.c_str());
+        } else if (format_ != "json") {
+            std::string params = join_params(r.info, " ");
+            fprintf(out_,
+                    "%s/%s%s%s: median %s, min %s, mean %s, p99 %s, "
+                    "stddev %s (%zu reps)",
+                    r.suite.c_str(), r.info.name.c_str(),
+                    params.empty() ? "" : " ", params.c_str(),
+                    pretty_time(r.stats.median).c_str(),
+                    pretty_time(r.stats.min).c_str(),
+                    pretty_time(r.stats.mean).c_str(),
+                    pretty_time(r.stats.p99).c_str(),
+                    pretty_time(r.stats.stddev).c_str(), r.stats.reps);
+            for (const auto &m : r.metrics)
+                fprintf(out_, ", %s %.4g", m.first.c_str(), m.second);
+            fprintf(out_, "\n");
+        }
+        fflush(out_);
+    }
+
+    void print_json() {
+        fprintf(out_, "[\n");
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const Result &r = results_[i];
+            fprintf(out_, "  {\"suite\": \"%s\", \"case\": \"%s\", ",
+                    escape(r.suite).c_str(), escape(r.info.name).c_str());
+            fprintf(out_, "\"params\": {");
+            for (size_t p = 0; p < r.info.params.size(); ++p)
+                fprintf(out_, "%s\"%s\": \"%s\"", p ? ", " : "",
+                        escape(r.info.params[p].first).c_str(),
+                        escape(r.info.params[p].second).c_str());
+            fprintf(out_,
+                    "}, \"reps\": %zu, \"min_ns\": %.1f, \"median_ns\": "
+                    "%.1f, \"mean_ns\": %.1f, \"p99_ns\": %.1f, "
+                    "\"stddev_ns\": %.1f, \"metrics\": {",
+                    r.stats.reps, r.stats.min, r.stats.median, r.stats.mean,
+                    r.stats.p99, r.stats.stddev);
+            for (size_t m = 0; m < r.metrics.size(); ++m)
+                fprintf(out_, "%s\"%s\": %.6g", m ? ", " : "",
+                        escape(r.metrics[m].first).c_str(),
+                        r.metrics[m].second);
+            fprintf(out_, "}}%s\n", i + 1 < results_.size() ? "," : "");
+        }
+        fprintf(out_, "]\n");
+    }
+
+    std::string suite_;
+    Options opts_;
+    long reps_ {10};
+    long warmup_ {1};
+    double min_time_ms_ {0.};
+    std::string format_;
+    std::string timer_;
+    FILE *out_ {stdout};
+    bool csv_header_ {false};
+    std::unique_ptr<perf::CounterGroup> counters_;
+    std::deque<Result> results_;
+};
+
+} // namespace bench
+#endif
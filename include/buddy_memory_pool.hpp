@@ -4,9 +4,13 @@
 #include <cmath>
 #include <iostream>
 #include <memory>
+#include <new>
 #include <vector>
 #include <unordered_map>
 
+#include "numa.hpp"
+#include "sharded_counter.hpp"
+
 // Manages memory in power of two increments
 // * If 2^(U-1)<S<=2^U: Allocate the whole block
 // * Else: Recursively divide the block equally and test the condition at each
@@ -17,6 +21,7 @@
 //  ** much internal fragmentations - fixed allocation size
 //  ** can be implemented by binary tree, search complexity is O(logN)
 //  ** easier to coalescing
+//  ** the buffer is bound to one NUMA node, one pool per node
 namespace buddy_mempool {
 
 // minimal allocation unit - 4 bytes
@@ -24,11 +29,12 @@ namespace buddy_mempool {
 
 class MemoryPool {
 private:
-    // default ctor - need initial capacity
-    MemoryPool(size_t n) {
+    // default ctor - need initial capacity, node < 0 keeps the default
+    // memory policy
+    MemoryPool(size_t n, int node = -1) : capacity_(n), node_(node) {
         // allocate real buffer
-        std::unique_ptr<char> temp_mem = std::make_unique<char>(n);
-        data_ = temp_mem.release();
+        data_ = static_cast<char *>(numa::alloc_on_node(n, node));
+        if (!data_) throw std::bad_alloc();
 
         int num_elem_in_free_list
                 = static_cast<int>(std::ceil(log(n) / log(2)));
@@ -44,12 +50,23 @@ private:
     ~MemoryPool() { release(); }
 
 public:
-    // Singletone
-    static MemoryPool &Instance() {
-        static MemoryPool inst(2048);
-        return inst;
+    // Singletone, one per NUMA node (node < 0: default policy)
+    static MemoryPool &Instance(int node = -1) {
+        if (node < 0 || node >= NUMA_MAX_NODES) {
+            static MemoryPool inst(2048);
+            return inst;
+        }
+        // created on first use, live as long as the program
+        static MemoryPool *per_node[NUMA_MAX_NODES] = {};
+        if (!per_node[node]) per_node[node] = new MemoryPool(2048, node);
+        return *per_node[node];
     }
 
+    int node() const { return node_; }
+
+    // start of the real buffer, offsets are relative to it
+    char *data() const { return data_; }
+
     // Divide process
     // time complexity is O(log(N))
     void *allocate(size_t n) {
@@ -62,6 +79,7 @@ public:
                     global_vars_.free_list[chunk_idx].begin());
             global_vars_.addr_to_size_map[temp.first]
                     = temp.second - temp.first + 1;
+            stats_.allocations.add();
 
             std::cout << "Memory from " << temp.first << " to " << temp.second
                       << " allocated"
@@ -103,6 +121,7 @@ public:
                 }
                 global_vars_.addr_to_size_map[temp.first]
                         = temp.second - temp.first + 1;
+                stats_.allocations.add();
                 std::cout << "Memory from " << temp.first << " to "
                           << temp.second << " allocated"
                           << "\n";
@@ -153,17 +172,27 @@ public:
             }
         }
         global_vars_.addr_to_size_map.erase(base_addr);
+        stats_.deallocations.add();
         std::cout << "Returning Memory " << base_addr << " to pool\n";
     }
 
     // free all of memory chunks in the memory pool
     void release() {
         if (data_) {
-            delete[] data_;
+            numa::free_on_node(data_, capacity_);
+            data_ = nullptr;
             std::cout << "Releasing memory buffer...\n";
         }
     }
 
+    // usage counters, cheap to update and safe to read from any thread
+    struct Stats {
+        concurrent::ShardedCounter allocations;
+        concurrent::ShardedCounter deallocations;
+    };
+
+    const Stats &stats() const { return stats_; }
+
 private:
     struct GlobalVars {
         // how many level in this memory pool - depends on the initial capacity
@@ -179,6 +208,9 @@ private:
 
     // real buffer
     char *data_ {nullptr};
+    size_t capacity_;
+    int node_;
+    Stats stats_;
 };
 
 } // namespace buddy_mempool
@@ -0,0 +1,141 @@
+// Cache-oblivious kernels built on recursive divide-and-conquer
+#ifndef CACHE_OBLIVIOUS_HPP_
+#define CACHE_OBLIVIOUS_HPP_
+
+#include <algorithm>
+#include <utility>
+
+// Splitting the largest dimension in half until the sub-problem is small
+// enough visits the matrices in Z-order (Morton order). At some level of the
+// recursion the sub-problem fits into each cache (L1, L2, L3 ...), so the
+// kernels make good use of every cache level without knowing their sizes.
+//
+// Take-aways
+//  ** no machine-specific tuning of block sizes, unlike block_matmul
+//  ** recursion overhead is amortized by a base-case cutoff, below which a
+//     plain loop nest with good spatial locality is used
+//  ** works on any size, not only powers of two or multiples of a block
+namespace cache_oblivious {
+
+// default base-case cutoffs (in elements along the largest dimension); a
+// cutoff below 1 is taken as 1, the recursion would never reach it
+#define CO_MATMUL_CUTOFF (32)
+#define CO_TRANSPOSE_CUTOFF (16)
+
+namespace detail {
+
+// base case of matmul, loop M -> loop K -> loop N (best spatial locality)
+template <typename T>
+void matmul_base(const T *A, const T *B, T *C, int m, int n, int k, int lda,
+        int ldb, int ldc) {
+    for (int i = 0; i < m; ++i) {
+        for (int kk = 0; kk < k; ++kk) {
+            T tmp = A[i * lda + kk];
+            for (int j = 0; j < n; ++j) {
+                C[i * ldc + j] += tmp * B[kk * ldb + j];
+            }
+        }
+    }
+}
+
+// swap X (rows x cols) with the transpose of Y (cols x rows)
+template <typename T>
+void swap_transpose(T *X, T *Y, int rows, int cols, int ld, int cutoff) {
+    if (rows <= cutoff && cols <= cutoff) {
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                std::swap(X[i * ld + j], Y[j * ld + i]);
+            }
+        }
+    } else if (rows >= cols) {
+        int r1 = rows / 2;
+        swap_transpose(X, Y, r1, cols, ld, cutoff);
+        swap_transpose(X + r1 * ld, Y + r1, rows - r1, cols, ld, cutoff);
+    } else {
+        int c1 = cols / 2;
+        swap_transpose(X, Y, rows, c1, ld, cutoff);
+        swap_transpose(X + c1, Y + c1 * ld, rows, cols - c1, ld, cutoff);
+    }
+}
+
+} // namespace detail
+
+// C[m x n] += A[m x k] * B[k x n], all row-major with leading dimensions
+// lda, ldb and ldc
+template <typename T>
+void matmul(const T *A, const T *B, T *C, int m, int n, int k, int lda,
+        int ldb, int ldc, int cutoff = CO_MATMUL_CUTOFF) {
+    cutoff = std::max(cutoff, 1);
+    if (m <= cutoff && n <= cutoff && k <= cutoff) {
+        detail::matmul_base(A, B, C, m, n, k, lda, ldb, ldc);
+    } else if (m >= n && m >= k) {
+        // split rows of A and C
+        int m1 = m / 2;
+        matmul(A, B, C, m1, n, k, lda, ldb, ldc, cutoff);
+        matmul(A + m1 * lda, B, C + m1 * ldc, m - m1, n, k, lda, ldb, ldc,
+                cutoff);
+    } else if (n >= k) {
+        // split columns of B and C
+        int n1 = n / 2;
+        matmul(A, B, C, m, n1, k, lda, ldb, ldc, cutoff);
+        matmul(A, B + n1, C + n1, m, n - n1, k, lda, ldb, ldc, cutoff);
+    } else {
+        // split the reduction dimension, both halves accumulate into C
+        int k1 = k / 2;
+        matmul(A, B, C, m, n, k1, lda, ldb, ldc, cutoff);
+        matmul(A + k1, B + k1 * ldb, C, m, n, k - k1, lda, ldb, ldc, cutoff);
+    }
+}
+
+// C[n x n] += A[n x n] * B[n x n] for densely stored square matrices
+template <typename T>
+void matmul(const T *A, const T *B, T *C, int n, int cutoff = CO_MATMUL_CUTOFF) {
+    matmul(A, B, C, n, n, n, n, n, n, cutoff);
+}
+
+// out-of-place transpose: B[cols x rows] = A[rows x cols]^T
+template <typename T>
+void transpose(const T *A, T *B, int rows, int cols, int lda, int ldb,
+        int cutoff = CO_TRANSPOSE_CUTOFF) {
+    cutoff = std::max(cutoff, 1);
+    if (rows <= cutoff && cols <= cutoff) {
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                B[j * ldb + i] = A[i * lda + j];
+            }
+        }
+    } else if (rows >= cols) {
+        int r1 = rows / 2;
+        transpose(A, B, r1, cols, lda, ldb, cutoff);
+        transpose(A + r1 * lda, B + r1, rows - r1, cols, lda, ldb, cutoff);
+    } else {
+        int c1 = cols / 2;
+        transpose(A, B, rows, c1, lda, ldb, cutoff);
+        transpose(A + c1, B + c1 * ldb, rows, cols - c1, lda, ldb, cutoff);
+    }
+}
+
+// in-place transpose of a square n x n matrix with leading dimension lda
+//
+// | A11 A12 |T   | A11^T A21^T |
+// | A21 A22 |  = | A12^T A22^T |
+template <typename T>
+void transpose_inplace(
+        T *A, int n, int lda, int cutoff = CO_TRANSPOSE_CUTOFF) {
+    cutoff = std::max(cutoff, 1);
+    if (n <= cutoff) {
+        for (int i = 0; i < n; ++i) {
+            for (int j = i + 1; j < n; ++j) {
+                std::swap(A[i * lda + j], A[j * lda + i]);
+            }
+        }
+        return;
+    }
+    int n1 = n / 2;
+    transpose_inplace(A, n1, lda, cutoff);
+    transpose_inplace(A + n1 * lda + n1, n - n1, lda, cutoff);
+    detail::swap_transpose(A + n1, A + n1 * lda, n1, n - n1, lda, cutoff);
+}
+
+} // namespace cache_oblivious
+#endif
@@ -0,0 +1,419 @@
+// Trace-driven simulator of set-associative caches and TLBs
+#ifndef CACHE_SIM_HPP_
+#define CACHE_SIM_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "topology.hpp"
+
+// A Hierarchy holds the cache levels (L1, L2, ...) and the TLB levels (dTLB,
+// STLB) of one core. Every address goes through the TLBs by page and through
+// the caches by line:
+//  * a lookup that misses in a level goes on to the next one and fills every
+//    level on the way back (non-inclusive, no write-backs)
+//  * replacement is LRU, or bit PLRU: one MRU bit per way, the first way with
+//    a clear bit is the victim, and all bits but the last are cleared once
+//    every bit is set
+//  * with prefetch on, a demand miss in a level also fills the next line
+//    into it, without counting as an access of the lower levels
+//
+// Traces are compact: a record is the delta to the last address of one of
+// TRACE_STREAMS streams, zigzag encoded and shifted left by the stream index,
+// as a LEB128 varint. A writer picks the stream with the nearest address, or
+// starts a new one round robin when none is within TRACE_NEAR bytes, so the
+// interleaved unit strides of a loop nest take one byte per access.
+// A TraceWriter hands full chunks to a sink, either a Hierarchy directly or
+// a file of [uint32_t length][chunk] frames read back by read_trace.
+//
+// Take-aways
+//  ** misses per level follow from the access order and the cache geometry
+//     alone, before running anything on the machine
+//  ** repeated accesses to one line are the common case, so the inner loop
+//     checks the last line and page before any set lookup
+namespace cache_sim {
+
+enum Policy { LRU = 0, PLRU, NUM_POLICIES };
+
+inline const char *policy_name(Policy p) {
+    static const char *names[NUM_POLICIES] = {"lru", "plru"};
+    return names[p];
+}
+
+// NUM_POLICIES if unknown
+inline Policy parse_policy(const std::string &s) {
+    for (int p = 0; p < NUM_POLICIES; ++p)
+        if (s == policy_name(static_cast<Policy>(p)))
+            return static_cast<Policy>(p);
+    return NUM_POLICIES;
+}
+
+// a cache level, or a TLB level with one "line" per page; up to 64 ways
+struct LevelConfig {
+    std::string name;
+    size_t size;
+    int ways;
+    size_t line;
+    Policy policy;
+    bool prefetch;
+};
+
+struct Stats {
+    uint64_t accesses {0};
+    uint64_t misses {0};
+    uint64_t prefetches {0};
+
+    double miss_rate() const {
+        return accesses ? static_cast<double>(misses) / accesses : 0.;
+    }
+};
+
+#define TRACE_STREAMS (4)
+#define TRACE_NEAR (4096)
+
+// tag of an empty way
+constexpr uint64_t INVALID_BLOCK = ~0ull;
+
+class Cache {
+public:
+    explicit Cache(const LevelConfig &c)
+        : config_(c), ways_(std::min(std::max(c.ways, 1), 64)) {
+        sets_ = c.size / c.line / ways_;
+        if (sets_ == 0) sets_ = 1;
+        pow2_ = (sets_ & (sets_ - 1)) == 0;
+        tags_.assign(sets_ * ways_, INVALID_BLOCK);
+        if (config_.policy == LRU)
+            stamps_.assign(sets_ * ways_, 0);
+        else
+            mru_.assign(sets_, 0);
+        full_ = ways_ == 64 ? ~0ull : (1ull << ways_) - 1;
+    }
+
+    const LevelConfig &config() const { return config_; }
+    size_t sets() const { return sets_; }
+
+    // true on a hit; a miss inserts the block
+    bool access(uint64_t block) {
+        size_t set = set_of(block);
+        uint64_t *tags = &tags_[set * ways_];
+        for (int w = 0; w < ways_; ++w)
+            if (tags[w] == block) {
+                touch(set, w);
+                return true;
+            }
+        int v = victim(set);
+        tags[v] = block;
+        touch(set, v);
+        return false;
+    }
+
+    bool contains(uint64_t block) const {
+        size_t base = set_of(block) * ways_;
+        for (int w = 0; w < ways_; ++w)
+            if (tags_[base + w] == block) return true;
+        return false;
+    }
+
+    void clear() {
+        std::fill(tags_.begin(), tags_.end(), INVALID_BLOCK);
+        std::fill(stamps_.begin(), stamps_.end(), 0);
+        std::fill(mru_.begin(), mru_.end(), 0);
+        clock_ = 0;
+    }
+
+private:
+    LevelConfig config_;
+    int ways_;
+    size_t sets_;
+    bool pow2_;
+    std::vector<uint64_t> tags_;
+    // LRU: time of the last access of each way
+    std::vector<uint64_t> stamps_;
+    uint64_t clock_ {0};
+    // PLRU: MRU bits of each set, all ways set in full_
+    std::vector<uint64_t> mru_;
+    uint64_t full_;
+
+    size_t set_of(uint64_t block) const {
+        return pow2_ ? block & (sets_ - 1) : block % sets_;
+    }
+
+    void touch(size_t set, int w) {
+        if (config_.policy == LRU) {
+            stamps_[set * ways_ + w] = ++clock_;
+            return;
+        }
+        uint64_t &mru = mru_[set];
+        mru |= 1ull << w;
+        if (mru == full_) mru = 1ull << w;
+    }
+
+    int victim(size_t set) const {
+        const uint64_t *tags = &tags_[set * ways_];
+        for (int w = 0; w < ways_; ++w)
+            if (tags[w] == INVALID_BLOCK) return w;
+        if (config_.policy == PLRU)
+            return __builtin_ctzll(~mru_[set]);
+        const uint64_t *s = &stamps_[set * ways_];
+        int v = 0;
+        for (int w = 1; w < ways_; ++w)
+            if (s[w] < s[v]) v = w;
+        return v;
+    }
+};
+
+// L1D, L2, ... from the detected topology
+inline std::vector<LevelConfig> topology_caches(
+        Policy policy = LRU, bool prefetch = false) {
+    std::vector<LevelConfig> levels;
+    for (const auto &c : topology::info().caches)
+        levels.push_back({"L" + std::to_string(c.level), c.size,
+                c.ways > 0 ? c.ways : 8, c.line_size, policy, prefetch});
+    return levels;
+}
+
+// a typical dTLB and STLB for 4 KiB pages, the sizes are not detected
+inline std::vector<LevelConfig> default_tlbs(Policy policy = LRU) {
+    return {{"dTLB", 64 * 4096, 4, 4096, policy, false},
+            {"STLB", 1536 * 4096, 12, 4096, policy, false}};
+}
+
+class Hierarchy {
+public:
+    Hierarchy(const std::vector<LevelConfig> &caches,
+            const std::vector<LevelConfig> &tlbs = {}) {
+        for (const auto &c : caches)
+            caches_.emplace_back(c);
+        for (const auto &t : tlbs)
+            tlbs_.emplace_back(t);
+        cache_stats_.resize(caches_.size());
+        tlb_stats_.resize(tlbs_.size());
+        line_shift_ = shift_of(caches_.empty() ? 64 : caches.front().line);
+        page_shift_ = shift_of(tlbs_.empty() ? 4096 : tlbs.front().line);
+    }
+
+    // one demand access
+    void access(uint64_t addr) {
+        if (!tlbs_.empty()) {
+            uint64_t page = addr >> page_shift_;
+            if (page == last_page_)
+                ++tlb_stats_[0].accesses;
+            else
+                lookup(tlbs_, tlb_stats_, page);
+            last_page_ = page;
+        }
+        if (caches_.empty()) return;
+        uint64_t line = addr >> line_shift_;
+        if (line == last_line_) {
+            ++cache_stats_[0].accesses;
+            return;
+        }
+        lookup(caches_, cache_stats_, line);
+        last_line_ = line;
+    }
+
+    // decode a chunk of trace and simulate it
+    void consume(const uint8_t *data, size_t n) {
+        const uint8_t *end = data + n;
+        while (data < end) {
+            uint64_t v = 0;
+            int shift = 0;
+            uint8_t b;
+            do {
+                b = *data++;
+                v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            uint64_t &addr = prev_[v % TRACE_STREAMS];
+            v /= TRACE_STREAMS;
+            addr += (v >> 1) ^ (~(v & 1) + 1);
+            access(addr);
+        }
+    }
+
+    const std::vector<Cache> &caches() const { return caches_; }
+    const std::vector<Cache> &tlbs() const { return tlbs_; }
+    const Stats &cache_stats(size_t level) const { return cache_stats_[level]; }
+    const Stats &tlb_stats(size_t level) const { return tlb_stats_[level]; }
+
+    // cold caches and zero counts
+    void reset() {
+        for (auto &c : caches_)
+            c.clear();
+        for (auto &t : tlbs_)
+            t.clear();
+        for (auto &s : cache_stats_)
+            s = Stats();
+        for (auto &s : tlb_stats_)
+            s = Stats();
+        last_line_ = last_page_ = ~0ull;
+        std::fill(prev_, prev_ + TRACE_STREAMS, 0);
+    }
+
+    void print(FILE *out = stdout) const {
+        auto print_level = [out](const Cache &c, const Stats &s) {
+            fprintf(out,
+                    "%6s %8zu KiB %3d-way %5s%s: %14llu accesses %14llu "
+                    "misses (%.2f%%) %12llu prefetches\n",
+                    c.config().name.c_str(), c.config().size / 1024,
+                    c.config().ways, policy_name(c.config().policy),
+                    c.config().prefetch ? "+pf" : "   ",
+                    static_cast<unsigned long long>(s.accesses),
+                    static_cast<unsigned long long>(s.misses),
+                    100. * s.miss_rate(),
+                    static_cast<unsigned long long>(s.prefetches));
+        };
+        for (size_t i = 0; i < caches_.size(); ++i)
+            print_level(caches_[i], cache_stats_[i]);
+        for (size_t i = 0; i < tlbs_.size(); ++i)
+            print_level(tlbs_[i], tlb_stats_[i]);
+    }
+
+private:
+    std::vector<Cache> caches_;
+    std::vector<Cache> tlbs_;
+    std::vector<Stats> cache_stats_;
+    std::vector<Stats> tlb_stats_;
+    int line_shift_;
+    int page_shift_;
+    uint64_t last_line_ {~0ull};
+    uint64_t last_page_ {~0ull};
+    // last address of every trace stream decoded so far
+    uint64_t prev_[TRACE_STREAMS] {};
+
+    static int shift_of(size_t bytes) {
+        int s = 0;
+        while ((static_cast<size_t>(1) << (s + 1)) <= bytes)
+            ++s;
+        return s;
+    }
+
+    static void lookup(
+            std::vector<Cache> &levels, std::vector<Stats> &stats, uint64_t b) {
+        for (size_t i = 0; i < levels.size(); ++i) {
+            ++stats[i].accesses;
+            if (levels[i].access(b)) return;
+            ++stats[i].misses;
+            if (levels[i].config().prefetch && !levels[i].contains(b + 1)) {
+                ++stats[i].prefetches;
+                levels[i].access(b + 1);
+                for (size_t j = i + 1; j < levels.size(); ++j)
+                    if (levels[j].access(b + 1)) break;
+            }
+        }
+    }
+};
+
+// encodes addresses into chunks handed to a sink
+class TraceWriter {
+public:
+    using Sink = std::function<void(const uint8_t *, size_t)>;
+
+    explicit TraceWriter(Sink sink, size_t chunk_bytes = 1 << 20)
+        : sink_(std::move(sink)), buf_(chunk_bytes < 64 ? 64 : chunk_bytes) {}
+
+    ~TraceWriter() { flush(); }
+
+    void record(uint64_t addr) {
+        if (pos_ + 10 > buf_.size()) flush();
+        int s = 0;
+        uint64_t best = distance(addr, prev_[0]);
+        for (int i = 1; i < TRACE_STREAMS; ++i) {
+            uint64_t d = distance(addr, prev_[i]);
+            if (d < best) {
+                best = d;
+                s = i;
+            }
+        }
+        if (best > TRACE_NEAR) {
+            s = next_;
+            next_ = (next_ + 1) % TRACE_STREAMS;
+        }
+        uint64_t d = addr - prev_[s];
+        // zigzag: small negative deltas stay small
+        uint64_t v = ((d << 1) ^ (0 - (d >> 63))) * TRACE_STREAMS + s;
+        while (v >= 0x80) {
+            buf_[pos_++] = static_cast<uint8_t>(v | 0x80);
+            v >>= 7;
+        }
+        buf_[pos_++] = static_cast<uint8_t>(v);
+        prev_[s] = addr;
+        ++records_;
+    }
+
+    void record(const void *p) {
+        record(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)));
+    }
+
+    void flush() {
+        if (!pos_) return;
+        sink_(buf_.data(), pos_);
+        bytes_ += pos_;
+        pos_ = 0;
+    }
+
+    uint64_t records() const { return records_; }
+    // bytes handed to the sink so far
+    uint64_t bytes() const { return bytes_; }
+
+    // sink writing [uint32_t length][chunk] frames to a file
+    static Sink to_file(FILE *f) {
+        return [f](const uint8_t *data, size_t n) {
+            uint32_t len = static_cast<uint32_t>(n);
+            fwrite(&len, sizeof(len), 1, f);
+            fwrite(data, 1, n, f);
+        };
+    }
+
+    static Sink to_hierarchy(Hierarchy &h) {
+        return [&h](const uint8_t *data, size_t n) { h.consume(data, n); };
+    }
+
+private:
+    static uint64_t distance(uint64_t a, uint64_t b) {
+        return a > b ? a - b : b - a;
+    }
+
+    Sink sink_;
+    std::vector<uint8_t> buf_;
+    size_t pos_ {0};
+    uint64_t prev_[TRACE_STREAMS] {};
+    int next_ {0};
+    uint64_t records_ {0};
+    uint64_t bytes_ {0};
+};
+
+// feed the frames of a trace file to sink, false on a truncated file
+inline bool read_trace(FILE *f, const TraceWriter::Sink &sink) {
+    std::vector<uint8_t> buf;
+    uint32_t len;
+    while (fread(&len, sizeof(len), 1, f) == 1) {
+        buf.resize(len);
+        if (fread(buf.data(), 1, len, f) != len) return false;
+        sink(buf.data(), len);
+    }
+    return true;
+}
+
+// an array that records the address of every element it hands out, for the
+// templated kernels of matmul_kernels.hpp
+template <typename T>
+struct TracedArray {
+    T *p;
+    TraceWriter *trace;
+
+    T &operator[](size_t i) const {
+        trace->record(p + i);
+        return p[i];
+    }
+    TracedArray operator+(size_t i) const { return {p + i, trace}; }
+};
+
+} // namespace cache_sim
+
+#endif // CACHE_SIM_HPP_
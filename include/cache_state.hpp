@@ -0,0 +1,176 @@
+// Deterministic cache state before a timed region: flushed, evicted or warm
+#ifndef CACHE_STATE_HPP_
+#define CACHE_STATE_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "bench.hpp"
+#include "topology.hpp"
+
+// Replaces the per-benchmark clear_cache() sweeps. A benchmark registers the
+// buffers it works on and asks for one state before every repetition:
+//  * flushed: every line of the registered buffers is written back and
+//    invalidated in all cache levels with clflushopt (clflush on older
+//    CPUs), followed by mfence; only the benchmark's own data goes cold, at a
+//    cost proportional to the buffers, and the TLB stays warm
+//  * evicted: a read sweep over a buffer sized from the LLC (flush_size()),
+//    which also evicts code, stack and TLB entries, like a cold process
+//  * warm: one read per line of the registered buffers, so they start in
+//    the closest level that holds them
+//
+// Take-aways
+//  ** flushing is exact and cheap; an eviction sweep depends on the
+//     replacement policy and costs a pass over twice the LLC
+//  ** do the preparation in the setup of a case, outside the timed region
+//  ** the sweeps feed a volatile sink, so they cannot be optimized away
+namespace cache_state {
+
+enum State { FLUSHED = 0, EVICTED, WARM };
+
+inline const char *state_name(State s) {
+    static const char *names[] = {"flushed", "evicted", "warm"};
+    return names[s];
+}
+
+// "flushed", "evicted" or "warm", false if unknown
+inline bool parse_state(const std::string &name, State &s) {
+    for (int i = FLUSHED; i <= WARM; ++i)
+        if (name == state_name(static_cast<State>(i))) {
+            s = static_cast<State>(i);
+            return true;
+        }
+    return false;
+}
+
+// the --cache option of the benchmarks, def if absent or unknown
+inline State option(bench::Options &opts, State def = FLUSHED) {
+    std::string name = opts.get_string("cache", state_name(def),
+            "cache state before each repetition: flushed, evicted or warm");
+    State s = def;
+    if (!parse_state(name, s))
+        fprintf(stderr, "unknown cache state %s, using %s\n", name.c_str(),
+                state_name(def));
+    return s;
+}
+
+namespace detail {
+
+inline volatile uintptr_t &sink() {
+    static volatile uintptr_t s = 0;
+    return s;
+}
+
+inline bool has_clflushopt() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool has = [] {
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+        return (ebx & (1u << 23)) != 0;
+    }();
+    return has;
+#else
+    return false;
+#endif
+}
+
+} // namespace detail
+
+// write back and invalidate every line of [p, p + bytes)
+inline void flush(const void *p, size_t bytes) {
+#if defined(__x86_64__) || defined(__i386__)
+    const size_t line = topology::info().line_size;
+    uintptr_t begin = reinterpret_cast<uintptr_t>(p) / line * line;
+    uintptr_t end = reinterpret_cast<uintptr_t>(p) + bytes;
+    if (detail::has_clflushopt()) {
+        for (uintptr_t a = begin; a < end; a += line)
+            asm volatile("clflushopt %0" : "+m"(*reinterpret_cast<char *>(a)));
+    } else {
+        for (uintptr_t a = begin; a < end; a += line)
+            _mm_clflush(reinterpret_cast<const void *>(a));
+    }
+    _mm_mfence();
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
+
+// read sweep over twice the LLC, evicts everything else
+inline void evict() {
+    static std::vector<char> buffer = [] {
+        std::vector<char> b(topology::info().flush_size());
+        // touched once here, so the first sweep does not pay page faults
+        memset(b.data(), 1, b.size());
+        return b;
+    }();
+    const size_t line = topology::info().line_size;
+    uintptr_t x = 0;
+    for (size_t i = 0; i < buffer.size(); i += line)
+        x += buffer[i];
+    detail::sink() = detail::sink() + x;
+}
+
+// read every line of [p, p + bytes)
+inline void warm(const void *p, size_t bytes) {
+    const size_t line = topology::info().line_size;
+    const char *c = static_cast<const char *>(p);
+    uintptr_t x = 0;
+    for (size_t i = 0; i < bytes; i += line)
+        x += c[i];
+    if (bytes) x += c[bytes - 1];
+    detail::sink() = detail::sink() + x;
+}
+
+// the buffers of one benchmark and the state they should start in
+class Buffers {
+public:
+    Buffers() = default;
+    explicit Buffers(State s) : state_(s) {}
+
+    Buffers &add(const void *p, size_t bytes) {
+        regions_.emplace_back(p, bytes);
+        return *this;
+    }
+
+    template <typename T>
+    Buffers &add(const std::vector<T> &v) {
+        return add(v.data(), v.size() * sizeof(T));
+    }
+
+    void clear() { regions_.clear(); }
+
+    State state() const { return state_; }
+    void set_state(State s) { state_ = s; }
+    const char *name() const { return state_name(state_); }
+
+    // bring the buffers into state(), call it from the setup of a case
+    void prepare() const {
+        switch (state_) {
+            case FLUSHED:
+                for (const auto &r : regions_)
+                    flush(r.first, r.second);
+                break;
+            case EVICTED: evict(); break;
+            case WARM:
+                for (const auto &r : regions_)
+                    warm(r.first, r.second);
+                break;
+        }
+    }
+
+private:
+    State state_ {FLUSHED};
+    std::vector<std::pair<const void *, size_t>> regions_;
+};
+
+} // namespace cache_state
+#endif
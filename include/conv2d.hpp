@@ -0,0 +1,286 @@
+// 2-D convolution lowered to the blocked matmul, and direct on blocked channels
+#ifndef CONV2D_HPP_
+#define CONV2D_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "matmul_kernels.hpp"
+
+// out[n][k][p][q] = sum over c, r, s of in[n][c][p * stride + r - pad]
+// [q * stride + s - pad] * w[k][c][r][s] (cross-correlation, zero padding),
+// in two forms:
+//  * im2col: every output pixel gets a column of the C * R * S input values
+//    it needs, and the convolution is one [K x CRS] x [CRS x PQ] matmul
+//    (block_gemm of matmul_kernels). The columns repeat every input value
+//    R * S / stride^2 times, in memory and in traffic. A 1x1 stride-1
+//    convolution needs no columns: the input already is the matrix
+//  * direct: input and output in NCHW16c (channels in blocks of 16, the 16
+//    channels of a pixel contiguous), weights in KCRS16c16k. A register tile
+//    of CONV_TILE_Q output pixels x 16 output channels accumulates over every
+//    input channel, r and s before it is stored once; each weight vector is
+//    loaded once per tile and each input value broadcast across 16 lanes
+// reorder_input / reorder_output / reorder_weights convert between the
+// plain and the blocked layouts, padding the channels to multiples of 16.
+//
+// Take-aways
+//  ** im2col costs R * S times the input in extra memory and a full write
+//     and read of it per image; it buys a plain matmul with all its blocking
+//  ** the direct kernel reads the input in place; blocking channels by the
+//     vector width makes the channel loop a vector loop over contiguous data
+//  ** a blocked layout pays off when the network stays in it: reorder once
+//     at the edges, not around every convolution
+namespace conv2d {
+
+// channels per block of the blocked layouts
+#define CONV_BLOCK (16)
+// output pixels per register tile of the direct kernel
+#define CONV_TILE_Q (4)
+
+struct Shape {
+    int n {1};
+    int c {0};
+    int h {0};
+    int w {0};
+    int k {0};
+    int r {3};
+    int s {3};
+    int stride {1};
+    int pad {1};
+
+    int p() const { return (h + 2 * pad - r) / stride + 1; }
+    int q() const { return (w + 2 * pad - s) / stride + 1; }
+    int c_blocks() const { return (c + CONV_BLOCK - 1) / CONV_BLOCK; }
+    int k_blocks() const { return (k + CONV_BLOCK - 1) / CONV_BLOCK; }
+    double flops() const {
+        return 2. * n * k * p() * q() * c * r * s;
+    }
+    // elements of the plain tensors
+    size_t input_size() const { return static_cast<size_t>(n) * c * h * w; }
+    size_t weight_size() const { return static_cast<size_t>(k) * c * r * s; }
+    size_t output_size() const {
+        return static_cast<size_t>(n) * k * p() * q();
+    }
+    // elements of the blocked tensors
+    size_t blocked_input_size() const {
+        return static_cast<size_t>(n) * c_blocks() * h * w * CONV_BLOCK;
+    }
+    size_t blocked_weight_size() const {
+        return static_cast<size_t>(k_blocks()) * c_blocks() * r * s
+                * CONV_BLOCK * CONV_BLOCK;
+    }
+    size_t blocked_output_size() const {
+        return static_cast<size_t>(n) * k_blocks() * p() * q() * CONV_BLOCK;
+    }
+    bool pointwise() const {
+        return r == 1 && s == 1 && stride == 1 && pad == 0;
+    }
+    // elements of the im2col buffer, one image at a time
+    size_t columns_size() const {
+        return pointwise() ? 0
+                           : static_cast<size_t>(c) * r * s * p() * q();
+    }
+};
+
+// the definition, for checking
+inline void reference(const Shape &sh, const float *in, const float *w,
+        float *out) {
+    const int P = sh.p(), Q = sh.q();
+    for (int n = 0; n < sh.n; ++n)
+        for (int k = 0; k < sh.k; ++k)
+            for (int p = 0; p < P; ++p)
+                for (int q = 0; q < Q; ++q) {
+                    double sum = 0.;
+                    for (int c = 0; c < sh.c; ++c)
+                        for (int r = 0; r < sh.r; ++r)
+                            for (int s = 0; s < sh.s; ++s) {
+                                int y = p * sh.stride + r - sh.pad;
+                                int x = q * sh.stride + s - sh.pad;
+                                if (y < 0 || y >= sh.h || x < 0 || x >= sh.w)
+                                    continue;
+                                sum += static_cast<double>(
+                                               in[((static_cast<size_t>(n) * sh.c + c)
+                                                          * sh.h
+                                                  + y) * sh.w + x])
+                                        * w[((static_cast<size_t>(k) * sh.c + c)
+                                                    * sh.r
+                                                    + r) * sh.s + s];
+                            }
+                    out[((static_cast<size_t>(n) * sh.k + k) * P + p) * Q + q]
+                            = static_cast<float>(sum);
+                }
+}
+
+// --- im2col + blocked matmul ---
+
+// columns[(c * R + r) * S + s][p * Q + q] of one image
+inline void im2col(const Shape &sh, const float *image, float *columns) {
+    const int P = sh.p(), Q = sh.q();
+    for (int c = 0; c < sh.c; ++c)
+        for (int r = 0; r < sh.r; ++r)
+            for (int s = 0; s < sh.s; ++s) {
+                float *row = columns
+                        + static_cast<size_t>((c * sh.r + r) * sh.s + s) * P * Q;
+                for (int p = 0; p < P; ++p) {
+                    int y = p * sh.stride + r - sh.pad;
+                    float *dst = row + static_cast<size_t>(p) * Q;
+                    if (y < 0 || y >= sh.h) {
+                        std::fill(dst, dst + Q, 0.f);
+                        continue;
+                    }
+                    const float *src = image + (static_cast<size_t>(c) * sh.h + y) * sh.w;
+                    for (int q = 0; q < Q; ++q) {
+                        int x = q * sh.stride + s - sh.pad;
+                        dst[q] = x >= 0 && x < sh.w ? src[x] : 0.f;
+                    }
+                }
+            }
+}
+
+// out = conv(in, w) through im2col; columns holds columns_size() and packed
+// MM_BLOCK_SIZE^2 elements
+inline void im2col_gemm(const Shape &sh, const float *in, const float *w,
+        float *out, float *columns, float *packed) {
+    const int PQ = sh.p() * sh.q();
+    const int CRS = sh.c * sh.r * sh.s;
+    for (int n = 0; n < sh.n; ++n) {
+        const float *image = in + static_cast<size_t>(n) * sh.c * sh.h * sh.w;
+        float *o = out + static_cast<size_t>(n) * sh.k * PQ;
+        float *b = const_cast<float *>(image);
+        if (!sh.pointwise()) {
+            im2col(sh, image, columns);
+            b = columns;
+        }
+        std::fill(o, o + static_cast<size_t>(sh.k) * PQ, 0.f);
+        matmul_kernels::block_gemm(
+                const_cast<float *>(w), b, o, packed, sh.k, PQ, CRS);
+    }
+}
+
+// --- blocked layouts ---
+
+// NCHW -> NCHW16c, channels past c zeroed
+inline void reorder_input(const Shape &sh, const float *src, float *dst) {
+    const size_t hw = static_cast<size_t>(sh.h) * sh.w;
+    for (int n = 0; n < sh.n; ++n)
+        for (int cb = 0; cb < sh.c_blocks(); ++cb) {
+            float *d = dst + (static_cast<size_t>(n) * sh.c_blocks() + cb) * hw
+                            * CONV_BLOCK;
+            for (size_t i = 0; i < hw; ++i)
+                for (int l = 0; l < CONV_BLOCK; ++l) {
+                    int c = cb * CONV_BLOCK + l;
+                    d[i * CONV_BLOCK + l] = c < sh.c
+                            ? src[(static_cast<size_t>(n) * sh.c + c) * hw + i]
+                            : 0.f;
+                }
+        }
+}
+
+// NKPQ16k -> NKPQ, the padding channels dropped
+inline void reorder_output(const Shape &sh, const float *src, float *dst) {
+    const size_t pq = static_cast<size_t>(sh.p()) * sh.q();
+    for (int n = 0; n < sh.n; ++n)
+        for (int k = 0; k < sh.k; ++k) {
+            const float *s = src
+                    + (static_cast<size_t>(n) * sh.k_blocks() + k / CONV_BLOCK)
+                            * pq * CONV_BLOCK
+                    + k % CONV_BLOCK;
+            float *d = dst + (static_cast<size_t>(n) * sh.k + k) * pq;
+            for (size_t i = 0; i < pq; ++i)
+                d[i] = s[i * CONV_BLOCK];
+        }
+}
+
+// KCRS -> [K/16][C/16][R][S][16c][16k], padding zeroed
+inline void reorder_weights(const Shape &sh, const float *src, float *dst) {
+    size_t i = 0;
+    for (int kb = 0; kb < sh.k_blocks(); ++kb)
+        for (int cb = 0; cb < sh.c_blocks(); ++cb)
+            for (int r = 0; r < sh.r; ++r)
+                for (int s = 0; s < sh.s; ++s)
+                    for (int cl = 0; cl < CONV_BLOCK; ++cl)
+                        for (int kl = 0; kl < CONV_BLOCK; ++kl, ++i) {
+                            int k = kb * CONV_BLOCK + kl;
+                            int c = cb * CONV_BLOCK + cl;
+                            dst[i] = k < sh.k && c < sh.c
+                                    ? src[((static_cast<size_t>(k) * sh.c + c)
+                                                  * sh.r
+                                                  + r) * sh.s + s]
+                                    : 0.f;
+                        }
+}
+
+// --- direct convolution on the blocked layouts ---
+
+namespace detail {
+
+// T output pixels from (p, q0) of output channel block kb
+template <int T>
+inline void direct_tile(const Shape &sh, const float *image, const float *w,
+        float *out, int p, int q0) {
+    float acc[T][CONV_BLOCK] = {};
+    const size_t plane = static_cast<size_t>(sh.h) * sh.w * CONV_BLOCK;
+    for (int cb = 0; cb < sh.c_blocks(); ++cb) {
+        const float *in = image + cb * plane;
+        for (int r = 0; r < sh.r; ++r) {
+            int y = p * sh.stride + r - sh.pad;
+            if (y < 0 || y >= sh.h) continue;
+            const float *row = in + static_cast<size_t>(y) * sh.w * CONV_BLOCK;
+            for (int s = 0; s < sh.s; ++s) {
+                const float *ws = w
+                        + ((static_cast<size_t>(cb) * sh.r + r) * sh.s + s)
+                                * CONV_BLOCK * CONV_BLOCK;
+                // the input pixel of every output of the tile, or none
+                const float *px[T];
+                for (int t = 0; t < T; ++t) {
+                    int x = (q0 + t) * sh.stride + s - sh.pad;
+                    px[t] = x >= 0 && x < sh.w ? row + x * CONV_BLOCK : nullptr;
+                }
+                for (int cl = 0; cl < CONV_BLOCK; ++cl) {
+                    const float *wv = ws + cl * CONV_BLOCK;
+                    for (int t = 0; t < T; ++t) {
+                        if (!px[t]) continue;
+                        float v = px[t][cl];
+                        for (int kl = 0; kl < CONV_BLOCK; ++kl)
+                            acc[t][kl] += v * wv[kl];
+                    }
+                }
+            }
+        }
+    }
+    for (int t = 0; t < T; ++t)
+        std::memcpy(out + (static_cast<size_t>(p) * sh.q() + q0 + t) * CONV_BLOCK,
+                acc[t], sizeof(acc[t]));
+}
+
+} // namespace detail
+
+// out = conv(in, w) with in, w and out in the blocked layouts
+inline void direct(const Shape &sh, const float *in, const float *w,
+        float *out) {
+    const int P = sh.p(), Q = sh.q();
+    const size_t in_image = static_cast<size_t>(sh.c_blocks()) * sh.h * sh.w
+            * CONV_BLOCK;
+    const size_t w_block = static_cast<size_t>(sh.c_blocks()) * sh.r * sh.s
+            * CONV_BLOCK * CONV_BLOCK;
+    const size_t out_block = static_cast<size_t>(P) * Q * CONV_BLOCK;
+    for (int n = 0; n < sh.n; ++n)
+        for (int kb = 0; kb < sh.k_blocks(); ++kb) {
+            const float *image = in + n * in_image;
+            const float *wk = w + kb * w_block;
+            float *o = out + (static_cast<size_t>(n) * sh.k_blocks() + kb)
+                            * out_block;
+            for (int p = 0; p < P; ++p) {
+                int q = 0;
+                for (; q + CONV_TILE_Q <= Q; q += CONV_TILE_Q)
+                    detail::direct_tile<CONV_TILE_Q>(sh, image, wk, o, p, q);
+                for (; q < Q; ++q)
+                    detail::direct_tile<1>(sh, image, wk, o, p, q);
+            }
+        }
+}
+
+} // namespace conv2d
+
+#endif // CONV2D_HPP_
@@ -5,6 +5,9 @@
 #include <memory>
 #include <vector>
 
+#include "numa.hpp"
+#include "sharded_counter.hpp"
+
 namespace dynamic_mempool {
 
 // Memory pool with dynamic management
@@ -15,10 +18,12 @@ namespace dynamic_mempool {
 // Take-aways
 //  ** linear search complexity
 //  ** poor data locality - not contiguous between adjacent nodes
+//  ** fresh chunks come from a node-local arena, so a pool per NUMA node
+//     hands out memory close to the threads of that node
 class MemoryPool {
 private:
-    // default ctor
-    MemoryPool() {
+    // default ctor, node < 0 keeps the default memory policy
+    explicit MemoryPool(int node = -1) : arena_(node) {
         Entry e;
         e.data = nullptr;
         e.size = 0;
@@ -31,12 +36,20 @@ private:
     ~MemoryPool() { release(); }
 
 public:
-    // Singleton instance
-    static MemoryPool &Instance() {
-        static MemoryPool inst;
-        return inst;
+    // Singleton instance, one per NUMA node (node < 0: default policy)
+    static MemoryPool &Instance(int node = -1) {
+        if (node < 0 || node >= NUMA_MAX_NODES) {
+            static MemoryPool inst;
+            return inst;
+        }
+        // created on first use, live as long as the program
+        static MemoryPool *per_node[NUMA_MAX_NODES] = {};
+        if (!per_node[node]) per_node[node] = new MemoryPool(node);
+        return *per_node[node];
     }
 
+    int node() const { return arena_.node(); }
+
     // allocate a memory chunk of size n
     // add to allocated_list_
     // search time complexity: O(N)
@@ -50,8 +63,7 @@ public:
         int delete_idx = -1;
         // no proper memory size
         if (free_list_.back().size < n) {
-            std::unique_ptr<char> mem_ptr = std::make_unique<char>(n);
-            e.data = mem_ptr.release();
+            e.data = arena_.allocate(n, alignment);
             e.size = n;
         } else {
             for (int i = free_list_.size(); i >= 0; --i) {
@@ -66,6 +78,8 @@ public:
         }
 
         allocated_list_.push_back(e);
+        stats_.allocations.add();
+        stats_.bytes_in_use.add(e.size);
         std::cout << "Allocating " << e.size << " bytes from memory pool!\n";
         return e.data;
     }
@@ -98,6 +112,11 @@ public:
             }
         }
 
+        if (e.data) {
+            stats_.deallocations.add();
+            stats_.bytes_in_use.sub(e.size);
+        }
+
         // add into free_list_
         if (free_list_.back().size < e.size) {
             free_list_.push_back(e);
@@ -119,30 +138,23 @@ public:
     }
 
     // free all resources listed in free_list_ and allocated_list_
+    // every chunk lives in the arena, so they are returned all at once
     void release() {
-        for (auto &item : allocated_list_) {
-            if (!item.data) {
-                char *ptr = static_cast<char *>(item.data);
-                delete[] ptr;
-                item.data = nullptr;
-                item.size = 0;
-            }
-        }
-
-        for (auto &item : free_list_) {
-            if (!item.data) {
-                char *ptr = static_cast<char *>(item.data);
-                delete[] ptr;
-                item.data = nullptr;
-                item.size = 0;
-            }
-        }
-
+        arena_.release();
         allocated_list_.clear();
         free_list_.clear();
         std::cout << "Release all resources in the memory pool!\n";
     }
 
+    // usage counters, cheap to update and safe to read from any thread
+    struct Stats {
+        concurrent::ShardedCounter allocations;
+        concurrent::ShardedCounter deallocations;
+        concurrent::ShardedCounter bytes_in_use;
+    };
+
+    const Stats &stats() const { return stats_; }
+
 private:
     struct Entry {
         // pointer to memory chunk
@@ -151,10 +163,13 @@ private:
         size_t size;
     };
 
+    // node-local backing memory of all chunks
+    numa::Arena arena_;
     // list of allocated memory chunks
     std::vector<Entry> allocated_list_;
     // list of free memory chunks, sorted by increasing order
     std::vector<Entry> free_list_;
+    Stats stats_;
 };
 
 } // namespace dynamic_mempool
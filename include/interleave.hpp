@@ -0,0 +1,242 @@
+// Batched lookups that overlap their cache misses by interleaving
+#ifndef INTERLEAVE_HPP_
+#define INTERLEAVE_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// A lookup into a structure larger than the caches misses at every hop, and
+// the next hop depends on the miss, so one lookup keeps at most one miss in
+// flight. run() keeps K lookups in flight per thread instead: each lookup is
+// a small state machine that prefetches the address of its next hop and
+// yields, and the executor steps the next lookup while the line arrives
+// (the hand-written form of a C++20 coroutine that suspends after a
+// prefetch).
+//
+// A Machine provides
+//  * key_type, result_type and State
+//  * start(State &, key): set up a lookup and prefetch its first address
+//  * step(State &) -> bool: one hop on the prefetched line; prefetch the next
+//    address and return false, or return true when the lookup is done
+//  * result(const State &) -> result_type
+// HashTable::Lookup and SortedSearch are the machines of a chained hash table
+// and of a branch-free binary search.
+//
+// Take-aways
+//  ** K independent lookups overlap up to K misses; the gain stops at the
+//     number of line fill buffers (10-12 per core on x86), or earlier when
+//     the state of K lookups no longer fits the registers and L1
+//  ** switching costs a few instructions per hop, so it only pays for data
+//     well beyond L2
+//  ** the hops at the top of a binary search stay in cache, only the last
+//     few levels miss; a hash probe misses on the bucket and on every node
+namespace interleave {
+
+inline void prefetch(const void *p) { __builtin_prefetch(p, 0, 3); }
+
+// results of keys[0, n) into out, with up to k lookups in flight
+template <typename Machine>
+void run(const Machine &m, const typename Machine::key_type *keys, size_t n,
+        typename Machine::result_type *out, size_t k) {
+    using State = typename Machine::State;
+    k = std::max<size_t>(1, std::min(k, n));
+    if (n == 0) return;
+    std::vector<State> states(k);
+    std::vector<size_t> index(k);
+    size_t next = 0;
+    size_t active = 0;
+    for (; active < k; ++active) {
+        m.start(states[active], keys[next]);
+        index[active] = next++;
+    }
+    // round robin over the active slots; a finished slot takes the next key,
+    // or the last active slot once the keys run out
+    while (active > 0) {
+        for (size_t s = 0; s < active;) {
+            if (!m.step(states[s])) {
+                ++s;
+                continue;
+            }
+            out[index[s]] = m.result(states[s]);
+            if (next < n) {
+                m.start(states[s], keys[next]);
+                index[s] = next++;
+                ++s;
+            } else {
+                --active;
+                states[s] = states[active];
+                index[s] = index[active];
+            }
+        }
+    }
+}
+
+inline uint64_t mix(uint64_t x) {
+    // murmur3 finalizer
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// chained hash table of at most capacity entries, one node per entry from a
+// pool, a power-of-two number of buckets
+template <typename K, typename V, typename Hash = std::hash<K>>
+class HashTable {
+public:
+    struct Node {
+        K key;
+        V value;
+        Node *next;
+    };
+
+    // buckets: average chain length of capacity / buckets once full
+    explicit HashTable(size_t capacity, size_t buckets = 0)
+        : capacity_(capacity) {
+        size_t b = 1;
+        size_t want = buckets ? buckets : std::max<size_t>(1, capacity / 2);
+        while (b < want)
+            b <<= 1;
+        buckets_.assign(b, nullptr);
+        mask_ = b - 1;
+        nodes_.reserve(capacity);
+    }
+
+    size_t size() const { return nodes_.size(); }
+    size_t num_buckets() const { return buckets_.size(); }
+    size_t bytes() const {
+        return buckets_.size() * sizeof(Node *) + nodes_.size() * sizeof(Node);
+    }
+
+    // false if the key is present or the table is full
+    bool insert(const K &key, const V &value) {
+        Node *&head = buckets_[bucket(key)];
+        for (Node *p = head; p; p = p->next)
+            if (p->key == key) return false;
+        if (nodes_.size() == capacity_) return false;
+        nodes_.push_back({key, value, head});
+        head = &nodes_.back();
+        return true;
+    }
+
+    // the sequential lookup
+    const V *find(const K &key) const {
+        for (const Node *p = buckets_[bucket(key)]; p; p = p->next)
+            if (p->key == key) return &p->value;
+        return nullptr;
+    }
+
+    // the interleaved lookup: bucket, then one node per step
+    class Lookup {
+    public:
+        using key_type = K;
+        using result_type = const V *;
+        struct State {
+            K key;
+            const Node *const *bucket;
+            const Node *node;
+        };
+
+        explicit Lookup(const HashTable &t) : t_(&t) {}
+
+        void start(State &s, const K &key) const {
+            s.key = key;
+            s.bucket = &t_->buckets_[t_->bucket(key)];
+            s.node = nullptr;
+            prefetch(s.bucket);
+        }
+        bool step(State &s) const {
+            if (s.bucket) {
+                s.node = *s.bucket;
+                s.bucket = nullptr;
+            } else if (s.node->key == s.key) {
+                return true;
+            } else {
+                s.node = s.node->next;
+            }
+            if (!s.node) return true;
+            prefetch(s.node);
+            return false;
+        }
+        const V *result(const State &s) const {
+            return s.node ? &s.node->value : nullptr;
+        }
+
+    private:
+        const HashTable *t_;
+    };
+
+    Lookup lookup() const { return Lookup(*this); }
+
+private:
+    size_t capacity_;
+    size_t mask_;
+    std::vector<Node *> buckets_;
+    // reserved up front, so nodes never move
+    std::vector<Node> nodes_;
+
+    size_t bucket(const K &key) const {
+        return mix(static_cast<uint64_t>(Hash()(key))) & mask_;
+    }
+};
+
+// lower bound in a sorted array, one halving per step:
+// base moves up by half while a[base + half] < key
+template <typename T>
+class SortedSearch {
+public:
+    using key_type = T;
+    using result_type = size_t;
+    struct State {
+        T key;
+        size_t base;
+        size_t len;
+    };
+
+    SortedSearch(const T *a, size_t n) : a_(a), n_(n) {}
+
+    // the sequential lookup, the same branch-free halving
+    size_t lower_bound(const T &key) const {
+        if (n_ == 0) return 0;
+        size_t base = 0;
+        size_t len = n_;
+        while (len > 1) {
+            size_t half = len / 2;
+            base = a_[base + half] < key ? base + half : base;
+            len -= half;
+        }
+        return base + (a_[base] < key);
+    }
+
+    void start(State &s, const T &key) const {
+        s.key = key;
+        s.base = 0;
+        s.len = n_;
+        if (n_ > 0) prefetch(a_ + n_ / 2);
+    }
+    bool step(State &s) const {
+        if (s.len > 1) {
+            size_t half = s.len / 2;
+            s.base = a_[s.base + half] < s.key ? s.base + half : s.base;
+            s.len -= half;
+            prefetch(a_ + s.base + (s.len > 1 ? s.len / 2 : 0));
+            return false;
+        }
+        if (s.len == 1) s.base += a_[s.base] < s.key;
+        return true;
+    }
+    size_t result(const State &s) const { return s.base; }
+
+private:
+    const T *a_;
+    size_t n_;
+};
+
+} // namespace interleave
+
+#endif // INTERLEAVE_HPP_
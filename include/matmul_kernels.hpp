@@ -0,0 +1,197 @@
+// The matmul loop nests of the locality examples, shared by the benchmarks
+// and the tools that analyze them
+#ifndef MATMUL_KERNELS_HPP_
+#define MATMUL_KERNELS_HPP_
+
+#include <string>
+#include <type_traits>
+
+#include "mem_ops.hpp"
+
+// C = A x B for row-major [n x n] matrices:
+//  * the six loop orders of 3_spatial_locality (C must be zeroed first for
+//    all but mnk and nmk, which overwrite it)
+//  * the blocked knm of 4_temporal_locality, with sub-blocks of B packed into
+//    an L1-sized buffer (n must be a multiple of MM_BLOCK_SIZE), and its
+//    rectangular form block_gemm for any m, n, k (C += A x B)
+// The matrices are taken as any type with operator[] returning a reference
+// and an offset operator+: raw pointers for timing, or arrays that record
+// every access for analysis.
+//
+// Each kernel comes with the bytes its loads and stores move per innermost
+// iteration, which gives its arithmetic intensity (2 flops per iteration)
+// as seen by the core.
+namespace matmul_kernels {
+
+// This size should be:
+//  - not too large, make sure (2 * MM_BLOCK_SIZE + MM_BLOCK_SIZE^2) is smaller
+//      than the size of L1 cache
+//  - not too small, make full use of L1 cache and improve temporal locality
+//      as much as possible
+#define MM_BLOCK_SIZE (64)
+
+template <typename P>
+using value_t = typename std::decay<decltype(std::declval<P>()[0])>::type;
+
+// loop M -> loop N -> loop K
+template <typename P>
+void mnk(P A, P B, P C, int n) {
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            value_t<P> sum = 0.;
+            for (int k = 0; k < n; ++k) {
+                sum += A[i * n + k] * B[k * n + j];
+            }
+            C[i * n + j] = sum;
+        }
+    }
+}
+
+// loop N -> loop M -> loop K
+template <typename P>
+void nmk(P A, P B, P C, int n) {
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            value_t<P> sum = 0.;
+            for (int k = 0; k < n; ++k) {
+                sum += A[i * n + k] * B[k * n + j];
+            }
+            C[i * n + j] = sum;
+        }
+    }
+}
+
+// loop N -> loop K -> loop M
+template <typename P>
+void nkm(P A, P B, P C, int n) {
+    for (int j = 0; j < n; ++j) {
+        for (int k = 0; k < n; ++k) {
+            value_t<P> tmp = B[k * n + j];
+            for (int i = 0; i < n; ++i) {
+                C[i * n + j] += A[i * n + k] * tmp;
+            }
+        }
+    }
+}
+
+// loop K -> loop N -> loop M
+template <typename P>
+void knm(P A, P B, P C, int n) {
+    for (int k = 0; k < n; ++k) {
+        for (int j = 0; j < n; ++j) {
+            value_t<P> tmp = B[k * n + j];
+            for (int i = 0; i < n; ++i) {
+                C[i * n + j] += A[i * n + k] * tmp;
+            }
+        }
+    }
+}
+
+// loop K -> loop M -> loop N
+template <typename P>
+void kmn(P A, P B, P C, int n) {
+    for (int k = 0; k < n; ++k) {
+        for (int i = 0; i < n; ++i) {
+            value_t<P> tmp = A[i * n + k];
+            for (int j = 0; j < n; ++j) {
+                C[i * n + j] += tmp * B[k * n + j];
+            }
+        }
+    }
+}
+
+// loop M -> loop K -> loop N
+// best spatial locality
+template <typename P>
+void mkn(P A, P B, P C, int n) {
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < n; ++k) {
+            value_t<P> tmp = A[i * n + k];
+            for (int j = 0; j < n; ++j) {
+                C[i * n + j] += tmp * B[k * n + j];
+            }
+        }
+    }
+}
+
+// pack the [MM_BLOCK_SIZE x MM_BLOCK_SIZE] block at src (leading dimension
+// ld) into dst
+template <typename P>
+void pack_block(P dst, P src, int ld) {
+    for (int r = 0; r < MM_BLOCK_SIZE; ++r)
+        for (int c = 0; c < MM_BLOCK_SIZE; ++c)
+            dst[r * MM_BLOCK_SIZE + c] = src[r * ld + c];
+}
+
+inline void pack_block(float *dst, float *src, int ld) {
+    mem_ops::pack(dst, MM_BLOCK_SIZE * sizeof(float), src, ld * sizeof(float),
+            MM_BLOCK_SIZE, MM_BLOCK_SIZE * sizeof(float));
+}
+
+// loop K -> loop N -> loop M on blocks, packed holds
+// MM_BLOCK_SIZE * MM_BLOCK_SIZE elements
+template <typename P>
+void block_knm(P A, P B, P C, P packed, int n) {
+    for (int k = 0; k < n; k += MM_BLOCK_SIZE) {
+        for (int j = 0; j < n; j += MM_BLOCK_SIZE) {
+            // pack B
+            pack_block(packed, B + (k * n + j), n);
+            for (int i = 0; i < n; ++i) {
+                for (int kk = k; kk < k + MM_BLOCK_SIZE; ++kk) {
+                    value_t<P> tmp = A[i * n + kk];
+                    for (int jj = j; jj < j + MM_BLOCK_SIZE; ++jj) {
+                        C[i * n + jj] += tmp
+                                * packed[(kk - k) * MM_BLOCK_SIZE + (jj - j)];
+                        // may introduce more page faults if directly access
+                        // memory from B
+                        // C[i * n + jj] += tmp * B[kk * n + jj];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// pack the [rows x cols] tile at src (leading dimension ld) into dst, rows
+// MM_BLOCK_SIZE apart
+template <typename P>
+void pack_tile(P dst, P src, int ld, int rows, int cols) {
+    for (int r = 0; r < rows; ++r)
+        for (int c = 0; c < cols; ++c)
+            dst[r * MM_BLOCK_SIZE + c] = src[r * ld + c];
+}
+
+inline void pack_tile(float *dst, float *src, int ld, int rows, int cols) {
+    mem_ops::pack(dst, MM_BLOCK_SIZE * sizeof(float), src, ld * sizeof(float),
+            rows, cols * sizeof(float));
+}
+
+// block_knm for C[m x n] += A[m x k] * B[k x n], any sizes: the blocks at
+// the right and bottom edges are partial
+template <typename P>
+void block_gemm(P A, P B, P C, P packed, int m, int n, int k) {
+    for (int kb = 0; kb < k; kb += MM_BLOCK_SIZE) {
+        int kw = k - kb < MM_BLOCK_SIZE ? k - kb : MM_BLOCK_SIZE;
+        for (int jb = 0; jb < n; jb += MM_BLOCK_SIZE) {
+            int jw = n - jb < MM_BLOCK_SIZE ? n - jb : MM_BLOCK_SIZE;
+            pack_tile(packed, B + (kb * n + jb), n, kw, jw);
+            for (int i = 0; i < m; ++i) {
+                for (int kk = 0; kk < kw; ++kk) {
+                    value_t<P> tmp = A[i * k + kb + kk];
+                    for (int jj = 0; jj < jw; ++jj)
+                        C[i * n + jb + jj] += tmp * packed[kk * MM_BLOCK_SIZE + jj];
+                }
+            }
+        }
+    }
+}
+
+// loads and stores per innermost iteration: mnk and nmk load A and B and
+// keep the sum in a register, the others load and store C next to one load
+inline int accesses_per_iter(const std::string &name) {
+    return name == "mnk" || name == "nmk" ? 2 : 3;
+}
+
+} // namespace matmul_kernels
+
+#endif // MATMUL_KERNELS_HPP_
@@ -0,0 +1,326 @@
+// Size-dispatched copy, fill and pack
+#ifndef MEM_OPS_HPP_
+#define MEM_OPS_HPP_
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HAS_X86_MEMOPS (1)
+#endif
+
+#include "topology.hpp"
+
+// Bulk memory operations that pick a strategy by size:
+//  * inline: up to MEMOPS_INLINE_MAX bytes, a few overlapping 16-byte (or
+//    smaller) moves chosen by size class, no loop over the bytes
+//  * vector: 64 bytes per iteration, the tail as one overlapping move
+//  * rep: rep movsb / rep stosb, which the microcode runs with full cache
+//    line writes when the CPU has ERMS (and also fast for short sizes with
+//    FSRM)
+//  * nt: non-temporal stores for buffers larger than the LLC, which would
+//    only evict everything else and pay for reading the destination first
+// The size thresholds come from the detected caches and can be changed.
+//
+// Take-aways
+//  ** small copies are dominated by branches and call overhead, not bytes
+//  ** for medium sizes rep movsb is as fast as a vector loop on ERMS CPUs
+//  ** past the LLC, streaming stores save the read-for-ownership traffic
+namespace mem_ops {
+
+#define MEMOPS_INLINE_MAX (128)
+
+enum Strategy { AUTO = 0, INLINE, VECTOR, REP, NT, NUM_STRATEGIES };
+
+inline const char *strategy_name(Strategy s) {
+    static const char *names[NUM_STRATEGIES]
+            = {"auto", "inline", "vector", "rep", "nt"};
+    return names[s];
+}
+
+struct Thresholds {
+    // smallest size for rep movsb / stosb, vector loop below
+    size_t rep_min;
+    // smallest size for non-temporal stores
+    size_t nt_min;
+};
+
+namespace detail {
+
+inline bool cpuid7(int reg, int bit) {
+#ifdef HAS_X86_MEMOPS
+    unsigned r[4];
+    if (!__get_cpuid_count(7, 0, &r[0], &r[1], &r[2], &r[3])) return false;
+    return (r[reg] >> bit) & 1u;
+#else
+    (void)reg;
+    (void)bit;
+    return false;
+#endif
+}
+
+} // namespace detail
+
+// enhanced rep movsb/stosb
+inline bool has_erms() {
+    static const bool has = detail::cpuid7(1, 9);
+    return has;
+}
+
+// fast short rep movsb
+inline bool has_fsrm() {
+    static const bool has = detail::cpuid7(3, 4);
+    return has;
+}
+
+// rep movsb has a startup cost of a few dozen cycles even with FSRM, so rep
+// pays off from 1 KiB (2 KiB without FSRM) if the CPU has ERMS, never
+// otherwise; non-temporal from the size of the LLC
+inline Thresholds &thresholds() {
+    static Thresholds t {has_erms() ? (has_fsrm() ? 1024 : 2048) : SIZE_MAX,
+            topology::info().llc_size()};
+    return t;
+}
+
+inline Strategy choose(size_t n) {
+    const Thresholds &t = thresholds();
+    if (n <= MEMOPS_INLINE_MAX) return INLINE;
+    if (n >= t.nt_min) return NT;
+    if (n >= t.rep_min) return REP;
+    return VECTOR;
+}
+
+#ifdef HAS_X86_MEMOPS
+
+namespace detail {
+
+template <typename T>
+inline void move(char *d, const char *s) {
+    T v;
+    memcpy(&v, s, sizeof(T));
+    memcpy(d, &v, sizeof(T));
+}
+
+// the strategy to use for n bytes: the inline moves only cover small sizes,
+// the vector and nt loops need more than 64 bytes
+inline Strategy valid(Strategy s, size_t n) {
+    if (s == AUTO) return choose(n);
+    if (s == INLINE && n > MEMOPS_INLINE_MAX) return VECTOR;
+    if ((s == VECTOR || s == NT) && n <= 64) return INLINE;
+    return s;
+}
+
+// n <= MEMOPS_INLINE_MAX: all loads first, then the overlapping stores
+inline void copy_inline(char *d, const char *s, size_t n) {
+    if (n >= 16) {
+        if (n <= 32) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+            __m128i b = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(s + n - 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d), a);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d + n - 16), b);
+            return;
+        }
+        const __m128i *p = reinterpret_cast<const __m128i *>(s);
+        const __m128i *pe = reinterpret_cast<const __m128i *>(s + n);
+        __m128i *q = reinterpret_cast<__m128i *>(d);
+        __m128i *qe = reinterpret_cast<__m128i *>(d + n);
+        // 32 bytes from both ends
+        __m128i a = _mm_loadu_si128(p), b = _mm_loadu_si128(p + 1);
+        __m128i c = _mm_loadu_si128(pe - 2), e = _mm_loadu_si128(pe - 1);
+        if (n > 64) {
+            // 64 bytes from both ends
+            __m128i f = _mm_loadu_si128(p + 2), g = _mm_loadu_si128(p + 3);
+            __m128i h = _mm_loadu_si128(pe - 4), k = _mm_loadu_si128(pe - 3);
+            _mm_storeu_si128(q + 2, f);
+            _mm_storeu_si128(q + 3, g);
+            _mm_storeu_si128(qe - 4, h);
+            _mm_storeu_si128(qe - 3, k);
+        }
+        _mm_storeu_si128(q, a);
+        _mm_storeu_si128(q + 1, b);
+        _mm_storeu_si128(qe - 2, c);
+        _mm_storeu_si128(qe - 1, e);
+    } else if (n >= 8) {
+        uint64_t a, b;
+        memcpy(&a, s, 8);
+        memcpy(&b, s + n - 8, 8);
+        memcpy(d, &a, 8);
+        memcpy(d + n - 8, &b, 8);
+    } else if (n >= 4) {
+        uint32_t a, b;
+        memcpy(&a, s, 4);
+        memcpy(&b, s + n - 4, 4);
+        memcpy(d, &a, 4);
+        memcpy(d + n - 4, &b, 4);
+    } else if (n >= 2) {
+        move<uint16_t>(d, s);
+        move<uint16_t>(d + n - 2, s + n - 2);
+    } else if (n == 1) {
+        *d = *s;
+    }
+}
+
+inline void fill_inline(char *d, int c, size_t n) {
+    if (n >= 16) {
+        __m128i v = _mm_set1_epi8(static_cast<char>(c));
+        for (size_t i = 0; i + 16 < n; i += 16)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + n - 16), v);
+    } else if (n >= 8) {
+        uint64_t v = 0x0101010101010101ull * static_cast<unsigned char>(c);
+        memcpy(d, &v, 8);
+        memcpy(d + n - 8, &v, 8);
+    } else if (n >= 4) {
+        uint32_t v = 0x01010101u * static_cast<unsigned char>(c);
+        memcpy(d, &v, 4);
+        memcpy(d + n - 4, &v, 4);
+    } else {
+        for (size_t i = 0; i < n; ++i)
+            d[i] = static_cast<char>(c);
+    }
+}
+
+// n > 64: 64 bytes per iteration, the last 64 bytes overlapping
+inline void copy_vector(char *d, const char *s, size_t n) {
+    const char *end = s + n - 64;
+    char *dend = d + n - 64;
+    __m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end));
+    __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end + 16));
+    __m128i t2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end + 32));
+    __m128i t3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end + 48));
+    for (; s < end; s += 64, d += 64) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(s);
+        __m128i a = _mm_loadu_si128(p), b = _mm_loadu_si128(p + 1);
+        __m128i c = _mm_loadu_si128(p + 2), e = _mm_loadu_si128(p + 3);
+        __m128i *q = reinterpret_cast<__m128i *>(d);
+        _mm_storeu_si128(q, a);
+        _mm_storeu_si128(q + 1, b);
+        _mm_storeu_si128(q + 2, c);
+        _mm_storeu_si128(q + 3, e);
+    }
+    __m128i *q = reinterpret_cast<__m128i *>(dend);
+    _mm_storeu_si128(q, t0);
+    _mm_storeu_si128(q + 1, t1);
+    _mm_storeu_si128(q + 2, t2);
+    _mm_storeu_si128(q + 3, t3);
+}
+
+inline void fill_vector(char *d, int c, size_t n) {
+    __m128i v = _mm_set1_epi8(static_cast<char>(c));
+    char *end = d + n - 64;
+    for (; d < end; d += 64) {
+        __m128i *q = reinterpret_cast<__m128i *>(d);
+        _mm_storeu_si128(q, v);
+        _mm_storeu_si128(q + 1, v);
+        _mm_storeu_si128(q + 2, v);
+        _mm_storeu_si128(q + 3, v);
+    }
+    __m128i *q = reinterpret_cast<__m128i *>(end);
+    _mm_storeu_si128(q, v);
+    _mm_storeu_si128(q + 1, v);
+    _mm_storeu_si128(q + 2, v);
+    _mm_storeu_si128(q + 3, v);
+}
+
+inline void copy_rep(char *d, const char *s, size_t n) {
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+inline void fill_rep(char *d, int c, size_t n) {
+    asm volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+}
+
+// n > 64: unaligned head, streaming stores to aligned lines, regular tail
+inline void copy_nt(char *d, const char *s, size_t n) {
+    size_t head = (64 - (reinterpret_cast<uintptr_t>(d) & 63)) & 63;
+    copy_inline(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    for (; n >= 64; n -= 64, s += 64, d += 64) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(s);
+        __m128i a = _mm_loadu_si128(p), b = _mm_loadu_si128(p + 1);
+        __m128i c = _mm_loadu_si128(p + 2), e = _mm_loadu_si128(p + 3);
+        __m128i *q = reinterpret_cast<__m128i *>(d);
+        _mm_stream_si128(q, a);
+        _mm_stream_si128(q + 1, b);
+        _mm_stream_si128(q + 2, c);
+        _mm_stream_si128(q + 3, e);
+    }
+    // order the streaming stores before anything that follows
+    _mm_sfence();
+    copy_inline(d, s, n);
+}
+
+inline void fill_nt(char *d, int c, size_t n) {
+    size_t head = (64 - (reinterpret_cast<uintptr_t>(d) & 63)) & 63;
+    fill_inline(d, c, head);
+    d += head;
+    n -= head;
+    __m128i v = _mm_set1_epi8(static_cast<char>(c));
+    for (; n >= 64; n -= 64, d += 64) {
+        __m128i *q = reinterpret_cast<__m128i *>(d);
+        _mm_stream_si128(q, v);
+        _mm_stream_si128(q + 1, v);
+        _mm_stream_si128(q + 2, v);
+        _mm_stream_si128(q + 3, v);
+    }
+    _mm_sfence();
+    fill_inline(d, c, n);
+}
+
+} // namespace detail
+
+// memcpy semantics, the buffers must not overlap
+inline void copy(void *dst, const void *src, size_t n, Strategy s = AUTO) {
+    char *d = static_cast<char *>(dst);
+    const char *p = static_cast<const char *>(src);
+    s = detail::valid(s, n);
+    switch (s) {
+        case INLINE: return detail::copy_inline(d, p, n);
+        case REP: return detail::copy_rep(d, p, n);
+        case NT: return detail::copy_nt(d, p, n);
+        default: return detail::copy_vector(d, p, n);
+    }
+}
+
+// memset semantics
+inline void fill(void *dst, int c, size_t n, Strategy s = AUTO) {
+    char *d = static_cast<char *>(dst);
+    s = detail::valid(s, n);
+    switch (s) {
+        case INLINE: return detail::fill_inline(d, c, n);
+        case REP: return detail::fill_rep(d, c, n);
+        case NT: return detail::fill_nt(d, c, n);
+        default: return detail::fill_vector(d, c, n);
+    }
+}
+
+#else
+
+inline void copy(void *dst, const void *src, size_t n, Strategy = AUTO) {
+    memcpy(dst, src, n);
+}
+
+inline void fill(void *dst, int c, size_t n, Strategy = AUTO) {
+    memset(dst, c, n);
+}
+
+#endif // HAS_X86_MEMOPS
+
+// copy rows x row_bytes from src (ld_src bytes between rows) to dst (ld_dst
+// bytes between rows), e.g. a block of a matrix into a contiguous buffer
+inline void pack(void *dst, size_t ld_dst, const void *src, size_t ld_src,
+        size_t rows, size_t row_bytes, Strategy s = AUTO) {
+    if (s == AUTO) s = choose(rows * row_bytes) == NT ? NT : choose(row_bytes);
+    char *d = static_cast<char *>(dst);
+    const char *p = static_cast<const char *>(src);
+    for (size_t r = 0; r < rows; ++r)
+        copy(d + r * ld_dst, p + r * ld_src, row_bytes, s);
+}
+
+} // namespace mem_ops
+#endif
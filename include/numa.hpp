@@ -0,0 +1,223 @@
+// NUMA topology and node-local memory without libnuma
+#ifndef NUMA_HPP_
+#define NUMA_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "topology.hpp"
+
+// Memory placement is done with the raw mbind(2) / set_mempolicy(2) /
+// get_mempolicy(2) system calls, topology comes from
+// /sys/devices/system/node.
+//
+// Everything degrades gracefully: on single-node machines, kernels without
+// NUMA support or containers that forbid the system calls, memory is
+// allocated with the default policy and queries return node 0 or -1.
+//
+// Take-aways
+//  ** a page is placed on the node of the thread that first touches it,
+//     unless a memory policy says otherwise
+//  ** binding (MPOL_BIND) happens per virtual range, before the first touch
+//  ** remote accesses pay for the interconnect in both latency and bandwidth
+namespace numa {
+
+// upper bound of nodes handled by the pools
+#define NUMA_MAX_NODES (64)
+
+// online nodes, {0} if the machine does not expose any
+inline std::vector<int> nodes() {
+    std::string online;
+    std::vector<int> ids;
+    if (topology::detail::read_line("/sys/devices/system/node/online", online))
+        ids = topology::detail::parse_cpu_list(online);
+    if (ids.empty()) ids.push_back(0);
+    return ids;
+}
+
+inline int num_nodes() {
+    return static_cast<int>(nodes().size());
+}
+
+// logical CPUs of a node, all online CPUs if unknown
+inline std::vector<int> node_cpus(int node) {
+    std::string list;
+    std::vector<int> cpus;
+    if (topology::detail::read_line("/sys/devices/system/node/node"
+                    + std::to_string(node) + "/cpulist",
+                list))
+        cpus = topology::detail::parse_cpu_list(list);
+    if (cpus.empty())
+        for (const auto &c : topology::info().cpus)
+            cpus.push_back(c.id);
+    return cpus;
+}
+
+// ACPI SLIT distance between two nodes (10 is local), -1 if unknown
+inline int distance(int from, int to) {
+    std::string line;
+    if (!topology::detail::read_line("/sys/devices/system/node/node"
+                    + std::to_string(from) + "/distance",
+                line))
+        return -1;
+    std::stringstream ss(line);
+    int d = -1;
+    for (int i = 0; i <= to && (ss >> d); ++i) {}
+    return ss ? d : -1;
+}
+
+// bind [addr, addr + len) to one node, before it is touched
+inline bool bind(void *addr, size_t len, int node) {
+#ifdef __linux__
+    if (node < 0 || node >= NUMA_MAX_NODES) return false;
+    unsigned long mask = 1ul << node;
+    // the kernel reads maxnode - 1 bits, so pass one more, as libnuma does
+    return syscall(SYS_mbind, addr, len, MPOL_BIND, &mask,
+                   sizeof(mask) * 8 + 1, 0)
+            == 0;
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+    return false;
+#endif
+}
+
+// make node the preferred node of the calling thread, -1 resets to default
+inline bool set_preferred(int node) {
+#ifdef __linux__
+    if (node < 0) return syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0) == 0;
+    if (node >= NUMA_MAX_NODES) return false;
+    unsigned long mask = 1ul << node;
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask,
+                   sizeof(mask) * 8 + 1)
+            == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+// node backing the page at addr, -1 if unknown (or not touched yet)
+inline int node_of(const void *addr) {
+#ifdef __linux__
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0,
+                const_cast<void *>(addr), MPOL_F_NODE | MPOL_F_ADDR)
+            != 0)
+        return -1;
+    return node;
+#else
+    (void)addr;
+    return -1;
+#endif
+}
+
+// restrict the calling thread to the CPUs of a node
+inline bool run_on_node(int node) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : node_cpus(node))
+        CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+// page-aligned mapping bound to a node (node < 0: default policy); if binding
+// fails the memory is still returned, placed by first touch
+inline void *alloc_on_node(size_t bytes, int node, bool *bound = nullptr) {
+#ifdef __linux__
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    bool ok = node >= 0 && bind(p, bytes, node);
+    if (bound) *bound = ok;
+    return p;
+#else
+    (void)node;
+    if (bound) *bound = false;
+    return ::operator new(bytes);
+#endif
+}
+
+inline void free_on_node(void *p, size_t bytes) {
+    if (!p) return;
+#ifdef __linux__
+    munmap(p, bytes);
+#else
+    (void)bytes;
+    ::operator delete(p);
+#endif
+}
+
+// Node-local bump arena: memory is carved out of large regions bound to one
+// node and only returned all at once by release()
+class Arena {
+public:
+    explicit Arena(int node = -1, size_t region_size = 2 * 1024 * 1024)
+        : node_(node), region_size_(region_size) {}
+
+    ~Arena() { release(); }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    int node() const { return node_; }
+
+    void *allocate(size_t n, size_t alignment = 64) {
+        uintptr_t p = (cur_ + alignment - 1) / alignment * alignment;
+        if (regions_.empty() || p + n > end_) {
+            size_t size = std::max(region_size_, n + alignment);
+            size = (size + 4095) / 4096 * 4096;
+            void *r = alloc_on_node(size, node_);
+            if (!r) return nullptr;
+            regions_.emplace_back(r, size);
+            cur_ = reinterpret_cast<uintptr_t>(r);
+            end_ = cur_ + size;
+            p = (cur_ + alignment - 1) / alignment * alignment;
+        }
+        cur_ = p + n;
+        return reinterpret_cast<void *>(p);
+    }
+
+    // return every region to the system
+    void release() {
+        for (auto &r : regions_)
+            free_on_node(r.first, r.second);
+        regions_.clear();
+        cur_ = end_ = 0;
+    }
+
+    size_t reserved() const {
+        size_t total = 0;
+        for (const auto &r : regions_)
+            total += r.second;
+        return total;
+    }
+
+private:
+    int node_;
+    size_t region_size_;
+    std::vector<std::pair<void *, size_t>> regions_;
+    uintptr_t cur_ {0};
+    uintptr_t end_ {0};
+};
+
+} // namespace numa
+#endif
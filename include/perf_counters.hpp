@@ -0,0 +1,177 @@
+// Hardware performance counters through perf_event_open(2)
+#ifndef PERF_COUNTERS_HPP_
+#define PERF_COUNTERS_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// A small group of counters for the calling thread and every thread it
+// creates after the group is opened (inherit; the children are summed into
+// the reads), user space only. bench::Runner opens its group before any
+// ThreadTeam exists, so multi-threaded cases count all their threads:
+//  * cycles, instructions, L1D read misses, LLC misses and dTLB read misses
+//    are scheduled together as one hardware group
+//  * page faults are a software event counted next to the group
+//
+// Events that cannot be opened (no PMU in a VM, perf_event_paranoid, seccomp
+// in containers ...) are skipped; if none can be opened, available() is
+// false and the caller falls back to time only.
+// Counts are scaled by time_enabled / time_running when the kernel has to
+// multiplex the group.
+namespace perf {
+
+enum Event {
+    CYCLES = 0,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    DTLB_MISSES,
+    PAGE_FAULTS,
+    NUM_EVENTS
+};
+
+inline const char *event_name(int e) {
+    static const char *names[NUM_EVENTS] = {"cycles", "instructions",
+            "l1d-misses", "llc-misses", "dtlb-misses", "page-faults"};
+    return names[e];
+}
+
+class CounterGroup {
+public:
+    CounterGroup() {
+        for (int e = 0; e < NUM_EVENTS; ++e) {
+            fds_[e] = -1;
+            totals_[e] = 0.;
+            begin_[e] = Sample();
+        }
+#ifdef __linux__
+        fds_[CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+        int leader = fds_[CYCLES];
+        if (leader >= 0) {
+            fds_[INSTRUCTIONS] = open(PERF_TYPE_HARDWARE,
+                    PERF_COUNT_HW_INSTRUCTIONS, leader);
+            fds_[L1D_MISSES] = open(PERF_TYPE_HW_CACHE,
+                    cache_config(PERF_COUNT_HW_CACHE_L1D), leader);
+            fds_[LLC_MISSES] = open(
+                    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader);
+            fds_[DTLB_MISSES] = open(PERF_TYPE_HW_CACHE,
+                    cache_config(PERF_COUNT_HW_CACHE_DTLB), leader);
+        }
+        fds_[PAGE_FAULTS]
+                = open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, -1);
+#endif
+    }
+
+    ~CounterGroup() {
+#ifdef __linux__
+        for (int e = 0; e < NUM_EVENTS; ++e)
+            if (fds_[e] >= 0) close(fds_[e]);
+#endif
+    }
+
+    CounterGroup(const CounterGroup &) = delete;
+    CounterGroup &operator=(const CounterGroup &) = delete;
+
+    bool available() const {
+        for (int e = 0; e < NUM_EVENTS; ++e)
+            if (fds_[e] >= 0) return true;
+        return false;
+    }
+    bool has(int e) const { return fds_[e] >= 0; }
+
+    // clear accumulated counts
+    void reset() {
+        for (int e = 0; e < NUM_EVENTS; ++e)
+            totals_[e] = 0.;
+    }
+
+    // start counting, counts accumulate over start()/stop() pairs
+    void start() {
+#ifdef __linux__
+        for (int e = 0; e < NUM_EVENTS; ++e)
+            if (fds_[e] >= 0) begin_[e] = read_fd(fds_[e]);
+        if (fds_[CYCLES] >= 0)
+            ioctl(fds_[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        if (fds_[PAGE_FAULTS] >= 0)
+            ioctl(fds_[PAGE_FAULTS], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        if (fds_[CYCLES] >= 0)
+            ioctl(fds_[CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        if (fds_[PAGE_FAULTS] >= 0)
+            ioctl(fds_[PAGE_FAULTS], PERF_EVENT_IOC_DISABLE, 0);
+        for (int e = 0; e < NUM_EVENTS; ++e) {
+            if (fds_[e] < 0) continue;
+            Sample end = read_fd(fds_[e]);
+            double value = static_cast<double>(end.value - begin_[e].value);
+            uint64_t enabled = end.enabled - begin_[e].enabled;
+            uint64_t running = end.running - begin_[e].running;
+            if (running > 0 && running < enabled)
+                value *= static_cast<double>(enabled) / running;
+            totals_[e] += value;
+        }
+#endif
+    }
+
+    // accumulated count of an event since the last reset()
+    double value(int e) const { return totals_[e]; }
+
+private:
+    struct Sample {
+        uint64_t value {0};
+        uint64_t enabled {0};
+        uint64_t running {0};
+    };
+
+#ifdef __linux__
+    static uint64_t cache_config(uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    static int open(uint32_t type, uint64_t config, int group_fd) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = group_fd < 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        long fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+        return static_cast<int>(fd);
+    }
+
+    static Sample read_fd(int fd) {
+        Sample s;
+        uint64_t buf[3] = {0, 0, 0};
+        if (::read(fd, buf, sizeof(buf)) == sizeof(buf)) {
+            s.value = buf[0];
+            s.enabled = buf[1];
+            s.running = buf[2];
+        }
+        return s;
+    }
+#endif
+
+    int fds_[NUM_EVENTS];
+    double totals_[NUM_EVENTS];
+    Sample begin_[NUM_EVENTS];
+};
+
+} // namespace perf
+#endif
@@ -3,7 +3,12 @@
 #define RING_BUFFER_HPP_
 
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <new>
 
 // A data structure that uses a *single*, *fixed size* buffer.
 //
@@ -204,5 +209,121 @@ public:
     }
 };
 
+// Single-producer single-consumer ring of variable-size byte records,
+// lock free: the producer only writes tail_, the consumer only head_, and
+// each keeps a cached copy of the other's index so that it touches the
+// shared line only when the cached one says the ring is full (or empty).
+//
+// A record is an 8-byte length and the payload, padded to 8 bytes, and never
+// wraps: if it does not fit before the end, a wrap marker sends the consumer
+// back to offset 0. Unlike RingBuffer, a full ring refuses new records
+// instead of dropping old ones.
+//
+// Key take-aways:
+//  * head and tail on their own cache lines, or every write and read
+//    invalidates the other side
+//  * acquire/release on the indices is all the ordering a SPSC queue needs
+template <size_t N>
+class SpscRing {
+    static_assert(N >= 64 && (N & (N - 1)) == 0, "N is a power of two");
+
+public:
+    SpscRing() {
+        if (posix_memalign(reinterpret_cast<void **>(&buf_), 64, N))
+            throw std::bad_alloc();
+    }
+    ~SpscRing() { free(buf_); }
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    static constexpr size_t capacity() { return N; }
+
+    // producer: room for a payload of n bytes, nullptr if the ring is full;
+    // the record is visible to the consumer after commit()
+    char *prepare(size_t n) {
+        size_t need = record_size(n);
+        size_t pos = tail_ & (N - 1);
+        // the bytes up to the end are skipped if the record does not fit
+        size_t skip = pos + need > N ? N - pos : 0;
+        if (need + skip > N) return nullptr;
+        if (tail_ + skip + need - cached_head_ > N) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail_ + skip + need - cached_head_ > N) return nullptr;
+        }
+        if (skip) {
+            store_length(buf_ + pos, WRAP);
+            tail_ += skip;
+            pos = 0;
+        }
+        store_length(buf_ + pos, n);
+        pending_ = tail_ + need;
+        return buf_ + pos + sizeof(uint64_t);
+    }
+
+    void commit() {
+        tail_ = pending_;
+        tail_shared_.store(tail_, std::memory_order_release);
+    }
+
+    // producer: copy a whole record, false if full
+    bool push(const void *p, size_t n) {
+        char *dst = prepare(n);
+        if (!dst) return false;
+        memcpy(dst, p, n);
+        commit();
+        return true;
+    }
+
+    // consumer: f(payload, n) on every record written so far, returns the
+    // number of records
+    template <typename F>
+    size_t consume(F &&f) {
+        size_t tail = tail_shared_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t count = 0;
+        while (head != tail) {
+            size_t pos = head & (N - 1);
+            uint64_t n = load_length(buf_ + pos);
+            if (n == WRAP) {
+                head += N - pos;
+                continue;
+            }
+            f(static_cast<const char *>(buf_ + pos + sizeof(uint64_t)),
+                    static_cast<size_t>(n));
+            head += record_size(n);
+            ++count;
+        }
+        head_.store(head, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire)
+                == tail_shared_.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr uint64_t WRAP = ~static_cast<uint64_t>(0);
+
+    static size_t record_size(size_t n) {
+        return sizeof(uint64_t) + ((n + 7) & ~static_cast<size_t>(7));
+    }
+    static void store_length(char *p, uint64_t n) { memcpy(p, &n, sizeof(n)); }
+    static uint64_t load_length(const char *p) {
+        uint64_t n;
+        memcpy(&n, p, sizeof(n));
+        return n;
+    }
+
+    char *buf_ {nullptr};
+    // consumer side
+    alignas(64) std::atomic<size_t> head_ {0};
+    // producer side: private tail, published tail and cached head
+    alignas(64) std::atomic<size_t> tail_shared_ {0};
+    size_t tail_ {0};
+    size_t pending_ {0};
+    size_t cached_head_ {0};
+};
+
 } // namespace ring_buffer
 #endif
@@ -0,0 +1,497 @@
+// Roofline model: compute and bandwidth ceilings with kernels placed under them
+#ifndef ROOFLINE_HPP_
+#define ROOFLINE_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "simd_kernels.hpp"
+
+// A kernel doing F flops while moving B bytes has an arithmetic intensity
+// AI = F / B and cannot run faster than
+//     min(peak GFLOP/s, bandwidth GB/s * AI)
+// Each level of the memory hierarchy gives one bandwidth ceiling, each way of
+// issuing flops (scalar, widest vectors) one compute ceiling. The ridge point
+// peak / bandwidth is the AI where a kernel stops being bound by that level.
+//
+// Bytes are counted from the loads and stores the kernel issues (the
+// "cache-aware" roofline), so a kernel has one AI whichever level serves its
+// data, and the highest bandwidth ceiling above its point tells which level
+// it could be running from.
+//
+// Take-aways
+//  ** left of the ridge, only fewer bytes per flop or a faster level helps
+//  ** right of it, only vectorization and independent FMAs help
+//  ** a point far below every ceiling is bound by latency or dependencies,
+//     which no throughput ceiling shows
+namespace roofline {
+
+namespace detail {
+
+// acc = acc * a + b on independent accumulators, enough of them to cover
+// FMA latency x FMA ports, with no loads or stores in the loop
+SIMD_SCALAR_FN inline float scalar_fma(size_t iters, float a, float b) {
+    float x0 = 0.f, x1 = 1.f, x2 = 2.f, x3 = 3.f;
+    float x4 = 4.f, x5 = 5.f, x6 = 6.f, x7 = 7.f;
+    SIMD_SCALAR_LOOP
+    for (size_t i = 0; i < iters; ++i) {
+        x0 = x0 * a + b;
+        x1 = x1 * a + b;
+        x2 = x2 * a + b;
+        x3 = x3 * a + b;
+        x4 = x4 * a + b;
+        x5 = x5 * a + b;
+        x6 = x6 * a + b;
+        x7 = x7 * a + b;
+    }
+    return ((x0 + x1) + (x2 + x3)) + ((x4 + x5) + (x6 + x7));
+}
+
+#ifdef HAS_X86_SIMD
+
+SIMD_AVX2_FN inline float avx2_fma(size_t iters, float a, float b) {
+    __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b);
+    __m256 x0 = _mm256_set1_ps(0.f), x1 = _mm256_set1_ps(1.f);
+    __m256 x2 = _mm256_set1_ps(2.f), x3 = _mm256_set1_ps(3.f);
+    __m256 x4 = _mm256_set1_ps(4.f), x5 = _mm256_set1_ps(5.f);
+    __m256 x6 = _mm256_set1_ps(6.f), x7 = _mm256_set1_ps(7.f);
+    __m256 x8 = _mm256_set1_ps(8.f), x9 = _mm256_set1_ps(9.f);
+    for (size_t i = 0; i < iters; ++i) {
+        x0 = _mm256_fmadd_ps(x0, va, vb);
+        x1 = _mm256_fmadd_ps(x1, va, vb);
+        x2 = _mm256_fmadd_ps(x2, va, vb);
+        x3 = _mm256_fmadd_ps(x3, va, vb);
+        x4 = _mm256_fmadd_ps(x4, va, vb);
+        x5 = _mm256_fmadd_ps(x5, va, vb);
+        x6 = _mm256_fmadd_ps(x6, va, vb);
+        x7 = _mm256_fmadd_ps(x7, va, vb);
+        x8 = _mm256_fmadd_ps(x8, va, vb);
+        x9 = _mm256_fmadd_ps(x9, va, vb);
+    }
+    __m256 s = _mm256_add_ps(
+            _mm256_add_ps(_mm256_add_ps(x0, x1), _mm256_add_ps(x2, x3)),
+            _mm256_add_ps(_mm256_add_ps(x4, x5), _mm256_add_ps(x6, x7)));
+    return simd::detail::avx2_hsum(_mm256_add_ps(s, _mm256_add_ps(x8, x9)));
+}
+
+SIMD_AVX512_FN inline float avx512_fma(size_t iters, float a, float b) {
+    __m512 va = _mm512_set1_ps(a), vb = _mm512_set1_ps(b);
+    __m512 x0 = _mm512_set1_ps(0.f), x1 = _mm512_set1_ps(1.f);
+    __m512 x2 = _mm512_set1_ps(2.f), x3 = _mm512_set1_ps(3.f);
+    __m512 x4 = _mm512_set1_ps(4.f), x5 = _mm512_set1_ps(5.f);
+    __m512 x6 = _mm512_set1_ps(6.f), x7 = _mm512_set1_ps(7.f);
+    __m512 x8 = _mm512_set1_ps(8.f), x9 = _mm512_set1_ps(9.f);
+    __m512 x10 = _mm512_set1_ps(10.f), x11 = _mm512_set1_ps(11.f);
+    for (size_t i = 0; i < iters; ++i) {
+        x0 = _mm512_fmadd_ps(x0, va, vb);
+        x1 = _mm512_fmadd_ps(x1, va, vb);
+        x2 = _mm512_fmadd_ps(x2, va, vb);
+        x3 = _mm512_fmadd_ps(x3, va, vb);
+        x4 = _mm512_fmadd_ps(x4, va, vb);
+        x5 = _mm512_fmadd_ps(x5, va, vb);
+        x6 = _mm512_fmadd_ps(x6, va, vb);
+        x7 = _mm512_fmadd_ps(x7, va, vb);
+        x8 = _mm512_fmadd_ps(x8, va, vb);
+        x9 = _mm512_fmadd_ps(x9, va, vb);
+        x10 = _mm512_fmadd_ps(x10, va, vb);
+        x11 = _mm512_fmadd_ps(x11, va, vb);
+    }
+    __m512 s = _mm512_add_ps(
+            _mm512_add_ps(_mm512_add_ps(x0, x1), _mm512_add_ps(x2, x3)),
+            _mm512_add_ps(_mm512_add_ps(x4, x5), _mm512_add_ps(x6, x7)));
+    s = _mm512_add_ps(s,
+            _mm512_add_ps(_mm512_add_ps(x8, x9), _mm512_add_ps(x10, x11)));
+    return _mm512_reduce_add_ps(s);
+}
+
+#endif // HAS_X86_SIMD
+
+} // namespace detail
+
+// flops of one iteration of fma_peak
+inline double fma_flops_per_iter(simd::Isa isa) {
+    switch (simd::detail::resolve(isa)) {
+        case simd::AVX512: return 12 * 16 * 2;
+        case simd::AVX2: return 10 * 8 * 2;
+        default: return 8 * 2;
+    }
+}
+
+// register-only multiply-add loop, iters * fma_flops_per_iter(isa) flops;
+// the scalar version is a multiply and an add unless built with FMA
+inline float fma_peak(size_t iters, simd::Isa isa = simd::best_isa()) {
+    // a < 1 keeps the accumulators bounded and away from denormals
+    volatile float a = 0.999999f, b = 1e-6f;
+    switch (simd::detail::resolve(isa)) {
+#ifdef HAS_X86_SIMD
+        case simd::AVX512: return detail::avx512_fma(iters, a, b);
+        case simd::AVX2: return detail::avx2_fma(iters, a, b);
+#endif
+        default: return detail::scalar_fma(iters, a, b);
+    }
+}
+
+// a kernel to place on the roofline: body() does flops and moves bytes,
+// setup() runs untimed before every call
+struct Kernel {
+    std::string name;
+    double flops;
+    double bytes;
+    std::function<void()> setup;
+    std::function<void()> body;
+};
+
+// a compute (GFLOP/s) or bandwidth (GB/s) ceiling
+struct Ceiling {
+    std::string name;
+    double value;
+};
+
+// a measured kernel; ram_ai is flops per byte of LLC misses, 0 if unknown
+struct Point {
+    std::string name;
+    double ai;
+    double gflops;
+    double ram_ai;
+};
+
+class Model {
+public:
+    // ceilings are kept fastest first
+    void add_compute(const std::string &name, double gflops) {
+        add(compute_, {name, gflops});
+    }
+    void add_bandwidth(const std::string &name, double gbs) {
+        add(bandwidth_, {name, gbs});
+    }
+    void add_point(const std::string &name, double ai, double gflops,
+            double ram_ai = 0.) {
+        points_.push_back({name, ai, gflops, ram_ai});
+    }
+
+    const std::vector<Ceiling> &compute() const { return compute_; }
+    const std::vector<Ceiling> &bandwidth() const { return bandwidth_; }
+    const std::vector<Point> &points() const { return points_; }
+
+    double peak() const { return compute_.empty() ? 0. : compute_[0].value; }
+
+    // attainable GFLOP/s at ai with data from the level of bandwidth ceiling b
+    double roof(double ai, const Ceiling &b) const {
+        return std::min(peak(), b.value * ai);
+    }
+    // attainable GFLOP/s at ai from the fastest level
+    double roof(double ai) const {
+        return bandwidth_.empty() ? peak() : roof(ai, bandwidth_[0]);
+    }
+    double ridge(const Ceiling &b) const { return peak() / b.value; }
+
+    // slowest level whose roof is above the point
+    const Ceiling *level(const Point &p) const {
+        for (auto it = bandwidth_.rbegin(); it != bandwidth_.rend(); ++it)
+            if (roof(p.ai, *it) >= p.gflops) return &*it;
+        return bandwidth_.empty() ? nullptr : &bandwidth_[0];
+    }
+
+    // "compute" if the point is right of the ridge of its level
+    std::string bound(const Point &p) const {
+        const Ceiling *b = level(p);
+        return !b || p.ai >= ridge(*b) ? "compute" : "memory";
+    }
+
+    std::string csv() const {
+        std::string s = "kind,name,ai,gflops,gbs,roof_gflops,pct_roof,level,"
+                        "bound,ram_ai\n";
+        char buf[256];
+        for (const auto &c : compute_) {
+            snprintf(buf, sizeof(buf), "compute,%s,,%.3f,,,,,,\n",
+                    c.name.c_str(), c.value);
+            s += buf;
+        }
+        for (const auto &b : bandwidth_) {
+            snprintf(buf, sizeof(buf), "bandwidth,%s,%.4f,%.3f,%.3f,,,,,\n",
+                    b.name.c_str(), ridge(b), peak(), b.value);
+            s += buf;
+        }
+        for (const auto &p : points_) {
+            const Ceiling *b = level(p);
+            snprintf(buf, sizeof(buf),
+                    "kernel,%s,%.4f,%.3f,,%.3f,%.1f,%s,%s,%.4f\n",
+                    p.name.c_str(), p.ai, p.gflops, roof(p.ai),
+                    100. * p.gflops / roof(p.ai), b ? b->name.c_str() : "",
+                    bound(p).c_str(), p.ram_ai);
+            s += buf;
+        }
+        return s;
+    }
+
+    // log-log chart, memory ceilings as '/', compute ceilings as '=',
+    // kernels as letters explained in a legend below ('*' if several fall
+    // on one character)
+    std::string ascii(int width = 64, int height = 20) const {
+        Axes ax = axes();
+        std::vector<std::string> grid(height, std::string(width, ' '));
+        auto row = [&](double g) {
+            return height - 1
+                    - static_cast<int>(std::lround(
+                            ax.fy(g) * (height - 1)));
+        };
+        auto col_ai = [&](int c) {
+            return ax.x0 * std::pow(ax.x1 / ax.x0,
+                           static_cast<double>(c) / (width - 1));
+        };
+        auto put = [&](int r, int c, char ch) {
+            if (r >= 0 && r < height && c >= 0 && c < width)
+                grid[r][c] = ch;
+        };
+        for (const auto &c : compute_)
+            for (int x = 0; x < width; ++x)
+                if (bandwidth_.empty() || col_ai(x) >= ridge(bandwidth_[0], c))
+                    put(row(c.value), x, '=');
+        std::vector<std::pair<int, int>> starts;
+        for (const auto &b : bandwidth_) {
+            int first = -1;
+            for (int x = 0; x < width; ++x) {
+                double g = b.value * col_ai(x);
+                if (g >= peak()) break;
+                int r = row(g);
+                if (r < 0 || r >= height) continue;
+                put(r, x, '/');
+                if (first < 0) first = x;
+            }
+            starts.emplace_back(
+                    first >= 0 ? row(b.value * col_ai(first)) : -1, first);
+        }
+        // name each memory ceiling right of where it enters the chart
+        for (size_t i = 0; i < starts.size(); ++i) {
+            const std::string &name = bandwidth_[i].name;
+            int r = starts[i].first, c = starts[i].second;
+            if (c < 0) continue;
+            while (c < width && grid[r][c] != ' ')
+                ++c;
+            ++c;
+            for (size_t k = 0; k < name.size(); ++k)
+                if (c + static_cast<int>(k) < width && grid[r][c + k] == ' ')
+                    grid[r][c + k] = name[k];
+        }
+        std::vector<std::pair<int, int>> cells;
+        for (size_t i = 0; i < points_.size(); ++i) {
+            std::pair<int, int> rc(row(points_[i].gflops),
+                    static_cast<int>(std::lround(
+                            ax.fx(points_[i].ai) * (width - 1))));
+            // '*' where kernels overlap
+            bool taken = std::find(cells.begin(), cells.end(), rc)
+                    != cells.end();
+            cells.push_back(rc);
+            put(rc.first, rc.second, taken ? '*' : point_char(i));
+        }
+
+        std::string s;
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%9s\n", "GFLOP/s");
+        s += buf;
+        for (int r = 0; r < height; ++r) {
+            // label rows that hold a power of two
+            double g = ax.y0 * std::pow(ax.y1 / ax.y0,
+                               static_cast<double>(height - 1 - r)
+                                       / (height - 1));
+            double p2 = std::pow(2., std::round(std::log2(g)));
+            if (row(p2) == r)
+                snprintf(buf, sizeof(buf), "%8g |", p2);
+            else
+                snprintf(buf, sizeof(buf), "%8s |", "");
+            s += buf + grid[r] + "\n";
+        }
+        s += std::string(9, ' ') + "+" + std::string(width, '-') + "\n";
+        std::string labels(width + 16, ' ');
+        int next = 0;
+        for (double ai = ax.x0; ai <= ax.x1 * 1.001; ai *= 2.) {
+            int c = static_cast<int>(std::lround(ax.fx(ai) * (width - 1)));
+            snprintf(buf, sizeof(buf), "%g", ai);
+            if (c < next) continue;
+            labels.replace(c, strlen(buf), buf);
+            next = c + static_cast<int>(strlen(buf)) + 1;
+        }
+        labels.erase(labels.find_last_not_of(' ') + 1);
+        s += std::string(10, ' ') + labels + "\n";
+        s += std::string(10, ' ') + "flops/byte\n";
+        for (const auto &c : compute_) {
+            snprintf(buf, sizeof(buf), "  =  %-12s%10.2f GFLOP/s\n",
+                    c.name.c_str(), c.value);
+            s += buf;
+        }
+        for (const auto &b : bandwidth_) {
+            snprintf(buf, sizeof(buf),
+                    "  /  %-12s%10.2f GB/s, ridge %.3g flops/byte\n",
+                    b.name.c_str(), b.value, ridge(b));
+            s += buf;
+        }
+        for (size_t i = 0; i < points_.size(); ++i) {
+            snprintf(buf, sizeof(buf),
+                    "  %c  %-12s%10.2f GFLOP/s at %.3g flops/byte\n",
+                    point_char(i), points_[i].name.c_str(),
+                    points_[i].gflops, points_[i].ai);
+            s += buf;
+        }
+        return s;
+    }
+
+    std::string svg(int width = 800, int height = 500) const {
+        Axes ax = axes();
+        const double ml = 70, mr = 20, mt = 30, mb = 50;
+        const double pw = width - ml - mr, ph = height - mt - mb;
+        auto px = [&](double ai) { return ml + ax.fx(ai) * pw; };
+        auto py = [&](double g) { return mt + (1. - ax.fy(g)) * ph; };
+        static const char *colors[] = {"#1f77b4", "#ff7f0e", "#2ca02c",
+                "#d62728", "#9467bd", "#8c564b", "#e377c2", "#7f7f7f"};
+
+        std::string s;
+        char buf[512];
+        snprintf(buf, sizeof(buf),
+                "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" "
+                "height=\"%d\" font-family=\"sans-serif\" font-size=\"11\">\n"
+                "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n",
+                width, height);
+        s += buf;
+        // grid on powers of two
+        for (double ai = ax.x0; ai <= ax.x1 * 1.001; ai *= 2.) {
+            snprintf(buf, sizeof(buf),
+                    "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" "
+                    "stroke=\"#ddd\"/><text x=\"%.1f\" y=\"%.1f\" "
+                    "text-anchor=\"middle\">%g</text>\n",
+                    px(ai), mt, px(ai), mt + ph, px(ai), mt + ph + 15, ai);
+            s += buf;
+        }
+        for (double g = ax.y0; g <= ax.y1 * 1.001; g *= 2.) {
+            snprintf(buf, sizeof(buf),
+                    "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" "
+                    "stroke=\"#ddd\"/><text x=\"%.1f\" y=\"%.1f\" "
+                    "text-anchor=\"end\">%g</text>\n",
+                    ml, py(g), ml + pw, py(g), ml - 5, py(g) + 4, g);
+            s += buf;
+        }
+        snprintf(buf, sizeof(buf),
+                "<rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" height=\"%.1f\" "
+                "fill=\"none\" stroke=\"black\"/>\n"
+                "<text x=\"%.1f\" y=\"%d\" text-anchor=\"middle\">"
+                "arithmetic intensity (flops/byte)</text>\n"
+                "<text x=\"15\" y=\"%.1f\" text-anchor=\"middle\" "
+                "transform=\"rotate(-90 15 %.1f)\">GFLOP/s</text>\n",
+                ml, mt, pw, ph, ml + pw / 2, height - 10, mt + ph / 2,
+                mt + ph / 2);
+        s += buf;
+        for (const auto &c : compute_) {
+            double x0 = bandwidth_.empty() ? ax.x0
+                                           : std::max(ax.x0,
+                                                   ridge(bandwidth_[0], c));
+            snprintf(buf, sizeof(buf),
+                    "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" "
+                    "stroke=\"black\" stroke-width=\"2\"/>\n"
+                    "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"end\">%s "
+                    "%.1f GFLOP/s</text>\n",
+                    px(x0), py(c.value), ml + pw, py(c.value), ml + pw - 4,
+                    py(c.value) - 5, escape(c.name).c_str(), c.value);
+            s += buf;
+        }
+        for (size_t i = 0; i < bandwidth_.size(); ++i) {
+            const Ceiling &b = bandwidth_[i];
+            double x0 = std::max(ax.x0, ax.y0 / b.value);
+            double x1 = std::min(ax.x1, ridge(b));
+            if (x0 >= x1) continue;
+            const char *color = colors[i % 8];
+            snprintf(buf, sizeof(buf),
+                    "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" "
+                    "stroke=\"%s\" stroke-width=\"2\"/>\n"
+                    "<text x=\"%.1f\" y=\"%.1f\" fill=\"%s\">%s %.1f GB/s"
+                    "</text>\n",
+                    px(x0), py(b.value * x0), px(x1), py(b.value * x1),
+                    color, px(x0) + 4, py(b.value * x0) - 6, color,
+                    escape(b.name).c_str(), b.value);
+            s += buf;
+        }
+        for (const auto &p : points_) {
+            snprintf(buf, sizeof(buf),
+                    "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"4\" fill=\"black\"/>"
+                    "<text x=\"%.1f\" y=\"%.1f\">%s</text>\n",
+                    px(p.ai), py(p.gflops), px(p.ai) + 6, py(p.gflops) + 4,
+                    escape(p.name).c_str());
+            s += buf;
+        }
+        s += "</svg>\n";
+        return s;
+    }
+
+private:
+    // log-log ranges on powers of two, fx / fy map into [0, 1]
+    struct Axes {
+        double x0, x1, y0, y1;
+        double fx(double ai) const {
+            return std::log(ai / x0) / std::log(x1 / x0);
+        }
+        double fy(double g) const {
+            return std::log(g / y0) / std::log(y1 / y0);
+        }
+    };
+
+    std::vector<Ceiling> compute_;
+    std::vector<Ceiling> bandwidth_;
+    std::vector<Point> points_;
+
+    static void add(std::vector<Ceiling> &v, const Ceiling &c) {
+        v.push_back(c);
+        std::stable_sort(v.begin(), v.end(),
+                [](const Ceiling &a, const Ceiling &b) {
+                    return a.value > b.value;
+                });
+    }
+
+    double ridge(const Ceiling &b, const Ceiling &c) const {
+        return c.value / b.value;
+    }
+
+    static char point_char(size_t i) {
+        return static_cast<char>(i < 26 ? 'A' + i : 'a' + (i - 26) % 26);
+    }
+
+    static std::string escape(const std::string &s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '<') out += "&lt;";
+            else if (c == '>') out += "&gt;";
+            else if (c == '&') out += "&amp;";
+            else out += c;
+        }
+        return out;
+    }
+
+    Axes axes() const {
+        double lo_ai = 1. / 16, hi_ai = 16.;
+        double lo_g = peak() > 0. ? peak() / 64 : 1., hi_g = peak();
+        for (const auto &b : bandwidth_)
+            hi_ai = std::max(hi_ai, 2. * ridge(b));
+        for (const auto &p : points_) {
+            if (p.ai <= 0. || p.gflops <= 0.) continue;
+            lo_ai = std::min(lo_ai, p.ai);
+            hi_ai = std::max(hi_ai, p.ai);
+            lo_g = std::min(lo_g, p.gflops);
+            hi_g = std::max(hi_g, p.gflops);
+        }
+        if (hi_g <= 0.) hi_g = 1.;
+        Axes ax;
+        ax.x0 = std::pow(2., std::floor(std::log2(lo_ai)));
+        ax.x1 = std::pow(2., std::ceil(std::log2(hi_ai)));
+        ax.y0 = std::pow(2., std::floor(std::log2(lo_g)));
+        ax.y1 = std::pow(2., std::ceil(std::log2(hi_g * 1.1)));
+        if (ax.y1 <= ax.y0) ax.y1 = 2. * ax.y0;
+        return ax;
+    }
+};
+
+} // namespace roofline
+
+#endif // ROOFLINE_HPP_
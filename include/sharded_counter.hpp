@@ -0,0 +1,152 @@
+// Cache-line padded values and per-thread sharded counters
+#ifndef SHARDED_COUNTER_HPP_
+#define SHARDED_COUNTER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Two threads writing to different variables on the same cache line keep
+// stealing the line from each other (false sharing), although they never
+// share data.
+//
+// Take-aways
+//  ** give every per-thread variable its own line, alignas() pads the type
+//  ** on x86 the L2 spatial prefetcher fetches lines in 128-byte pairs, so
+//     neighbours 64 bytes apart still interfere; pad to 128 bytes
+//  ** count on a private shard with relaxed atomics and only sum the shards
+//     when the value is read
+namespace concurrent {
+
+#define CACHE_LINE_SIZE (64)
+
+// false sharing range: std::hardware_destructive_interference_size where the
+// library has it (C++17), otherwise two lines for the adjacent-line prefetcher
+#if defined(__cpp_lib_hardware_interference_size)
+#define FALSE_SHARING_SIZE \
+    (std::hardware_destructive_interference_size > 128 \
+                    ? std::hardware_destructive_interference_size \
+                    : 128)
+#else
+#define FALSE_SHARING_SIZE (128)
+#endif
+
+// a T alone on its own Align bytes, no other object shares them
+template <typename T, size_t Align = FALSE_SHARING_SIZE>
+struct alignas(Align) padded {
+    T value {};
+
+    padded() = default;
+    explicit padded(const T &v) : value(v) {}
+
+    T &operator*() { return value; }
+    const T &operator*() const { return value; }
+    T *operator->() { return &value; }
+    const T *operator->() const { return &value; }
+};
+
+// Counter split into padded shards; a thread always adds to the same shard,
+// read() sums all shards with relaxed loads, so it is exact only once the
+// writers are quiescent
+class ShardedCounter {
+public:
+    explicit ShardedCounter(size_t num_shards = 0) {
+        size_t n = num_shards ? num_shards
+                              : std::max(1u, std::thread::hardware_concurrency());
+        num_shards_ = 1;
+        while (num_shards_ < n)
+            num_shards_ *= 2;
+        // std::vector does not honour over-alignment before C++17
+        void *p = nullptr;
+        if (posix_memalign(&p, alignof(Shard), num_shards_ * sizeof(Shard)))
+            throw std::bad_alloc();
+        shards_ = static_cast<Shard *>(p);
+        for (size_t i = 0; i < num_shards_; ++i)
+            new (shards_ + i) Shard();
+    }
+
+    ~ShardedCounter() {
+        for (size_t i = 0; i < num_shards_; ++i)
+            shards_[i].~Shard();
+        free(shards_);
+    }
+
+    ShardedCounter(const ShardedCounter &) = delete;
+    ShardedCounter &operator=(const ShardedCounter &) = delete;
+
+    void add(long n = 1) {
+        shards_[thread_index() & (num_shards_ - 1)].value.fetch_add(
+                n, std::memory_order_relaxed);
+    }
+
+    void sub(long n = 1) { add(-n); }
+
+    long read() const {
+        long sum = 0;
+        for (size_t i = 0; i < num_shards_; ++i)
+            sum += shards_[i].value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    void reset() {
+        for (size_t i = 0; i < num_shards_; ++i)
+            shards_[i].value.store(0, std::memory_order_relaxed);
+    }
+
+    size_t num_shards() const { return num_shards_; }
+
+    // small dense id of the calling thread, assigned on first use: the
+    // lowest id no live thread holds, given back when the thread exits, so
+    // threads alive at the same time never share a shard while there are
+    // at least as many shards as threads
+    static size_t thread_index() {
+        thread_local Slot slot;
+        return slot.id;
+    }
+
+private:
+    class ThreadIds {
+    public:
+        size_t acquire() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t id = std::find(used_.begin(), used_.end(), false)
+                    - used_.begin();
+            if (id == used_.size()) used_.push_back(false);
+            used_[id] = true;
+            return id;
+        }
+        void release(size_t id) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            used_[id] = false;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::vector<bool> used_;
+    };
+
+    static ThreadIds &ids() {
+        // never destroyed, threads may exit after static destruction
+        static ThreadIds *ids = new ThreadIds();
+        return *ids;
+    }
+
+    struct Slot {
+        size_t id;
+        Slot() : id(ids().acquire()) {}
+        ~Slot() { ids().release(id); }
+    };
+
+    using Shard = padded<std::atomic<long>>;
+
+    Shard *shards_ {nullptr};
+    size_t num_shards_;
+};
+
+} // namespace concurrent
+#endif
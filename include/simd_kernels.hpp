@@ -0,0 +1,428 @@
+// Explicitly vectorized streaming kernels with runtime ISA dispatch
+#ifndef SIMD_KERNELS_HPP_
+#define SIMD_KERNELS_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAS_X86_SIMD (1)
+#endif
+
+#include "thread_team.hpp"
+#include "topology.hpp"
+
+// Kernels over float arrays, each in a scalar, an AVX2 (+FMA) and an AVX-512
+// version:
+//  * add:   x[i] += c             (the update loop of 0_memory_access)
+//  * axpy:  y[i] += a * x[i]
+//  * sum:   x[0] + ... + x[n-1]
+//  * max:   max(x[0], ..., x[n-1])
+// The vector versions are compiled with function target attributes, so the
+// build needs no -mavx flags, and the best one the CPU supports is picked at
+// run time. The parallel_* versions split the work over a ThreadTeam in
+// chunks aligned to cache lines.
+//
+// Take-aways
+//  ** peel a scalar (AVX2) or masked (AVX-512) head until the stores are
+//     aligned, run aligned vector stores, then a tail
+//  ** reductions keep several independent accumulators, one accumulator is
+//     bound by the add latency rather than by the loads
+//  ** without -ffast-math the compiler cannot reorder a float sum, so the
+//     autovectorized loop stays scalar
+//  ** on large arrays all versions end up at the memory bandwidth, the ISA
+//     matters for data in the caches
+namespace simd {
+
+enum Isa { SCALAR = 0, AVX2, AVX512, NUM_ISAS };
+
+inline const char *isa_name(Isa isa) {
+    static const char *names[NUM_ISAS] = {"scalar", "avx2", "avx512"};
+    return names[isa];
+}
+
+inline bool supported(Isa isa) {
+#ifdef HAS_X86_SIMD
+    switch (isa) {
+        case SCALAR: return true;
+        case AVX2:
+            return __builtin_cpu_supports("avx2")
+                    && __builtin_cpu_supports("fma");
+        case AVX512: return __builtin_cpu_supports("avx512f");
+        default: return false;
+    }
+#else
+    return isa == SCALAR;
+#endif
+}
+
+// widest supported ISA
+inline Isa best_isa() {
+    static const Isa best = supported(AVX512) ? AVX512
+            : supported(AVX2)                 ? AVX2
+                                              : SCALAR;
+    return best;
+}
+
+// keep the scalar versions scalar, whatever the optimization level
+#if defined(__clang__)
+#define SIMD_SCALAR_FN
+#define SIMD_SCALAR_LOOP _Pragma("clang loop vectorize(disable)")
+#elif defined(__GNUC__)
+#define SIMD_SCALAR_FN __attribute__((optimize("no-tree-vectorize")))
+#define SIMD_SCALAR_LOOP
+#else
+#define SIMD_SCALAR_FN
+#define SIMD_SCALAR_LOOP
+#endif
+
+namespace detail {
+
+// elements until p is aligned to bytes, at most n
+inline size_t head(const float *p, size_t bytes, size_t n) {
+    size_t mis = reinterpret_cast<uintptr_t>(p) & (bytes - 1);
+    size_t h = mis ? (bytes - mis) / sizeof(float) : 0;
+    return std::min(h, n);
+}
+
+SIMD_SCALAR_FN inline void scalar_add(float *x, size_t n, float c) {
+    SIMD_SCALAR_LOOP
+    for (size_t i = 0; i < n; ++i)
+        x[i] += c;
+}
+
+SIMD_SCALAR_FN inline void scalar_axpy(
+        size_t n, float a, const float *x, float *y) {
+    SIMD_SCALAR_LOOP
+    for (size_t i = 0; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+SIMD_SCALAR_FN inline float scalar_sum(const float *x, size_t n) {
+    float s0 = 0.f, s1 = 0.f, s2 = 0.f, s3 = 0.f;
+    size_t i = 0;
+    SIMD_SCALAR_LOOP
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i];
+        s1 += x[i + 1];
+        s2 += x[i + 2];
+        s3 += x[i + 3];
+    }
+    for (; i < n; ++i)
+        s0 += x[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+SIMD_SCALAR_FN inline float scalar_max(const float *x, size_t n) {
+    float m0 = -std::numeric_limits<float>::infinity();
+    float m1 = m0, m2 = m0, m3 = m0;
+    size_t i = 0;
+    SIMD_SCALAR_LOOP
+    for (; i + 4 <= n; i += 4) {
+        m0 = std::max(m0, x[i]);
+        m1 = std::max(m1, x[i + 1]);
+        m2 = std::max(m2, x[i + 2]);
+        m3 = std::max(m3, x[i + 3]);
+    }
+    for (; i < n; ++i)
+        m0 = std::max(m0, x[i]);
+    return std::max(std::max(m0, m1), std::max(m2, m3));
+}
+
+#ifdef HAS_X86_SIMD
+
+#define SIMD_AVX2_FN __attribute__((target("avx2,fma")))
+#define SIMD_AVX512_FN __attribute__((target("avx512f")))
+
+SIMD_AVX2_FN inline float avx2_hsum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+SIMD_AVX2_FN inline float avx2_hmax(__m256 v) {
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_movehdup_ps(m));
+    return _mm_cvtss_f32(m);
+}
+
+SIMD_AVX2_FN inline void avx2_add(float *x, size_t n, float c) {
+    size_t i = head(x, 32, n);
+    for (size_t j = 0; j < i; ++j)
+        x[j] += c;
+    __m256 vc = _mm256_set1_ps(c);
+    for (; i + 16 <= n; i += 16) {
+        _mm256_store_ps(x + i, _mm256_add_ps(_mm256_load_ps(x + i), vc));
+        _mm256_store_ps(
+                x + i + 8, _mm256_add_ps(_mm256_load_ps(x + i + 8), vc));
+    }
+    for (; i + 8 <= n; i += 8)
+        _mm256_store_ps(x + i, _mm256_add_ps(_mm256_load_ps(x + i), vc));
+    for (; i < n; ++i)
+        x[i] += c;
+}
+
+SIMD_AVX2_FN inline void avx2_axpy(
+        size_t n, float a, const float *x, float *y) {
+    // align the stores, x may be misaligned against y
+    size_t i = head(y, 32, n);
+    for (size_t j = 0; j < i; ++j)
+        y[j] += a * x[j];
+    __m256 va = _mm256_set1_ps(a);
+    for (; i + 16 <= n; i += 16) {
+        _mm256_store_ps(y + i,
+                _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_load_ps(y + i)));
+        _mm256_store_ps(y + i + 8,
+                _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i + 8),
+                        _mm256_load_ps(y + i + 8)));
+    }
+    for (; i + 8 <= n; i += 8)
+        _mm256_store_ps(y + i,
+                _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_load_ps(y + i)));
+    for (; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+SIMD_AVX2_FN inline float avx2_sum(const float *x, size_t n) {
+    size_t i = head(x, 32, n);
+    float s = 0.f;
+    for (size_t j = 0; j < i; ++j)
+        s += x[j];
+    __m256 s0 = _mm256_setzero_ps(), s1 = s0, s2 = s0, s3 = s0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm256_add_ps(s0, _mm256_load_ps(x + i));
+        s1 = _mm256_add_ps(s1, _mm256_load_ps(x + i + 8));
+        s2 = _mm256_add_ps(s2, _mm256_load_ps(x + i + 16));
+        s3 = _mm256_add_ps(s3, _mm256_load_ps(x + i + 24));
+    }
+    for (; i + 8 <= n; i += 8)
+        s0 = _mm256_add_ps(s0, _mm256_load_ps(x + i));
+    s += avx2_hsum(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+    for (; i < n; ++i)
+        s += x[i];
+    return s;
+}
+
+SIMD_AVX2_FN inline float avx2_max(const float *x, size_t n) {
+    size_t i = head(x, 32, n);
+    float m = -std::numeric_limits<float>::infinity();
+    for (size_t j = 0; j < i; ++j)
+        m = std::max(m, x[j]);
+    __m256 m0 = _mm256_set1_ps(m), m1 = m0, m2 = m0, m3 = m0;
+    for (; i + 32 <= n; i += 32) {
+        m0 = _mm256_max_ps(m0, _mm256_load_ps(x + i));
+        m1 = _mm256_max_ps(m1, _mm256_load_ps(x + i + 8));
+        m2 = _mm256_max_ps(m2, _mm256_load_ps(x + i + 16));
+        m3 = _mm256_max_ps(m3, _mm256_load_ps(x + i + 24));
+    }
+    for (; i + 8 <= n; i += 8)
+        m0 = _mm256_max_ps(m0, _mm256_load_ps(x + i));
+    m = avx2_hmax(_mm256_max_ps(_mm256_max_ps(m0, m1), _mm256_max_ps(m2, m3)));
+    for (; i < n; ++i)
+        m = std::max(m, x[i]);
+    return m;
+}
+
+// AVX-512 heads and tails are masked vector operations
+SIMD_AVX512_FN inline __mmask16 avx512_mask(size_t k) {
+    return static_cast<__mmask16>((1u << k) - 1);
+}
+
+SIMD_AVX512_FN inline void avx512_add(float *x, size_t n, float c) {
+    __m512 vc = _mm512_set1_ps(c);
+    size_t i = head(x, 64, n);
+    if (i) {
+        __mmask16 m = avx512_mask(i);
+        _mm512_mask_storeu_ps(
+                x, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, x), vc));
+    }
+    for (; i + 32 <= n; i += 32) {
+        _mm512_store_ps(x + i, _mm512_add_ps(_mm512_load_ps(x + i), vc));
+        _mm512_store_ps(
+                x + i + 16, _mm512_add_ps(_mm512_load_ps(x + i + 16), vc));
+    }
+    for (; i + 16 <= n; i += 16)
+        _mm512_store_ps(x + i, _mm512_add_ps(_mm512_load_ps(x + i), vc));
+    if (i < n) {
+        __mmask16 m = avx512_mask(n - i);
+        _mm512_mask_storeu_ps(x + i, m,
+                _mm512_add_ps(_mm512_maskz_loadu_ps(m, x + i), vc));
+    }
+}
+
+SIMD_AVX512_FN inline void avx512_axpy(
+        size_t n, float a, const float *x, float *y) {
+    __m512 va = _mm512_set1_ps(a);
+    size_t i = head(y, 64, n);
+    if (i) {
+        __mmask16 m = avx512_mask(i);
+        _mm512_mask_storeu_ps(y, m,
+                _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x),
+                        _mm512_maskz_loadu_ps(m, y)));
+    }
+    for (; i + 32 <= n; i += 32) {
+        _mm512_store_ps(y + i,
+                _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_load_ps(y + i)));
+        _mm512_store_ps(y + i + 16,
+                _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i + 16),
+                        _mm512_load_ps(y + i + 16)));
+    }
+    for (; i + 16 <= n; i += 16)
+        _mm512_store_ps(y + i,
+                _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_load_ps(y + i)));
+    if (i < n) {
+        __mmask16 m = avx512_mask(n - i);
+        _mm512_mask_storeu_ps(y + i, m,
+                _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i),
+                        _mm512_maskz_loadu_ps(m, y + i)));
+    }
+}
+
+SIMD_AVX512_FN inline float avx512_sum(const float *x, size_t n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = head(x, 64, n);
+    if (i) s0 = _mm512_maskz_loadu_ps(avx512_mask(i), x);
+    for (; i + 64 <= n; i += 64) {
+        s0 = _mm512_add_ps(s0, _mm512_load_ps(x + i));
+        s1 = _mm512_add_ps(s1, _mm512_load_ps(x + i + 16));
+        s2 = _mm512_add_ps(s2, _mm512_load_ps(x + i + 32));
+        s3 = _mm512_add_ps(s3, _mm512_load_ps(x + i + 48));
+    }
+    for (; i + 16 <= n; i += 16)
+        s0 = _mm512_add_ps(s0, _mm512_load_ps(x + i));
+    if (i < n)
+        s1 = _mm512_add_ps(s1, _mm512_maskz_loadu_ps(avx512_mask(n - i), x + i));
+    return _mm512_reduce_add_ps(
+            _mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
+}
+
+SIMD_AVX512_FN inline float avx512_max(const float *x, size_t n) {
+    const __m512 lowest
+            = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    __m512 m0 = lowest, m1 = lowest, m2 = lowest, m3 = lowest;
+    size_t i = head(x, 64, n);
+    if (i) m0 = _mm512_mask_loadu_ps(lowest, avx512_mask(i), x);
+    for (; i + 64 <= n; i += 64) {
+        m0 = _mm512_max_ps(m0, _mm512_load_ps(x + i));
+        m1 = _mm512_max_ps(m1, _mm512_load_ps(x + i + 16));
+        m2 = _mm512_max_ps(m2, _mm512_load_ps(x + i + 32));
+        m3 = _mm512_max_ps(m3, _mm512_load_ps(x + i + 48));
+    }
+    for (; i + 16 <= n; i += 16)
+        m0 = _mm512_max_ps(m0, _mm512_load_ps(x + i));
+    if (i < n)
+        m1 = _mm512_max_ps(
+                m1, _mm512_mask_loadu_ps(lowest, avx512_mask(n - i), x + i));
+    return _mm512_reduce_max_ps(
+            _mm512_max_ps(_mm512_max_ps(m0, m1), _mm512_max_ps(m2, m3)));
+}
+
+#endif // HAS_X86_SIMD
+
+// requested ISA if the CPU has it, else the best one
+inline Isa resolve(Isa isa) {
+    return supported(isa) ? isa : best_isa();
+}
+
+} // namespace detail
+
+inline void add(float *x, size_t n, float c, Isa isa = best_isa()) {
+    switch (detail::resolve(isa)) {
+#ifdef HAS_X86_SIMD
+        case AVX512: return detail::avx512_add(x, n, c);
+        case AVX2: return detail::avx2_add(x, n, c);
+#endif
+        default: return detail::scalar_add(x, n, c);
+    }
+}
+
+inline void axpy(size_t n, float a, const float *x, float *y,
+        Isa isa = best_isa()) {
+    switch (detail::resolve(isa)) {
+#ifdef HAS_X86_SIMD
+        case AVX512: return detail::avx512_axpy(n, a, x, y);
+        case AVX2: return detail::avx2_axpy(n, a, x, y);
+#endif
+        default: return detail::scalar_axpy(n, a, x, y);
+    }
+}
+
+inline float sum(const float *x, size_t n, Isa isa = best_isa()) {
+    switch (detail::resolve(isa)) {
+#ifdef HAS_X86_SIMD
+        case AVX512: return detail::avx512_sum(x, n);
+        case AVX2: return detail::avx2_sum(x, n);
+#endif
+        default: return detail::scalar_sum(x, n);
+    }
+}
+
+// -inf for an empty array
+inline float max(const float *x, size_t n, Isa isa = best_isa()) {
+    switch (detail::resolve(isa)) {
+#ifdef HAS_X86_SIMD
+        case AVX512: return detail::avx512_max(x, n);
+        case AVX2: return detail::avx2_max(x, n);
+#endif
+        default: return detail::scalar_max(x, n);
+    }
+}
+
+// floats per cache line, the alignment of the per-thread chunks
+inline size_t chunk_align() {
+    return std::max<size_t>(1, topology::info().line_size / sizeof(float));
+}
+
+inline void parallel_add(thread_team::ThreadTeam &team, float *x, size_t n,
+        float c, Isa isa = best_isa()) {
+    team.run([&](int tid) {
+        auto r = thread_team::chunk(n, tid, team.size(), chunk_align());
+        add(x + r.first, r.second - r.first, c, isa);
+    });
+}
+
+inline void parallel_axpy(thread_team::ThreadTeam &team, size_t n, float a,
+        const float *x, float *y, Isa isa = best_isa()) {
+    team.run([&](int tid) {
+        auto r = thread_team::chunk(n, tid, team.size(), chunk_align());
+        axpy(r.second - r.first, a, x + r.first, y + r.first, isa);
+    });
+}
+
+// partial results of the threads one cache line apart
+inline float parallel_sum(thread_team::ThreadTeam &team, const float *x,
+        size_t n, Isa isa = best_isa()) {
+    const size_t stride = chunk_align();
+    std::vector<float> partial(team.size() * stride, 0.f);
+    team.run([&](int tid) {
+        auto r = thread_team::chunk(n, tid, team.size(), stride);
+        partial[tid * stride] = sum(x + r.first, r.second - r.first, isa);
+    });
+    float s = 0.f;
+    for (int t = 0; t < team.size(); ++t)
+        s += partial[t * stride];
+    return s;
+}
+
+inline float parallel_max(thread_team::ThreadTeam &team, const float *x,
+        size_t n, Isa isa = best_isa()) {
+    const size_t stride = chunk_align();
+    std::vector<float> partial(
+            team.size() * stride, -std::numeric_limits<float>::infinity());
+    team.run([&](int tid) {
+        auto r = thread_team::chunk(n, tid, team.size(), stride);
+        partial[tid * stride] = max(x + r.first, r.second - r.first, isa);
+    });
+    float m = -std::numeric_limits<float>::infinity();
+    for (int t = 0; t < team.size(); ++t)
+        m = std::max(m, partial[t * stride]);
+    return m;
+}
+
+} // namespace simd
+#endif
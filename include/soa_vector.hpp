@@ -0,0 +1,390 @@
+// A vector of records stored as AoS, SoA or AoSoA behind one API
+#ifndef SOA_VECTOR_HPP_
+#define SOA_VECTOR_HPP_
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// soa_vector<Layout, Fields...> holds size() records of the given fields:
+//  * AoS: records one after the other, like std::vector<struct>
+//  * SoA: one array per field
+//  * AoSoA<W>: tiles of W records, one array of W per field within a tile,
+//    so a tile of one field fills a W-wide SIMD register
+//
+// Kernels see the same API for every layout:
+//  * v[i] is a proxy, get<I>(v[i]) the field I of record i
+//  * field<I>(v) is a view of one field, field<I>(v)[i] as above
+//  * for_each_block(v, f) calls f(block, n) on runs of n records, and
+//    field<I>(block) is a plain pointer for SoA and AoSoA (the whole vector,
+//    or one tile) and a strided view for AoS, so a loop over j < n compiles
+//    to unit-stride (vectorizable) code wherever the layout allows it
+// Fields must be trivially copyable; new records are zeroed.
+//
+// Take-aways
+//  ** a kernel that touches 1 of N fields reads N times the bytes it needs
+//     from an AoS, and only those bytes from an SoA or AoSoA
+//  ** a kernel that touches every field streams one array per field from an
+//     SoA, one stream from an AoS or AoSoA
+//  ** AoSoA keeps the fields of a record within one tile (one page, few
+//     lines), and each field of a tile a full vector
+namespace soa {
+
+struct AoS {};
+struct SoA {};
+template <size_t W>
+struct AoSoA {
+    static_assert(W > 0 && (W & (W - 1)) == 0, "tile width is a power of two");
+};
+
+// alignment of the storage, and of every array of an SoA
+#define SOA_ALIGN (64)
+
+namespace detail {
+
+template <size_t I, typename... Ts>
+using nth = typename std::tuple_element<I, std::tuple<Ts...>>::type;
+
+constexpr size_t align_up(size_t x, size_t a) { return (x + a - 1) / a * a; }
+
+// offset of field I in a record with every field at its natural alignment
+template <size_t I, typename... Ts>
+constexpr size_t offset() {
+    size_t sizes[] = {sizeof(Ts)...};
+    size_t aligns[] = {alignof(Ts)...};
+    size_t off = 0;
+    for (size_t k = 0; k < I; ++k)
+        off = align_up(off, aligns[k]) + sizes[k];
+    return align_up(off, aligns[I]);
+}
+
+template <typename... Ts>
+constexpr size_t record_size() {
+    size_t aligns[] = {alignof(Ts)...};
+    size_t a = 1;
+    for (size_t x : aligns)
+        a = x > a ? x : a;
+    constexpr size_t last = sizeof...(Ts) - 1;
+    return align_up(offset<last, Ts...>() + sizeof(nth<last, Ts...>), a);
+}
+
+// offset of the array of field I in an SoA of capacity cap; each array is
+// padded by one more line, so that power-of-two capacities do not put every
+// array on the same cache sets (and 4K-alias their loads and stores)
+template <size_t I, typename... Ts>
+size_t soa_offset(size_t cap) {
+    size_t sizes[] = {sizeof(Ts)...};
+    size_t off = 0;
+    for (size_t k = 0; k < I; ++k)
+        off += align_up(sizes[k] * cap, SOA_ALIGN) + SOA_ALIGN;
+    return off;
+}
+
+// view of a field of an AoS, records Stride bytes apart
+template <typename T, size_t Stride>
+struct strided {
+    char *p;
+    T &operator[](size_t i) const {
+        return *reinterpret_cast<T *>(p + i * Stride);
+    }
+};
+
+// view of a field of an AoSoA, W elements per tile of TileBytes
+template <typename T, size_t W, size_t TileBytes>
+struct tiled {
+    char *p;
+    T &operator[](size_t i) const {
+        return *reinterpret_cast<T *>(
+                p + (i / W) * TileBytes + (i % W) * sizeof(T));
+    }
+};
+
+template <typename Layout>
+struct layout;
+
+template <>
+struct layout<AoS> {
+    static const char *name() { return "aos"; }
+    // records per block of for_each_block
+    static constexpr size_t block = ~static_cast<size_t>(0);
+
+    template <typename... Ts>
+    static size_t bytes(size_t cap) {
+        return cap * record_size<Ts...>();
+    }
+    template <size_t I, typename... Ts>
+    static char *at(char *d, size_t, size_t i) {
+        return d + i * record_size<Ts...>() + offset<I, Ts...>();
+    }
+    template <size_t I, typename... Ts>
+    static strided<nth<I, Ts...>, record_size<Ts...>()> view(
+            char *d, size_t cap, size_t first) {
+        return {at<I, Ts...>(d, cap, first)};
+    }
+    template <size_t I, typename... Ts>
+    static strided<nth<I, Ts...>, record_size<Ts...>()> block_view(
+            char *d, size_t cap, size_t first) {
+        return view<I, Ts...>(d, cap, first);
+    }
+};
+
+template <>
+struct layout<SoA> {
+    static const char *name() { return "soa"; }
+    static constexpr size_t block = ~static_cast<size_t>(0);
+
+    template <typename... Ts>
+    static size_t bytes(size_t cap) {
+        return soa_offset<sizeof...(Ts) - 1, Ts...>(cap)
+                + align_up(sizeof(nth<sizeof...(Ts) - 1, Ts...>) * cap,
+                        SOA_ALIGN);
+    }
+    template <size_t I, typename... Ts>
+    static char *at(char *d, size_t cap, size_t i) {
+        return d + soa_offset<I, Ts...>(cap) + i * sizeof(nth<I, Ts...>);
+    }
+    template <size_t I, typename... Ts>
+    static nth<I, Ts...> *view(char *d, size_t cap, size_t first) {
+        return reinterpret_cast<nth<I, Ts...> *>(at<I, Ts...>(d, cap, first));
+    }
+    template <size_t I, typename... Ts>
+    static nth<I, Ts...> *block_view(char *d, size_t cap, size_t first) {
+        return view<I, Ts...>(d, cap, first);
+    }
+};
+
+template <size_t W>
+struct layout<AoSoA<W>> {
+    static const char *name() {
+        static const std::string n = "aosoa" + std::to_string(W);
+        return n.c_str();
+    }
+    static constexpr size_t block = W;
+
+    template <typename... Ts>
+    static constexpr size_t tile_bytes() {
+        return W * record_size<Ts...>();
+    }
+    template <typename... Ts>
+    static size_t bytes(size_t cap) {
+        return (cap + W - 1) / W * tile_bytes<Ts...>();
+    }
+    template <size_t I, typename... Ts>
+    static char *at(char *d, size_t, size_t i) {
+        return d + (i / W) * tile_bytes<Ts...>() + W * offset<I, Ts...>()
+                + (i % W) * sizeof(nth<I, Ts...>);
+    }
+    // a view from the first record of a tile
+    template <size_t I, typename... Ts>
+    static tiled<nth<I, Ts...>, W, tile_bytes<Ts...>()> view(
+            char *d, size_t cap, size_t first) {
+        return {at<I, Ts...>(d, cap, first)};
+    }
+    // blocks are tiles, contiguous per field
+    template <size_t I, typename... Ts>
+    static nth<I, Ts...> *block_view(char *d, size_t cap, size_t first) {
+        return reinterpret_cast<nth<I, Ts...> *>(at<I, Ts...>(d, cap, first));
+    }
+};
+
+template <typename F, size_t... I>
+void for_fields(F &&f, std::index_sequence<I...>) {
+    int expand[] = {0, (f(std::integral_constant<size_t, I>()), 0)...};
+    (void)expand;
+}
+
+} // namespace detail
+
+template <typename Layout, typename... Fields>
+class soa_vector {
+    static_assert(sizeof...(Fields) > 0, "at least one field");
+    using traits = detail::layout<Layout>;
+    using fields = std::index_sequence_for<Fields...>;
+
+public:
+    using layout_type = Layout;
+    template <size_t I>
+    using field_type = detail::nth<I, Fields...>;
+    static constexpr size_t num_fields = sizeof...(Fields);
+    // bytes of one record, as in an AoS
+    static constexpr size_t record_bytes = detail::record_size<Fields...>();
+
+    // record i
+    class reference {
+    public:
+        reference(soa_vector *v, size_t i) : v_(v), i_(i) {}
+        template <size_t I>
+        field_type<I> &get() const {
+            return v_->template get<I>(i_);
+        }
+        void set(const Fields &...values) const { v_->set(i_, values...); }
+        std::tuple<Fields...> load() const {
+            return load(fields());
+        }
+
+    private:
+        soa_vector *v_;
+        size_t i_;
+
+        template <size_t... I>
+        std::tuple<Fields...> load(std::index_sequence<I...>) const {
+            return std::tuple<Fields...>(get<I>()...);
+        }
+    };
+
+    // records [first, first + n) of for_each_block
+    class block {
+    public:
+        block(soa_vector *v, size_t first) : v_(v), first_(first) {}
+        template <size_t I>
+        auto field() const {
+            return traits::template block_view<I, Fields...>(
+                    v_->data_, v_->capacity_, first_);
+        }
+        size_t first() const { return first_; }
+
+    private:
+        soa_vector *v_;
+        size_t first_;
+    };
+
+    soa_vector() = default;
+    explicit soa_vector(size_t n) { resize(n); }
+
+    soa_vector(const soa_vector &other) {
+        reserve(other.capacity_);
+        size_ = other.size_;
+        if (data_) memcpy(data_, other.data_, bytes(capacity_));
+    }
+
+    soa_vector(soa_vector &&other) noexcept { swap(other); }
+
+    soa_vector &operator=(soa_vector other) {
+        swap(other);
+        return *this;
+    }
+
+    ~soa_vector() { free(data_); }
+
+    void swap(soa_vector &other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    static const char *layout_name() { return traits::name(); }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+    // bytes of storage for cap records
+    static size_t bytes(size_t cap) {
+        return traits::template bytes<Fields...>(cap);
+    }
+    const void *data() const { return data_; }
+
+    void reserve(size_t cap) {
+        if (cap <= capacity_) return;
+        void *p = nullptr;
+        size_t n = std::max<size_t>(bytes(cap), SOA_ALIGN);
+        if (posix_memalign(&p, SOA_ALIGN, n)) throw std::bad_alloc();
+        memset(p, 0, n);
+        char *d = static_cast<char *>(p);
+        // field by field, as the offsets of an SoA depend on the capacity
+        detail::for_fields(
+                [&](auto f) {
+                    constexpr size_t I = decltype(f)::value;
+                    for (size_t i = 0; i < size_; ++i)
+                        memcpy(traits::template at<I, Fields...>(d, cap, i),
+                                &get<I>(i), sizeof(field_type<I>));
+                },
+                fields());
+        free(data_);
+        data_ = d;
+        capacity_ = cap;
+    }
+
+    void resize(size_t n) {
+        if (n > capacity_) reserve(std::max(n, 2 * capacity_));
+        // zero the records a shrink left behind
+        for (size_t i = size_; i < n; ++i)
+            set(i, Fields()...);
+        size_ = n;
+    }
+
+    void clear() { size_ = 0; }
+
+    void push_back(const Fields &...values) {
+        const size_t step = traits::block;
+        if (size_ == capacity_)
+            reserve(std::max<size_t>(2 * capacity_, step == ~0ul ? 16 : step));
+        set(size_++, values...);
+    }
+
+    reference operator[](size_t i) { return reference(this, i); }
+
+    template <size_t I>
+    field_type<I> &get(size_t i) const {
+        return *reinterpret_cast<field_type<I> *>(
+                traits::template at<I, Fields...>(data_, capacity_, i));
+    }
+
+    void set(size_t i, const Fields &...values) {
+        set_fields(i, std::forward_as_tuple(values...), fields());
+    }
+
+    // view of field I over all records
+    template <size_t I>
+    auto field() const {
+        return traits::template view<I, Fields...>(data_, capacity_, 0);
+    }
+
+    // f(block, n) on consecutive runs of records: the whole vector for AoS
+    // and SoA, one tile at a time for AoSoA
+    template <typename F>
+    void for_each_block(F &&f) {
+        const size_t step = traits::block;
+        for (size_t first = 0; first < size_;) {
+            size_t n = std::min(step, size_ - first);
+            f(block(this, first), n);
+            first += n;
+        }
+    }
+
+private:
+    char *data_ {nullptr};
+    size_t size_ {0};
+    size_t capacity_ {0};
+
+    template <typename Tuple, size_t... I>
+    void set_fields(
+            size_t i, const Tuple &values, std::index_sequence<I...>) {
+        int expand[] = {0, (get<I>(i) = std::get<I>(values), 0)...};
+        (void)expand;
+    }
+};
+
+// field I of a record, a vector or a block
+template <size_t I, typename R>
+auto get(const R &r) -> decltype(r.template get<I>()) {
+    return r.template get<I>();
+}
+
+template <size_t I, typename V>
+auto field(const V &v) -> decltype(v.template field<I>()) {
+    return v.template field<I>();
+}
+
+template <typename V, typename F>
+void for_each_block(V &v, F &&f) {
+    v.for_each_block(std::forward<F>(f));
+}
+
+} // namespace soa
+
+#endif // SOA_VECTOR_HPP_
@@ -0,0 +1,409 @@
+// Sparse matrix-vector multiply in CSR and SELL-C-sigma, with reorderings
+#ifndef SPMV_HPP_
+#define SPMV_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+// y = A x over a sparse A reads every matrix entry once and gathers x[col]
+// for each of them. The matrix streams, so the gathers decide the speed:
+// they hit the cache when nearby rows have nearby columns, and miss on every
+// entry when the columns are scattered over an x larger than the caches.
+//
+// Formats:
+//  * Csr: row pointers, column indices and values of the nonzeros, row by
+//    row
+//  * Sell: SELL-C-sigma. Rows are sorted by length within windows of sigma
+//    rows and cut into chunks of C rows. Each chunk is padded to its longest
+//    row and stored column-major, so the C rows of a chunk are the C lanes
+//    of a vector loop
+// Reorderings, both symmetric (rows and columns), return order[new] = old:
+//  * rcm: reverse Cuthill-McKee, a BFS from a peripheral node that visits
+//    neighbours by increasing degree, so the band around the diagonal gets
+//    narrow
+//  * degree_order: rows by decreasing degree, so the x entries of hubs,
+//    which most rows gather, share a few lines
+// Threads split the rows (chunks for Sell) by nonzeros, not by count, with
+// partition().
+//
+// Take-aways
+//  ** SpMV is bound by memory bandwidth, about 8 bytes per 2 flops for the
+//     matrix alone, so the best case is the stream rate
+//  ** x gathers that miss add up to a line per nonzero; a reordering that
+//     turns them into hits is worth more than any kernel tuning
+//  ** split rows by nnz: with power-law rows an equal row count per thread
+//     leaves one thread with the hubs
+//  ** SELL-C-sigma vectorizes over rows, and pays padding for rows of
+//     different lengths within a chunk; sigma trades padding for locality
+namespace spmv {
+
+using index_t = uint32_t;
+
+struct Csr {
+    size_t rows {0};
+    size_t cols {0};
+    // rows + 1 offsets into idx and val
+    std::vector<size_t> ptr;
+    std::vector<index_t> idx;
+    std::vector<float> val;
+
+    size_t nnz() const { return idx.size(); }
+    size_t degree(size_t r) const { return ptr[r + 1] - ptr[r]; }
+};
+
+// SELL-C-sigma: entry j of the row in lane l of chunk c is at
+// ptr[c] + j * C + l, padding entries have value 0 and column 0
+struct Sell {
+    size_t rows {0};
+    size_t cols {0};
+    size_t C {8};
+    size_t sigma {1};
+    // perm[k] is the row in slot k (chunk k / C, lane k % C)
+    std::vector<index_t> perm;
+    // chunks + 1 offsets into idx and val
+    std::vector<size_t> ptr;
+    std::vector<index_t> idx;
+    std::vector<float> val;
+    // nonzeros of the matrix, padding excluded
+    size_t nonzeros {0};
+
+    size_t nnz() const { return nonzeros; }
+    size_t chunks() const { return ptr.size() - 1; }
+    // stored entries, padding included
+    size_t stored() const { return idx.size(); }
+};
+
+// minimum traffic of one y = A x: the matrix, x and y once each
+inline double traffic(const Csr &a) {
+    return (a.rows + 1) * sizeof(size_t)
+            + a.nnz() * (sizeof(index_t) + sizeof(float))
+            + (a.rows + a.cols) * sizeof(float);
+}
+
+inline double traffic(const Sell &s) {
+    return s.ptr.size() * sizeof(size_t) + s.rows * sizeof(index_t)
+            + s.stored() * (sizeof(index_t) + sizeof(float))
+            + (s.rows + s.cols) * sizeof(float);
+}
+
+// mean |row - col| over the nonzeros, small when the gathers are local
+inline double mean_distance(const Csr &a) {
+    double sum = 0.;
+    for (size_t r = 0; r < a.rows; ++r)
+        for (size_t j = a.ptr[r]; j < a.ptr[r + 1]; ++j)
+            sum += std::fabs(static_cast<double>(r) - a.idx[j]);
+    return a.nnz() ? sum / a.nnz() : 0.;
+}
+
+// --- construction ---
+
+using Edges = std::vector<std::pair<index_t, index_t>>;
+
+// an n x n matrix from (row, col) entries, duplicates dropped, columns
+// sorted within rows, values in [0.5, 1.5)
+inline Csr from_edges(size_t n, const Edges &edges, uint64_t seed = 1) {
+    Csr a;
+    a.rows = a.cols = n;
+    std::vector<size_t> count(n + 1, 0);
+    for (const auto &e : edges)
+        ++count[e.first + 1];
+    std::partial_sum(count.begin(), count.end(), count.begin());
+    std::vector<index_t> cols(edges.size());
+    std::vector<size_t> fill(count.begin(), count.end() - 1);
+    for (const auto &e : edges)
+        cols[fill[e.first]++] = e.second;
+
+    a.ptr.assign(n + 1, 0);
+    a.idx.reserve(edges.size());
+    for (size_t r = 0; r < n; ++r) {
+        auto b = cols.begin() + count[r];
+        auto e = cols.begin() + count[r + 1];
+        std::sort(b, e);
+        a.idx.insert(a.idx.end(), b, std::unique(b, e));
+        a.ptr[r + 1] = a.idx.size();
+    }
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<float> dist(0.5f, 1.5f);
+    a.val.resize(a.idx.size());
+    for (auto &v : a.val)
+        v = dist(gen);
+    return a;
+}
+
+// random new names for the n nodes of edges
+inline void scramble(size_t n, Edges &edges, uint64_t seed) {
+    std::vector<index_t> name(n);
+    std::iota(name.begin(), name.end(), 0);
+    std::shuffle(name.begin(), name.end(), std::mt19937_64(seed));
+    for (auto &e : edges)
+        e = {name[e.first], name[e.second]};
+}
+
+// symmetric band matrix: the diagonal and about per_row entries per row
+// within half_band of it; with shuffle the nodes are renamed at random,
+// which hides the band until a reordering finds it again
+inline Csr banded(size_t n, size_t half_band, size_t per_row, bool shuffle,
+        uint64_t seed = 1) {
+    std::mt19937_64 gen(seed);
+    Edges edges;
+    edges.reserve(n * (per_row + 1));
+    half_band = std::max<size_t>(1, half_band);
+    for (size_t i = 0; i < n; ++i) {
+        edges.emplace_back(i, i);
+        for (size_t k = 0; k < per_row / 2; ++k) {
+            size_t j = i + 1 + gen() % half_band;
+            if (j >= n) continue;
+            edges.emplace_back(i, j);
+            edges.emplace_back(j, i);
+        }
+    }
+    if (shuffle) scramble(n, edges, seed + 1);
+    return from_edges(n, edges, seed);
+}
+
+// symmetric power-law graph (plus the diagonal) with about avg_degree
+// entries per row: both ends of an edge are drawn as n * u^skew for uniform
+// u, so low nodes become hubs with degrees falling off as a power law;
+// with shuffle the hubs are spread over the node range
+inline Csr power_law(size_t n, size_t avg_degree, double skew, bool shuffle,
+        uint64_t seed = 1) {
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<double> u(0., 1.);
+    auto node = [&] {
+        return static_cast<index_t>(
+                std::min<double>(n - 1, n * std::pow(u(gen), skew)));
+    };
+    Edges edges;
+    size_t m = n * avg_degree / 2;
+    edges.reserve(n + 2 * m);
+    for (size_t i = 0; i < n; ++i)
+        edges.emplace_back(i, i);
+    for (size_t k = 0; k < m; ++k) {
+        index_t a = node();
+        index_t b = node();
+        edges.emplace_back(a, b);
+        edges.emplace_back(b, a);
+    }
+    if (shuffle) scramble(n, edges, seed + 1);
+    return from_edges(n, edges, seed);
+}
+
+// B = P A P^T with order[new] = old
+inline Csr permute(const Csr &a, const std::vector<index_t> &order) {
+    std::vector<index_t> inv(a.rows);
+    for (size_t k = 0; k < order.size(); ++k)
+        inv[order[k]] = static_cast<index_t>(k);
+    Csr b;
+    b.rows = a.rows;
+    b.cols = a.cols;
+    b.ptr.assign(a.rows + 1, 0);
+    b.idx.resize(a.nnz());
+    b.val.resize(a.nnz());
+    std::vector<std::pair<index_t, float>> row;
+    for (size_t r = 0; r < a.rows; ++r) {
+        size_t old = order[r];
+        row.clear();
+        for (size_t j = a.ptr[old]; j < a.ptr[old + 1]; ++j)
+            row.emplace_back(inv[a.idx[j]], a.val[j]);
+        std::sort(row.begin(), row.end(),
+                [](const std::pair<index_t, float> &x,
+                        const std::pair<index_t, float> &y) {
+                    return x.first < y.first;
+                });
+        size_t at = b.ptr[r];
+        for (const auto &e : row) {
+            b.idx[at] = e.first;
+            b.val[at] = e.second;
+            ++at;
+        }
+        b.ptr[r + 1] = at;
+    }
+    return b;
+}
+
+// --- reorderings ---
+
+// reverse Cuthill-McKee of the graph of a symmetric matrix; every connected
+// component starts from the far end of a BFS from its lowest-degree node
+inline std::vector<index_t> rcm(const Csr &a) {
+    const size_t n = a.rows;
+    std::vector<index_t> by_degree(n);
+    std::iota(by_degree.begin(), by_degree.end(), 0);
+    std::stable_sort(by_degree.begin(), by_degree.end(),
+            [&](index_t x, index_t y) { return a.degree(x) < a.degree(y); });
+
+    std::vector<index_t> order;
+    order.reserve(n);
+    std::vector<char> placed(n, 0);
+    std::vector<uint32_t> probe(n, 0);
+    std::vector<index_t> queue;
+    std::vector<index_t> next;
+    uint32_t stamp = 0;
+    for (index_t seed : by_degree) {
+        if (placed[seed]) continue;
+        // probe BFS: its last node is (nearly) peripheral
+        ++stamp;
+        queue.assign(1, seed);
+        probe[seed] = stamp;
+        for (size_t q = 0; q < queue.size(); ++q)
+            for (size_t j = a.ptr[queue[q]]; j < a.ptr[queue[q] + 1]; ++j) {
+                index_t v = a.idx[j];
+                if (probe[v] != stamp && !placed[v]) {
+                    probe[v] = stamp;
+                    queue.push_back(v);
+                }
+            }
+        index_t start = queue.back();
+
+        // Cuthill-McKee from there, neighbours by increasing degree
+        size_t head = order.size();
+        order.push_back(start);
+        placed[start] = 1;
+        for (; head < order.size(); ++head) {
+            index_t u = order[head];
+            next.clear();
+            for (size_t j = a.ptr[u]; j < a.ptr[u + 1]; ++j) {
+                index_t v = a.idx[j];
+                if (!placed[v]) {
+                    placed[v] = 1;
+                    next.push_back(v);
+                }
+            }
+            std::sort(next.begin(), next.end(), [&](index_t x, index_t y) {
+                return a.degree(x) < a.degree(y);
+            });
+            order.insert(order.end(), next.begin(), next.end());
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+// rows by decreasing degree, ties in their original order
+inline std::vector<index_t> degree_order(const Csr &a) {
+    std::vector<index_t> order(a.rows);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+            [&](index_t x, index_t y) { return a.degree(x) > a.degree(y); });
+    return order;
+}
+
+// --- SELL-C-sigma ---
+
+inline Sell to_sell(const Csr &a, size_t C, size_t sigma) {
+    Sell s;
+    s.rows = a.rows;
+    s.cols = a.cols;
+    s.C = C;
+    s.sigma = std::max<size_t>(1, sigma);
+    s.nonzeros = a.nnz();
+    s.perm.resize(a.rows);
+    std::iota(s.perm.begin(), s.perm.end(), 0);
+    for (size_t w = 0; w < a.rows; w += s.sigma)
+        std::stable_sort(s.perm.begin() + w,
+                s.perm.begin() + std::min(a.rows, w + s.sigma),
+                [&](index_t x, index_t y) {
+                    return a.degree(x) > a.degree(y);
+                });
+
+    size_t chunks = (a.rows + C - 1) / C;
+    s.ptr.assign(chunks + 1, 0);
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t width = 0;
+        for (size_t k = c * C; k < std::min(a.rows, (c + 1) * C); ++k)
+            width = std::max(width, a.degree(s.perm[k]));
+        s.ptr[c + 1] = s.ptr[c] + width * C;
+    }
+    s.idx.assign(s.ptr[chunks], 0);
+    s.val.assign(s.ptr[chunks], 0.f);
+    for (size_t k = 0; k < a.rows; ++k) {
+        size_t c = k / C;
+        size_t lane = k % C;
+        size_t r = s.perm[k];
+        for (size_t j = 0; j < a.degree(r); ++j) {
+            s.idx[s.ptr[c] + j * C + lane] = a.idx[a.ptr[r] + j];
+            s.val[s.ptr[c] + j * C + lane] = a.val[a.ptr[r] + j];
+        }
+    }
+    return s;
+}
+
+// --- kernels ---
+
+// bounds[t], bounds[t + 1] of parts ranges of a prefix-sum array (CSR row
+// pointers, SELL chunk pointers) with about the same number of entries
+inline std::vector<size_t> partition(
+        const std::vector<size_t> &ptr, size_t parts) {
+    size_t n = ptr.size() - 1;
+    std::vector<size_t> bounds(parts + 1, n);
+    bounds[0] = 0;
+    for (size_t p = 1; p < parts; ++p) {
+        size_t target = static_cast<size_t>(
+                static_cast<double>(ptr[n]) * p / parts);
+        bounds[p] = std::lower_bound(ptr.begin(), ptr.end(), target)
+                - ptr.begin();
+        bounds[p] = std::max(bounds[p - 1], std::min(bounds[p], n));
+    }
+    return bounds;
+}
+
+// y[r] = A[r] x for rows [begin, end)
+inline void multiply(const Csr &a, const float *x, float *y, size_t begin,
+        size_t end) {
+    const size_t *ptr = a.ptr.data();
+    const index_t *idx = a.idx.data();
+    const float *val = a.val.data();
+    for (size_t r = begin; r < end; ++r) {
+        float sum = 0.f;
+        for (size_t j = ptr[r]; j < ptr[r + 1]; ++j)
+            sum += val[j] * x[idx[j]];
+        y[r] = sum;
+    }
+}
+
+namespace detail {
+
+template <size_t C>
+void multiply_sell(const Sell &s, const float *x, float *y, size_t begin,
+        size_t end) {
+    const size_t *ptr = s.ptr.data();
+    const index_t *idx = s.idx.data();
+    const float *val = s.val.data();
+    for (size_t c = begin; c < end; ++c) {
+        float sum[C] = {};
+        for (size_t j = ptr[c]; j < ptr[c + 1]; j += C)
+            for (size_t l = 0; l < C; ++l)
+                sum[l] += val[j + l] * x[idx[j + l]];
+        size_t rows = std::min(C, s.rows - c * C);
+        for (size_t l = 0; l < rows; ++l)
+            y[s.perm[c * C + l]] = sum[l];
+    }
+}
+
+} // namespace detail
+
+// y = A x for chunks [begin, end); C is 4, 8, 16 or 32
+inline void multiply(const Sell &s, const float *x, float *y, size_t begin,
+        size_t end) {
+    switch (s.C) {
+    case 4: detail::multiply_sell<4>(s, x, y, begin, end); break;
+    case 8: detail::multiply_sell<8>(s, x, y, begin, end); break;
+    case 16: detail::multiply_sell<16>(s, x, y, begin, end); break;
+    case 32: detail::multiply_sell<32>(s, x, y, begin, end); break;
+    default: break;
+    }
+}
+
+// whether multiply() supports chunks of c rows
+inline bool sell_width_supported(size_t c) {
+    return c == 4 || c == 8 || c == 16 || c == 32;
+}
+
+} // namespace spmv
+
+#endif // SPMV_HPP_
@@ -0,0 +1,183 @@
+// A fixed team of pinned threads for data-parallel benchmark kernels
+#ifndef THREAD_TEAM_HPP_
+#define THREAD_TEAM_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "topology.hpp"
+
+// The caller is thread 0 of the team, the other threads are created once and
+// wait for work, so a timed region only contains the kernel and one barrier.
+//
+// Take-aways
+//  ** pin threads so first-touch initialization places pages on the node of
+//     the thread that later uses them, and results do not depend on the
+//     scheduler migrating threads
+//  ** give each thread a chunk aligned to cache lines, so no line is written
+//     by two threads
+namespace thread_team {
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+// pin the calling thread to one logical CPU
+inline bool pin_to_cpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Saves the CPU affinity of the calling thread and restores it on
+// destruction, so pinning for a team does not outlive the team
+class AffinityGuard {
+public:
+    AffinityGuard() {
+#ifdef __linux__
+        CPU_ZERO(&saved_);
+        valid_ = pthread_getaffinity_np(pthread_self(), sizeof(saved_), &saved_)
+                == 0;
+#endif
+    }
+
+    ~AffinityGuard() {
+#ifdef __linux__
+        if (valid_)
+            pthread_setaffinity_np(pthread_self(), sizeof(saved_), &saved_);
+#endif
+    }
+
+    AffinityGuard(const AffinityGuard &) = delete;
+    AffinityGuard &operator=(const AffinityGuard &) = delete;
+
+private:
+#ifdef __linux__
+    cpu_set_t saved_;
+#endif
+    bool valid_ {false};
+};
+
+// logical CPUs in pinning order: one per physical core first, then the SMT
+// siblings
+inline std::vector<int> pin_order() {
+    const topology::CpuInfo &topo = topology::info();
+    std::vector<int> order = topo.one_cpu_per_core();
+    for (const auto &c : topo.cpus)
+        if (std::find(order.begin(), order.end(), c.id) == order.end())
+            order.push_back(c.id);
+    return order;
+}
+
+// [begin, end) of thread tid when n elements are split over nthreads, with
+// chunk boundaries on multiples of align elements
+inline std::pair<size_t, size_t> chunk(
+        size_t n, int tid, int nthreads, size_t align = 1) {
+    size_t blocks = (n + align - 1) / align;
+    size_t per = blocks / nthreads;
+    size_t rem = blocks % nthreads;
+    size_t b = tid * per + std::min<size_t>(tid, rem);
+    size_t e = b + per + (static_cast<size_t>(tid) < rem ? 1 : 0);
+    return {std::min(n, b * align), std::min(n, e * align)};
+}
+
+class ThreadTeam {
+public:
+    explicit ThreadTeam(int num_threads, bool pin = true)
+        : ThreadTeam(num_threads, pin ? pin_order() : std::vector<int>()) {}
+
+    // pin thread t to cpus[t % cpus.size()], e.g. the CPUs of one NUMA node;
+    // no pinning if cpus is empty. The caller is thread 0 and gets its
+    // affinity back when the team is destroyed
+    ThreadTeam(int num_threads, const std::vector<int> &cpus)
+        : num_threads_(std::max(1, num_threads)) {
+        pin_ = !cpus.empty();
+        if (pin_) {
+            for (int t = 0; t < num_threads_; ++t)
+                cpus_.push_back(cpus[t % cpus.size()]);
+            pin_to_cpu(cpus_[0]);
+        }
+        for (int t = 1; t < num_threads_; ++t)
+            workers_.emplace_back([this, t] { worker(t); });
+    }
+
+    ~ThreadTeam() {
+        stop_.store(true, std::memory_order_release);
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+        for (auto &w : workers_)
+            w.join();
+    }
+
+    ThreadTeam(const ThreadTeam &) = delete;
+    ThreadTeam &operator=(const ThreadTeam &) = delete;
+
+    int size() const { return num_threads_; }
+
+    // run fn(tid) on every thread of the team, returns when all are done
+    void run(const std::function<void(int)> &fn) {
+        task_ = &fn;
+        pending_.store(num_threads_ - 1, std::memory_order_relaxed);
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+        fn(0);
+        while (pending_.load(std::memory_order_acquire) != 0)
+            cpu_relax();
+        task_ = nullptr;
+    }
+
+private:
+    void worker(int tid) {
+        if (pin_) pin_to_cpu(cpus_[tid]);
+        unsigned seen = 0;
+        for (;;) {
+            // spin for a while, then give the core away
+            unsigned spins = 0;
+            unsigned gen;
+            while ((gen = generation_.load(std::memory_order_acquire))
+                    == seen) {
+                if (++spins < 4096)
+                    cpu_relax();
+                else
+                    std::this_thread::yield();
+            }
+            seen = gen;
+            if (stop_.load(std::memory_order_acquire)) return;
+            (*task_)(tid);
+            pending_.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    // declared first: saves the caller's mask before the constructor pins it
+    AffinityGuard affinity_;
+    int num_threads_;
+    bool pin_ {false};
+    std::vector<int> cpus_;
+    std::vector<std::thread> workers_;
+    const std::function<void(int)> *task_ {nullptr};
+    std::atomic<unsigned> generation_ {0};
+    std::atomic<int> pending_ {0};
+    std::atomic<bool> stop_ {false};
+};
+
+} // namespace thread_team
+#endif
@@ -0,0 +1,297 @@
+// Runtime detection of cache and CPU topology
+#ifndef TOPOLOGY_HPP_
+#define TOPOLOGY_HPP_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "utils.hpp"
+
+// Replaces the machine constants the examples used to hard-code (L3 size,
+// clock, 64-byte lines ...). Sources, in order of preference:
+//  * /sys/devices/system/cpu/cpu*/cache/index*/ for the cache hierarchy
+//  * cpuid leaf 4 when sysfs is not available
+//  * /sys/devices/system/cpu/cpu*/topology/ for packages, cores and SMT
+//  * cpuid leaf 0x15 for the TSC frequency, else calibration (utils.hpp)
+//
+// Take-aways
+//  ** the cache sizes in sysfs are per instance, an L3 is usually shared by
+//     all cores of a package, L1/L2 by the SMT siblings of one core
+//  ** a flush buffer must be larger than the LLC instance it should evict
+namespace topology {
+
+struct CacheLevel {
+    // 1, 2, 3 ...
+    int level {0};
+    // Data, Instruction or Unified
+    std::string type;
+    // bytes per instance
+    size_t size {0};
+    size_t line_size {64};
+    int ways {0};
+    // number of logical CPUs sharing one instance
+    int shared_cpus {1};
+};
+
+struct Cpu {
+    int id {0};
+    int package {0};
+    int core {0};
+};
+
+struct CpuInfo {
+    // data and unified caches, ordered by level
+    std::vector<CacheLevel> caches;
+    // online logical CPUs
+    std::vector<Cpu> cpus;
+    size_t line_size {64};
+    int packages {1};
+    int physical_cores {1};
+    // hardware threads per core
+    int smt {1};
+    // TSC ticks per nanosecond
+    double tsc_ghz {1.0};
+    // true if the TSC frequency was read from cpuid rather than calibrated
+    bool tsc_from_cpuid {false};
+
+    // cache of a given level, nullptr if there is none
+    const CacheLevel *level(int l) const {
+        for (const auto &c : caches)
+            if (c.level == l) return &c;
+        return nullptr;
+    }
+
+    size_t cache_size(int l) const {
+        const CacheLevel *c = level(l);
+        return c ? c->size : 0;
+    }
+
+    // last level cache, size of one instance
+    size_t llc_size() const { return caches.empty() ? 0 : caches.back().size; }
+
+    // buffer size that evicts the LLC when swept
+    size_t flush_size() const {
+        return std::max<size_t>(2 * llc_size(), 16 * 1024 * 1024);
+    }
+
+    // name of the smallest cache a working set fits in, "RAM" otherwise
+    std::string label(size_t bytes) const {
+        for (const auto &c : caches)
+            if (bytes <= c.size) return "L" + std::to_string(c.level);
+        return "RAM";
+    }
+
+    // Working-set sweep from min_bytes to max_factor * LLC: powers of two
+    // plus every cache size and 1.5x of it, so each boundary has points on
+    // both sides
+    std::vector<size_t> working_sets(
+            size_t min_bytes = 1024, size_t max_factor = 4) const {
+        std::set<size_t> sizes;
+        size_t max_bytes = std::max<size_t>(max_factor * llc_size(), min_bytes);
+        for (size_t s = min_bytes; s <= max_bytes; s *= 2)
+            sizes.insert(s);
+        for (const auto &c : caches) {
+            if (c.size >= min_bytes) sizes.insert(c.size);
+            if (c.size * 3 / 2 <= max_bytes) sizes.insert(c.size * 3 / 2);
+        }
+        return std::vector<size_t>(sizes.begin(), sizes.end());
+    }
+
+    // first logical CPU of every physical core, packages interleaved last,
+    // for pinning one thread per core
+    std::vector<int> one_cpu_per_core() const {
+        std::set<std::pair<int, int>> seen;
+        std::vector<int> ids;
+        for (const auto &c : cpus)
+            if (seen.insert({c.package, c.core}).second) ids.push_back(c.id);
+        return ids;
+    }
+
+    void print(FILE *out = stdout) const {
+        fprintf(out, "packages: %d, cores: %d, logical CPUs: %zu, SMT: %d\n",
+                packages, physical_cores, cpus.size(), smt);
+        for (const auto &c : caches)
+            fprintf(out,
+                    "L%d %s: %zu KiB, line %zu B, %d-way, shared by %d "
+                    "CPUs\n",
+                    c.level, c.type.c_str(), c.size / 1024, c.line_size,
+                    c.ways, c.shared_cpus);
+        fprintf(out, "TSC: %.3f GHz (%s)\n", tsc_ghz,
+                tsc_from_cpuid ? "cpuid" : "calibrated");
+    }
+};
+
+namespace detail {
+
+inline bool read_line(const std::string &path, std::string &out) {
+    std::ifstream f(path);
+    if (!f) return false;
+    std::getline(f, out);
+    return true;
+}
+
+inline long read_long(const std::string &path, long def) {
+    std::string s;
+    if (!read_line(path, s) || s.empty()) return def;
+    return std::strtol(s.c_str(), nullptr, 10);
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+inline std::vector<int> parse_cpu_list(const std::string &list) {
+    std::vector<int> ids;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        size_t dash = item.find('-');
+        int lo = std::atoi(item.c_str());
+        int hi = dash == std::string::npos ? lo
+                                            : std::atoi(item.c_str() + dash + 1);
+        for (int i = lo; i <= hi; ++i)
+            ids.push_back(i);
+    }
+    return ids;
+}
+
+// "48K", "2048K", "300M" -> bytes
+inline size_t parse_cache_size(const std::string &s) {
+    char *end = nullptr;
+    size_t v = std::strtoul(s.c_str(), &end, 10);
+    if (end && (*end == 'K' || *end == 'k')) v *= 1024;
+    if (end && (*end == 'M' || *end == 'm')) v *= 1024 * 1024;
+    return v;
+}
+
+inline std::vector<CacheLevel> caches_from_sysfs(int cpu) {
+    std::vector<CacheLevel> caches;
+    std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu)
+            + "/cache/index";
+    for (int i = 0;; ++i) {
+        std::string dir = base + std::to_string(i) + "/";
+        CacheLevel c;
+        std::string size, shared;
+        if (!read_line(dir + "type", c.type)) break;
+        if (c.type == "Instruction") continue;
+        c.level = static_cast<int>(read_long(dir + "level", 0));
+        if (read_line(dir + "size", size)) c.size = parse_cache_size(size);
+        c.line_size = read_long(dir + "coherency_line_size", 64);
+        c.ways = static_cast<int>(read_long(dir + "ways_of_associativity", 0));
+        if (read_line(dir + "shared_cpu_list", shared))
+            c.shared_cpus = std::max<int>(1, parse_cpu_list(shared).size());
+        if (c.level > 0 && c.size > 0) caches.push_back(c);
+    }
+    return caches;
+}
+
+inline std::vector<CacheLevel> caches_from_cpuid() {
+    std::vector<CacheLevel> caches;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    for (unsigned int i = 0;; ++i) {
+        if (!__get_cpuid_count(4, i, &eax, &ebx, &ecx, &edx)) break;
+        unsigned int type = eax & 0x1f;
+        // 0: no more caches, 2: instruction cache
+        if (type == 0) break;
+        if (type == 2) continue;
+        CacheLevel c;
+        c.level = (eax >> 5) & 0x7;
+        c.type = type == 1 ? "Data" : "Unified";
+        c.line_size = (ebx & 0xfff) + 1;
+        c.ways = ((ebx >> 22) & 0x3ff) + 1;
+        size_t partitions = ((ebx >> 12) & 0x3ff) + 1;
+        size_t sets = static_cast<size_t>(ecx) + 1;
+        c.size = c.ways * partitions * c.line_size * sets;
+        c.shared_cpus = ((eax >> 14) & 0xfff) + 1;
+        caches.push_back(c);
+    }
+#endif
+    return caches;
+}
+
+// TSC frequency from cpuid leaf 0x15 (and 0x16 for the crystal), 0 if unknown
+inline double tsc_ghz_from_cpuid() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, nullptr) < 0x15) return 0.;
+    __cpuid(0x15, eax, ebx, ecx, edx);
+    if (eax == 0 || ebx == 0) return 0.;
+    double crystal_hz = ecx;
+    if (crystal_hz == 0. && __get_cpuid_max(0, nullptr) >= 0x16) {
+        unsigned int base_mhz, b, c, d;
+        __cpuid(0x16, base_mhz, b, c, d);
+        // base frequency = crystal * ebx / eax
+        if (base_mhz) return base_mhz * 1e-3;
+    }
+    return crystal_hz * ebx / eax * 1e-9;
+#else
+    return 0.;
+#endif
+}
+
+inline CpuInfo detect() {
+    CpuInfo info;
+    std::string online;
+    std::vector<int> ids;
+    if (read_line("/sys/devices/system/cpu/online", online))
+        ids = parse_cpu_list(online);
+    if (ids.empty()) ids.push_back(0);
+
+    std::set<int> packages;
+    std::set<std::pair<int, int>> cores;
+    for (int id : ids) {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id)
+                + "/topology/";
+        Cpu cpu;
+        cpu.id = id;
+        cpu.package = static_cast<int>(
+                read_long(dir + "physical_package_id", 0));
+        cpu.core = static_cast<int>(read_long(dir + "core_id", id));
+        packages.insert(cpu.package);
+        cores.insert({cpu.package, cpu.core});
+        info.cpus.push_back(cpu);
+    }
+    info.packages = static_cast<int>(packages.size());
+    info.physical_cores = static_cast<int>(cores.size());
+    info.smt = std::max<int>(1, info.cpus.size() / cores.size());
+
+    info.caches = caches_from_sysfs(ids.front());
+    if (info.caches.empty()) info.caches = caches_from_cpuid();
+    if (info.caches.empty()) {
+        // nothing to detect from, assume a typical desktop part
+        info.caches.push_back({1, "Data", 32 * 1024, 64, 8, 2});
+        info.caches.push_back({2, "Unified", 256 * 1024, 64, 4, 2});
+        info.caches.push_back({3, "Unified", 8 * 1024 * 1024, 64, 16, 8});
+    }
+    std::sort(info.caches.begin(), info.caches.end(),
+            [](const CacheLevel &a, const CacheLevel &b) {
+                return a.level < b.level;
+            });
+    info.line_size = info.caches.front().line_size;
+
+    info.tsc_ghz = tsc_ghz_from_cpuid();
+    info.tsc_from_cpuid = info.tsc_ghz > 0.;
+    if (!info.tsc_from_cpuid) info.tsc_ghz = ::tsc_ghz();
+    return info;
+}
+
+} // namespace detail
+
+// topology of the running machine, detected once
+inline const CpuInfo &info() {
+    static const CpuInfo inst = detail::detect();
+    return inst;
+}
+
+} // namespace topology
+#endif
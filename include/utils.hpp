@@ -3,13 +3,65 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
-#include <sys/time.h>
+#include <cstdint>
+#include <time.h>
 
-// timer function
-double ms_now() {
-  struct timeval time;
-  gettimeofday(&time, nullptr);
-  return (1e+3 * time.tv_sec + 1e-3 * time.tv_usec);
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC (1)
+#endif
+
+// timer function, monotonic and not slewed by NTP
+inline uint64_t ns_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull
+            + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+inline double ms_now() {
+    return 1e-6 * static_cast<double>(ns_now());
+}
+
+// time stamp counter, for regions too short for clock_gettime
+// * tsc_begin() waits for preceding instructions before reading the counter
+// * tsc_end() waits for the timed region to finish (rdtscp) and keeps later
+//   instructions from starting early
+#ifdef HAS_RDTSC
+inline uint64_t tsc_begin() {
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+
+inline uint64_t tsc_end() {
+    unsigned int aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+}
+#else
+inline uint64_t tsc_begin() { return ns_now(); }
+inline uint64_t tsc_end() { return ns_now(); }
+#endif
+
+// TSC ticks per nanosecond, calibrated once against CLOCK_MONOTONIC_RAW
+inline double tsc_ghz() {
+    static const double ghz = [] {
+#ifdef HAS_RDTSC
+        uint64_t t0 = ns_now();
+        uint64_t c0 = tsc_begin();
+        // busy wait ~20 ms
+        while (ns_now() - t0 < 20000000ull) {}
+        uint64_t c1 = tsc_end();
+        uint64_t t1 = ns_now();
+        return static_cast<double>(c1 - c0) / static_cast<double>(t1 - t0);
+#else
+        return 1.0;
+#endif
+    }();
+    return ghz;
 }
 
 #endif
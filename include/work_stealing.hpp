@@ -0,0 +1,441 @@
+// Work-stealing task scheduler: Chase-Lev deques and parallel_for
+#ifndef WORK_STEALING_HPP_
+#define WORK_STEALING_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "sharded_counter.hpp"
+#include "thread_team.hpp"
+
+// Every worker owns a Chase-Lev deque. It pushes and pops the tasks it spawns
+// at the bottom, in LIFO order, so it keeps working on the data it just
+// touched; an idle worker steals from the top of a random victim, which takes
+// the oldest, and for a recursively split range the largest, piece of work.
+//
+// The caller is worker 0, as in ThreadTeam: it spawns into its own deque and
+// executes and steals tasks while it waits. The other workers are created
+// once and pinned; between calls they spin, then yield, and once no call is
+// in flight they sleep on a condition variable.
+//
+// parallel_for(begin, end, grain, f) splits the range in halves, spawning
+// the upper half, until a piece has at most grain elements, then calls
+// f(b, e) on it. Tasks only split when a piece is executed, so a worker that
+// steals a large half splits it further for the others.
+//
+// Take-aways
+//  ** static chunks are the cheapest schedule for uniform work, but the
+//     slowest chunk sets the time when the cost per element varies
+//  ** the owner touches only the bottom of its deque; a thief pays a CAS on
+//     the top, and only the last element is contended
+//  ** the grain trades spawn overhead against balance: pieces must be
+//     large against the cost of a task (tens of ns) and small against the
+//     run time divided by the threads
+namespace work_stealing {
+
+// spins, then yields, of an idle worker before it checks for sleep
+#define WS_SPIN_COUNT (4096)
+#define WS_YIELD_COUNT (256)
+// initial slots of a deque, doubled when full
+#define WS_DEQUE_SIZE (256)
+
+class TaskGroup;
+
+struct Task {
+    TaskGroup *group {nullptr};
+    virtual ~Task() = default;
+    virtual void execute() = 0;
+};
+
+template <typename F>
+struct FnTask : Task {
+    F fn;
+    explicit FnTask(F f) : fn(std::move(f)) {}
+    void execute() override { fn(); }
+};
+
+// Chase-Lev deque of T (a pointer type), after Le, Pop, Cohen and Zappa
+// Nardelli, "Correct and efficient work-stealing for weak memory models":
+// push and pop by the owner, steal by any thread. Arrays outgrown by the
+// owner stay allocated until the deque is destroyed, since a thief may
+// still read from them.
+template <typename T>
+class Deque {
+public:
+    explicit Deque(size_t capacity = WS_DEQUE_SIZE) {
+        size_t cap = 1;
+        while (cap < capacity)
+            cap <<= 1;
+        arrays_.emplace_back(new Array(cap));
+        array_.store(arrays_.back().get(), std::memory_order_relaxed);
+    }
+
+    Deque(const Deque &) = delete;
+    Deque &operator=(const Deque &) = delete;
+
+    // owner only
+    void push(T x) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array *a = array_.load(std::memory_order_relaxed);
+        if (b - t > static_cast<int64_t>(a->mask)) a = grow(a, t, b);
+        a->put(b, x);
+        // a release store rather than the paper's fence, same code on x86
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    // owner only, newest first; nullptr if empty
+    T pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array *a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T x = a->get(b);
+        if (t == b) {
+            // the last element, race the thieves for it
+            if (!top_.compare_exchange_strong(t, t + 1,
+                        std::memory_order_seq_cst, std::memory_order_relaxed))
+                x = nullptr;
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    // any thread, oldest first; nullptr if empty or lost to another thread
+    T steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        Array *a = array_.load(std::memory_order_acquire);
+        T x = a->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                    std::memory_order_relaxed))
+            return nullptr;
+        return x;
+    }
+
+    // a snapshot, exact only while no other thread works on the deque
+    size_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    size_t capacity() const {
+        return array_.load(std::memory_order_relaxed)->mask + 1;
+    }
+
+private:
+    struct Array {
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit Array(size_t cap) : mask(cap - 1), slots(new std::atomic<T>[cap]) {}
+        T get(int64_t i) const {
+            return slots[static_cast<size_t>(i) & mask].load(
+                    std::memory_order_relaxed);
+        }
+        void put(int64_t i, T x) {
+            slots[static_cast<size_t>(i) & mask].store(
+                    x, std::memory_order_relaxed);
+        }
+    };
+
+    Array *grow(Array *a, int64_t t, int64_t b) {
+        arrays_.emplace_back(new Array(2 * (a->mask + 1)));
+        Array *bigger = arrays_.back().get();
+        for (int64_t i = t; i < b; ++i)
+            bigger->put(i, a->get(i));
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(FALSE_SHARING_SIZE) std::atomic<int64_t> top_ {0};
+    alignas(FALSE_SHARING_SIZE) std::atomic<int64_t> bottom_ {0};
+    std::atomic<Array *> array_ {nullptr};
+    std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+class Scheduler {
+public:
+    explicit Scheduler(int num_threads, bool pin = true)
+        : Scheduler(num_threads,
+                  pin ? thread_team::pin_order() : std::vector<int>()) {}
+
+    // pin worker w to cpus[w % cpus.size()]; no pinning if cpus is empty.
+    // The caller is worker 0 and gets its affinity back when the scheduler
+    // is destroyed
+    Scheduler(int num_threads, const std::vector<int> &cpus)
+        : num_threads_(std::max(1, num_threads)) {
+        // std::vector does not honour over-alignment before C++17
+        void *p = nullptr;
+        if (posix_memalign(&p, alignof(Worker), num_threads_ * sizeof(Worker)))
+            throw std::bad_alloc();
+        workers_ = static_cast<Worker *>(p);
+        for (int w = 0; w < num_threads_; ++w) {
+            new (workers_ + w) Worker();
+            workers_[w].rng = 0x9e3779b97f4a7c15ull * (w + 1);
+            if (!cpus.empty()) workers_[w].cpu = cpus[w % cpus.size()];
+        }
+        if (workers_[0].cpu >= 0) thread_team::pin_to_cpu(workers_[0].cpu);
+        current() = {this, 0};
+        for (int w = 1; w < num_threads_; ++w)
+            threads_.emplace_back([this, w] { worker(w); });
+    }
+
+    ~Scheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_.store(true, std::memory_order_seq_cst);
+        }
+        wake_.notify_all();
+        for (auto &t : threads_)
+            t.join();
+        if (current().scheduler == this) current() = {nullptr, -1};
+        for (int w = 0; w < num_threads_; ++w)
+            workers_[w].~Worker();
+        free(workers_);
+    }
+
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    int size() const { return num_threads_; }
+
+    // f(b, e) on pieces of at most grain elements covering [begin, end);
+    // from the thread that created the scheduler or from inside a task
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, size_t grain, const F &f);
+
+    // tasks executed and stolen since the last reset, per worker; exact only
+    // between calls
+    uint64_t executed(int w) const {
+        return workers_[w].executed.load(std::memory_order_relaxed);
+    }
+    uint64_t steals(int w) const {
+        return workers_[w].steals.load(std::memory_order_relaxed);
+    }
+    void reset_stats() {
+        for (int w = 0; w < num_threads_; ++w) {
+            workers_[w].executed.store(0, std::memory_order_relaxed);
+            workers_[w].steals.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // index of the calling worker of this scheduler, -1 for other threads
+    int worker_index() const {
+        return current().scheduler == this ? current().index : -1;
+    }
+
+private:
+    friend class TaskGroup;
+
+    struct alignas(FALSE_SHARING_SIZE) Worker {
+        Deque<Task *> deque;
+        uint64_t rng {0};
+        int cpu {-1};
+        // written by the owner only
+        std::atomic<uint64_t> executed {0};
+        std::atomic<uint64_t> steals {0};
+    };
+
+    struct Current {
+        Scheduler *scheduler;
+        int index;
+    };
+
+    static Current &current() {
+        thread_local Current c {nullptr, -1};
+        return c;
+    }
+
+    static void bump(std::atomic<uint64_t> &c) {
+        c.store(c.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    }
+
+    void push(int w, Task *t) { workers_[w].deque.push(t); }
+
+    // own deque first, then one round over the others from a random victim
+    Task *find(int w) {
+        Worker &me = workers_[w];
+        if (Task *t = me.deque.pop()) return t;
+        if (num_threads_ == 1) return nullptr;
+        me.rng ^= me.rng << 13;
+        me.rng ^= me.rng >> 7;
+        me.rng ^= me.rng << 17;
+        int first = static_cast<int>(me.rng % num_threads_);
+        for (int i = 0; i < num_threads_; ++i) {
+            int v = (first + i) % num_threads_;
+            if (v == w) continue;
+            if (Task *t = workers_[v].deque.steal()) {
+                bump(me.steals);
+                return t;
+            }
+        }
+        return nullptr;
+    }
+
+    inline void execute(int w, Task *t);
+
+    // a call from outside any task starts: wake the sleeping workers
+    void enter() {
+        if (busy_.fetch_add(1, std::memory_order_seq_cst) == 0
+                && sleeping_.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_.notify_all();
+        }
+    }
+
+    void leave() { busy_.fetch_sub(1, std::memory_order_seq_cst); }
+
+    void worker(int w) {
+        Worker &me = workers_[w];
+        if (me.cpu >= 0) thread_team::pin_to_cpu(me.cpu);
+        current() = {this, w};
+        unsigned idle = 0;
+        while (!stop_.load(std::memory_order_acquire)) {
+            if (Task *t = find(w)) {
+                execute(w, t);
+                idle = 0;
+            } else if (++idle < WS_SPIN_COUNT) {
+                thread_team::cpu_relax();
+            } else if (idle < WS_SPIN_COUNT + WS_YIELD_COUNT
+                    || busy_.load(std::memory_order_seq_cst) > 0) {
+                std::this_thread::yield();
+            } else {
+                std::unique_lock<std::mutex> lock(mutex_);
+                sleeping_.fetch_add(1, std::memory_order_seq_cst);
+                wake_.wait(lock, [this] {
+                    return busy_.load(std::memory_order_seq_cst) > 0
+                            || stop_.load(std::memory_order_seq_cst);
+                });
+                sleeping_.fetch_sub(1, std::memory_order_seq_cst);
+                idle = 0;
+            }
+        }
+    }
+
+    // declared first: saves the caller's mask before the constructor pins it
+    thread_team::AffinityGuard affinity_;
+    int num_threads_;
+    Worker *workers_ {nullptr};
+    std::vector<std::thread> threads_;
+    // calls in flight from outside the tasks, and workers asleep
+    std::atomic<int> busy_ {0};
+    std::atomic<int> sleeping_ {0};
+    std::atomic<bool> stop_ {false};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+};
+
+// Tasks spawned together and waited for together. spawn() pushes onto the
+// deque of the calling worker; from a thread that is not a worker of the
+// scheduler the task runs at once. wait() executes and steals tasks until
+// all tasks of the group are done, and the destructor waits.
+class TaskGroup {
+public:
+    explicit TaskGroup(Scheduler &s) : s_(s), worker_(s.worker_index()) {
+        // groups of the caller keep the workers awake; nested ones only add
+        // to the count
+        outer_ = worker_ == 0;
+        if (outer_) s_.enter();
+    }
+
+    ~TaskGroup() {
+        wait();
+        if (outer_) s_.leave();
+    }
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    // onto the deque of the calling thread, which need not be the creator
+    template <typename F>
+    void spawn(F &&f) {
+        int w = s_.worker_index();
+        if (w < 0) {
+            f();
+            return;
+        }
+        Task *t = new FnTask<typename std::decay<F>::type>(std::forward<F>(f));
+        t->group = this;
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        s_.push(w, t);
+    }
+
+    void wait() {
+        unsigned idle = 0;
+        while (pending_.load(std::memory_order_acquire) != 0) {
+            if (Task *t = s_.find(worker_)) {
+                s_.execute(worker_, t);
+                idle = 0;
+            } else if (++idle < WS_SPIN_COUNT) {
+                thread_team::cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    friend class Scheduler;
+
+    void done() { pending_.fetch_sub(1, std::memory_order_acq_rel); }
+
+    Scheduler &s_;
+    int worker_;
+    bool outer_ {false};
+    std::atomic<long> pending_ {0};
+};
+
+inline void Scheduler::execute(int w, Task *t) {
+    TaskGroup *g = t->group;
+    t->execute();
+    delete t;
+    bump(workers_[w].executed);
+    g->done();
+}
+
+namespace detail {
+
+// run [b, e): spawn the upper half until at most grain elements are left
+template <typename F>
+void split(TaskGroup &g, size_t b, size_t e, size_t grain, const F &f) {
+    while (e - b > grain) {
+        size_t mid = b + (e - b) / 2;
+        g.spawn([&g, mid, e, grain, &f] { split(g, mid, e, grain, f); });
+        e = mid;
+    }
+    f(b, e);
+}
+
+} // namespace detail
+
+template <typename F>
+void Scheduler::parallel_for(
+        size_t begin, size_t end, size_t grain, const F &f) {
+    if (begin >= end) return;
+    TaskGroup g(*this);
+    detail::split(g, begin, end, std::max<size_t>(grain, 1), f);
+    g.wait();
+}
+
+} // namespace work_stealing
+#endif
@@ -1,64 +1,61 @@
 #include <iostream>
 #include <vector>
 
-#include "utils.hpp"
-
-/* Code to clear cache */
-/* This computer has 12288K L3 cache, which is 3072K ints */
-#define ASIZE ((1 << 21) + (1 << 20))
-static int stuff[ASIZE];
-static int sink;
-
-static void clear_cache() {
-    int x = sink;
-    for (int i = 0; i < ASIZE; i += 16 /*cache line size: 64bytes*/)
-        x += stuff[i];
-    sink = x;
-}
-
-#define NUM_ITERS (200)
-#define NUM_ELEM (32 * 1024 * 1024)
-#define STEP (16)
+#include "bench.hpp"
+#include "cache_state.hpp"
+#include "topology.hpp"
 
 using DTYPE = float;
 
-void run_v1(std::vector<DTYPE> &src) {
-    double total_time = 0.;
-    // iterations
-    for (size_t i = 0; i < static_cast<size_t>(NUM_ITERS); ++i) {
-        clear_cache();
-        double start = ms_now();
-        for (size_t n = 0; n < static_cast<size_t>(NUM_ELEM); ++n) {
+void run_v1(bench::Runner &runner, std::vector<DTYPE> &src,
+        cache_state::State state) {
+    size_t num_elem = src.size();
+    cache_state::Buffers buffers(state);
+    buffers.add(src);
+    bench::Case c("v1");
+    c.param("elems", num_elem).param("cache", buffers.name()).set_ops(num_elem);
+    runner.run(c, [&] { buffers.prepare(); }, [&] {
+        for (size_t n = 0; n < num_elem; ++n) {
             src[n] += 1.1f;
         }
-        total_time += (ms_now() - start);
-    }
-    std::cout << "Time per iteration of v1: " <<
-        (total_time / NUM_ITERS) << " msec\n";
+    });
 }
 
-// the only difference is in v2 there will be a write operation every STEP elements
-void run_v2(std::vector<DTYPE> &src) {
-    double total_time = 0.;
-    // iterations
-    for (size_t i = 0; i < static_cast<size_t>(NUM_ITERS); ++i) {
-        clear_cache();
-        double start = ms_now();
-        for (size_t n = 0; n < static_cast<size_t>(NUM_ELEM); n += STEP) {
+// the only difference is in v2 there will be a write operation every step
+// elements
+void run_v2(bench::Runner &runner, std::vector<DTYPE> &src, size_t step,
+        cache_state::State state) {
+    size_t num_elem = src.size();
+    cache_state::Buffers buffers(state);
+    buffers.add(src);
+    bench::Case c("v2");
+    c.param("elems", num_elem)
+            .param("step", step)
+            .param("cache", buffers.name())
+            .set_ops(num_elem / step);
+    runner.run(c, [&] { buffers.prepare(); }, [&] {
+        for (size_t n = 0; n < num_elem; n += step) {
             src[n] += 1.1f;
         }
-        total_time += (ms_now() - start);
-    }
-    std::cout << "Time per iteration of v2: " <<
-        (total_time / NUM_ITERS) << " msec\n";
+    });
 }
 
-int main() {
-    std::vector<DTYPE> src_1(NUM_ELEM, 1);
-    std::vector<DTYPE> src_2(NUM_ELEM, 2);
+int main(int argc, char **argv) {
+    bench::Runner runner("memory_access", argc, argv, /*reps=*/20);
+    auto &opts = runner.options();
+    size_t num_elem = opts.get_int("elems", 32 * 1024 * 1024,
+            "number of floats to update");
+    // one write per cache line by default
+    size_t step = opts.get_int("step",
+            topology::info().line_size / sizeof(DTYPE), "element step of v2");
+    cache_state::State state = cache_state::option(opts);
+    if (opts.help()) return 0;
+
+    std::vector<DTYPE> src_1(num_elem, 1);
+    std::vector<DTYPE> src_2(num_elem, 2);
+
+    run_v1(runner, src_1, state);
+    run_v2(runner, src_2, step, state);
 
-    run_v1(src_1);
-    run_v2(src_2);
-    
     return 0;
-}
\ No newline at end of file
+}
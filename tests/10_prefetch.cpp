@@ -0,0 +1,225 @@
+// This is to find the software prefetch distance that pays off for a given
+// access pattern and working set, instead of guessing it.
+//
+// Patterns, one iteration each:
+//  * sequential: sum one cache line, then move to the next line
+//  * stride: load one line, then jump --stride-bytes ahead (wrapping), which
+//    crosses a page every time so the hardware prefetcher cannot follow
+//  * gather: a[idx[i]] with a random index array, the pattern of indirect
+//    hot loops that no hardware prefetcher predicts
+// Each pattern is timed without prefetching (distance 0) and with
+// __builtin_prefetch issued `distance` iterations ahead, for every locality
+// hint (nta, t2, t1, t0). In text mode a table gives the best distance and
+// hint per pattern and working set.
+//
+// The walk continues where the previous repetition stopped, so working sets
+// larger than the LLC stay cold from one repetition to the next.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "topology.hpp"
+
+using DTYPE = int;
+
+static const char *hint_names[] = {"nta", "t2", "t1", "t0"};
+
+template <int Hint>
+inline void prefetch(const void *p) {
+    __builtin_prefetch(p, 0, Hint);
+}
+
+class PrefetchBench {
+private:
+    std::vector<DTYPE> data_;
+    // random element index per line, for gather
+    std::vector<uint32_t> idx_;
+    // number of lines, a power of two
+    size_t lines_;
+    size_t mask_;
+    size_t line_elems_;
+    // stride in lines, odd so the walk visits every line
+    size_t stride_lines_;
+    // iteration where the next repetition starts
+    size_t cursor_ {0};
+
+public:
+    PrefetchBench(size_t bytes, size_t line_size, size_t stride_bytes)
+        : line_elems_(line_size / sizeof(DTYPE)) {
+        lines_ = 1;
+        while (lines_ * 2 * line_size <= bytes)
+            lines_ *= 2;
+        mask_ = lines_ - 1;
+        stride_lines_ = std::max<size_t>(1, stride_bytes / line_size) | 1;
+        data_.assign(lines_ * line_elems_, 1);
+        idx_.resize(lines_);
+        for (size_t i = 0; i < lines_; ++i)
+            idx_[i] = static_cast<uint32_t>(i * line_elems_);
+        std::shuffle(idx_.begin(), idx_.end(), std::mt19937_64(42));
+    }
+
+    size_t bytes() const { return data_.size() * sizeof(DTYPE); }
+
+    template <int Hint>
+    DTYPE sequential(size_t count, size_t dist) {
+        const DTYPE *a = data_.data();
+        size_t line = cursor_ & mask_;
+        DTYPE sum = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (dist) prefetch<Hint>(a + ((line + dist) & mask_) * line_elems_);
+            const DTYPE *p = a + line * line_elems_;
+            for (size_t e = 0; e < line_elems_; ++e)
+                sum += p[e];
+            line = (line + 1) & mask_;
+        }
+        cursor_ += count;
+        return sum;
+    }
+
+    template <int Hint>
+    DTYPE stride(size_t count, size_t dist) {
+        const DTYPE *a = data_.data();
+        const size_t s = stride_lines_;
+        size_t k = cursor_;
+        DTYPE sum = 0;
+        for (size_t i = 0; i < count; ++i, ++k) {
+            if (dist)
+                prefetch<Hint>(a + (((k + dist) * s) & mask_) * line_elems_);
+            sum += a[((k * s) & mask_) * line_elems_];
+        }
+        cursor_ = k;
+        return sum;
+    }
+
+    template <int Hint>
+    DTYPE gather(size_t count, size_t dist) {
+        const DTYPE *a = data_.data();
+        const uint32_t *idx = idx_.data();
+        size_t k = cursor_;
+        DTYPE sum = 0;
+        for (size_t i = 0; i < count; ++i, ++k) {
+            if (dist) prefetch<Hint>(a + idx[(k + dist) & mask_]);
+            sum += a[idx[k & mask_]];
+        }
+        cursor_ = k;
+        return sum;
+    }
+
+    template <int Hint>
+    DTYPE walk(const std::string &pattern, size_t count, size_t dist) {
+        if (pattern == "sequential") return sequential<Hint>(count, dist);
+        if (pattern == "stride") return stride<Hint>(count, dist);
+        return gather<Hint>(count, dist);
+    }
+
+    DTYPE walk(const std::string &pattern, int hint, size_t count,
+            size_t dist) {
+        switch (hint) {
+            case 0: return walk<0>(pattern, count, dist);
+            case 1: return walk<1>(pattern, count, dist);
+            case 2: return walk<2>(pattern, count, dist);
+            default: return walk<3>(pattern, count, dist);
+        }
+    }
+};
+
+struct Best {
+    double none {0.};
+    double ns {0.};
+    long distance {0};
+    int hint {0};
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("prefetch", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+
+    // one working set in L2, one in the LLC and one in memory
+    size_t phys = static_cast<size_t>(sysconf(_SC_PHYS_PAGES))
+            * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    std::vector<long> sizes;
+    if (topo.cache_size(2)) sizes.push_back(topo.cache_size(2) / 2 / 1024);
+    sizes.push_back(topo.llc_size() / 2 / 1024);
+    sizes.push_back(std::min(4 * topo.llc_size(), phys / 16) / 1024);
+    sizes = opts.get_list("sizes-kb", sizes, "working set sizes in KiB");
+    std::string patterns_str = opts.get_string("patterns",
+            "sequential,stride,gather", "access patterns to run");
+    std::vector<long> distances
+            = opts.get_list("distances", {0, 1, 2, 4, 8, 16, 32, 64, 128},
+                    "prefetch distances in iterations, 0 for none");
+    std::vector<long> hints = opts.get_list(
+            "hints", {0, 1, 2, 3}, "locality hints, 0 (nta) to 3 (t0)");
+    size_t stride_bytes = opts.get_int("stride-bytes", 4096 + topo.line_size,
+            "jump of the stride pattern");
+    size_t count = opts.get_int(
+            "accesses", 256 * 1024, "iterations per repetition");
+    if (opts.help()) return 0;
+
+    std::vector<std::string> patterns;
+    std::stringstream ss(patterns_str);
+    std::string p;
+    while (std::getline(ss, p, ','))
+        patterns.push_back(p);
+
+    // best (distance, hint) per pattern and working set
+    std::map<std::pair<std::string, long>, Best> summary;
+    for (long kb : sizes) {
+        PrefetchBench pb(kb * 1024, topo.line_size, stride_bytes);
+        long ws_kb = static_cast<long>(pb.bytes() / 1024);
+        for (const auto &pattern : patterns) {
+            if (pattern != "sequential" && pattern != "stride"
+                    && pattern != "gather") {
+                fprintf(stderr, "unknown pattern %s\n", pattern.c_str());
+                continue;
+            }
+            Best &best = summary[{pattern, ws_kb}];
+            for (long d : distances) {
+                for (long h : hints) {
+                    // without prefetching the hint does not matter
+                    if (d == 0 && h != hints.front()) continue;
+                    int hint = static_cast<int>(std::min(3l, std::max(0l, h)));
+                    bench::Case c(pattern);
+                    c.param("ws_kb", ws_kb)
+                            .param("level", topo.label(pb.bytes()))
+                            .param("distance", d)
+                            .param("hint", d ? hint_names[hint] : "-")
+                            .set_ops(count);
+                    double ns = runner.run(c, [&] {
+                                          bench::do_not_optimize(
+                                                  pb.walk(pattern, hint, count,
+                                                          d));
+                                      }).metric("ns/op");
+                    if (d == 0) best.none = ns;
+                    if (best.ns == 0. || ns < best.ns) {
+                        best.ns = ns;
+                        best.distance = d;
+                        best.hint = hint;
+                    }
+                }
+            }
+        }
+    }
+
+    if (runner.format() == "text" && !summary.empty()) {
+        printf("\n%12s%12s%8s%12s%10s%6s%12s%9s\n", "pattern", "ws_kb",
+                "level", "none ns", "distance", "hint", "best ns", "speedup");
+        for (const auto &row : summary) {
+            const Best &b = row.second;
+            printf("%12s%12ld%8s%12.2f%10ld%6s%12.2f%9.2f\n",
+                    row.first.first.c_str(), row.first.second,
+                    topo.label(row.first.second * 1024).c_str(), b.none,
+                    b.distance, b.distance ? hint_names[b.hint] : "-", b.ns,
+                    b.ns > 0. ? b.none / b.ns : 0.);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// This is to show false sharing: every thread increments its own counter,
+// no data is shared, yet the counters slow each other down when they are
+// close in memory.
+//
+// Layouts of the per-thread counters:
+//  * packed: adjacent 8-byte atomics, all on one cache line
+//  * line: one counter per 64-byte line, 64-byte pairs share a 128-byte
+//    block, so the adjacent-line prefetcher can still couple them
+//  * pair: one counter per 128 bytes (concurrent::padded), no coupling
+//  * sharded: concurrent::ShardedCounter, one shared counter object
+//  * local: a plain local sum, added to a shared atomic once at the end
+// ns/op is per increment over all threads, so it stays flat while there is
+// no interference.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "sharded_counter.hpp"
+#include "thread_team.hpp"
+#include "topology.hpp"
+
+class FalseSharing {
+private:
+    thread_team::ThreadTeam team_;
+    size_t iters_;
+    char *buffer_ {nullptr};
+    concurrent::ShardedCounter sharded_;
+    std::atomic<long> total_ {0};
+
+    std::atomic<long> *counter(int tid, size_t stride) {
+        return reinterpret_cast<std::atomic<long> *>(buffer_ + tid * stride);
+    }
+
+public:
+    FalseSharing(int num_threads, size_t iters)
+        : team_(num_threads), iters_(iters), sharded_(num_threads) {
+        // room for every thread at the largest stride, block aligned
+        size_t bytes = team_.size() * FALSE_SHARING_SIZE;
+        void *p = nullptr;
+        if (posix_memalign(&p, FALSE_SHARING_SIZE, bytes) == 0)
+            buffer_ = static_cast<char *>(p);
+    }
+
+    ~FalseSharing() { free(buffer_); }
+
+    bool valid() const { return buffer_ != nullptr; }
+
+    // every thread increments the counter stride bytes after its neighbour
+    void strided(size_t stride) {
+        team_.run([&](int tid) {
+            std::atomic<long> *c = counter(tid, stride);
+            for (size_t i = 0; i < iters_; ++i)
+                c->fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    void sharded() {
+        team_.run([&](int) {
+            for (size_t i = 0; i < iters_; ++i)
+                sharded_.add();
+        });
+        bench::do_not_optimize(sharded_.read());
+    }
+
+    void local() {
+        team_.run([&](int) {
+            long sum = 0;
+            for (size_t i = 0; i < iters_; ++i) {
+                sum += 1;
+                bench::do_not_optimize(sum);
+            }
+            total_.fetch_add(sum, std::memory_order_relaxed);
+        });
+    }
+
+    void run(bench::Runner &runner, const std::string &layout) {
+        bench::Case c(layout);
+        c.param("threads", team_.size()).set_ops(iters_ * team_.size());
+        if (layout == "packed" || layout == "line" || layout == "pair") {
+            size_t stride = layout == "packed"
+                    ? sizeof(std::atomic<long>)
+                    : layout == "line" ? CACHE_LINE_SIZE : FALSE_SHARING_SIZE;
+            c.param("stride_bytes", stride);
+            auto setup = [=] {
+                for (int t = 0; t < team_.size(); ++t)
+                    new (counter(t, stride)) std::atomic<long>(0);
+            };
+            runner.run(c, setup, [=] { strided(stride); });
+        } else if (layout == "sharded") {
+            c.param("stride_bytes", sizeof(concurrent::padded<long>));
+            runner.run(c, [this] { sharded_.reset(); }, [this] { sharded(); });
+        } else if (layout == "local") {
+            runner.run(c, [this] { local(); });
+        } else {
+            fprintf(stderr, "unknown layout %s\n", layout.c_str());
+        }
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("false_sharing", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+
+    int max_threads = static_cast<int>(topo.cpus.size());
+    std::vector<long> threads;
+    for (int t = 1; t < max_threads; t *= 2)
+        threads.push_back(t);
+    threads.push_back(max_threads);
+    threads = opts.get_list("threads", threads, "thread counts to sweep");
+    size_t iters = opts.get_int(
+            "iters", 4 * 1024 * 1024, "increments per thread and repetition");
+    std::string layouts_str = opts.get_string("layouts",
+            "packed,line,pair,sharded,local", "counter layouts to run");
+    if (opts.help()) return 0;
+
+    if (max_threads < 2)
+        fprintf(stderr, "one CPU, threads time-share it and false sharing "
+                        "cannot show\n");
+
+    std::vector<std::string> layouts;
+    std::stringstream ss(layouts_str);
+    std::string l;
+    while (std::getline(ss, l, ','))
+        layouts.push_back(l);
+
+    for (long t : threads) {
+        FalseSharing fs(static_cast<int>(t), iters);
+        if (!fs.valid()) return 1;
+        for (const auto &layout : layouts)
+            fs.run(runner, layout);
+    }
+    return 0;
+}
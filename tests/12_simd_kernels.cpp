@@ -0,0 +1,261 @@
+// This is to compare explicitly vectorized kernels (simd_kernels.hpp) with
+// the loops the compiler vectorizes on its own, on data in the caches and in
+// memory, on one and on all cores.
+//
+// Versions of every kernel (add, axpy, sum, max):
+//  * auto: the plain loop, as vectorized by the compiler with the build flags
+//  * scalar, avx2, avx512: the explicit versions, skipped if unsupported
+// Large arrays are memory bound, so the text summary relates them to the
+// memory bandwidth: "dram-read", the threads of the row reading the same
+// array with the best ISA. A kernel that moves more bytes per second than
+// that plain read shows above 100 %.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "simd_kernels.hpp"
+#include "thread_team.hpp"
+#include "topology.hpp"
+
+// the loops as they would be written without intrinsics
+void auto_add(float *x, size_t n, float c) {
+    for (size_t i = 0; i < n; ++i)
+        x[i] += c;
+}
+
+void auto_axpy(size_t n, float a, const float *x, float *y) {
+    for (size_t i = 0; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+float auto_sum(const float *x, size_t n) {
+    float s = 0.f;
+    for (size_t i = 0; i < n; ++i)
+        s += x[i];
+    return s;
+}
+
+float auto_max(const float *x, size_t n) {
+    float m = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < n; ++i)
+        m = std::max(m, x[i]);
+    return m;
+}
+
+class SimdBench {
+private:
+    size_t n_;
+    float *x_ {nullptr};
+    float *y_ {nullptr};
+    thread_team::ThreadTeam &team_;
+    // per-thread results, one cache line apart
+    std::vector<float> partial_;
+
+    static float *alloc(size_t n) {
+        void *p = nullptr;
+        if (posix_memalign(&p, 64, n * sizeof(float))) return nullptr;
+        return static_cast<float *>(p);
+    }
+
+    // kernel(begin, end, tid) on every thread, chunks on cache lines
+    template <typename F>
+    void parallel(F kernel) {
+        team_.run([&](int tid) {
+            auto r = thread_team::chunk(
+                    n_, tid, team_.size(), simd::chunk_align());
+            kernel(r.first, r.second, tid);
+        });
+    }
+
+public:
+    SimdBench(size_t n, thread_team::ThreadTeam &team)
+        : n_(n), team_(team),
+          partial_(team.size() * simd::chunk_align(), 0.f) {
+        x_ = alloc(n_);
+        y_ = alloc(n_);
+        if (!valid()) return;
+        // first touch by the threads that use the chunks
+        parallel([this](size_t b, size_t e, int) {
+            for (size_t i = b; i < e; ++i) {
+                x_[i] = static_cast<float>(i % 1000) * 1e-3f;
+                y_[i] = 0.f;
+            }
+        });
+    }
+
+    ~SimdBench() {
+        free(x_);
+        free(y_);
+    }
+
+    bool valid() const { return x_ && y_; }
+    size_t bytes() const { return n_ * sizeof(float); }
+
+    // returns GB/s, 0 if the version is not supported
+    double run(bench::Runner &runner, const std::string &kernel,
+            const std::string &version, const std::string &name) {
+        simd::Isa isa = simd::SCALAR;
+        bool is_auto = version == "auto";
+        if (!is_auto) {
+            int i = simd::SCALAR;
+            while (i < simd::NUM_ISAS
+                    && version != simd::isa_name(static_cast<simd::Isa>(i)))
+                ++i;
+            if (i == simd::NUM_ISAS) {
+                fprintf(stderr, "unknown version %s\n", version.c_str());
+                return 0.;
+            }
+            isa = static_cast<simd::Isa>(i);
+            if (!simd::supported(isa)) return 0.;
+        }
+
+        float *x = x_, *y = y_;
+        float *partial = partial_.data();
+        const size_t stride = simd::chunk_align();
+        // arrays read or written per element
+        double arrays = 1;
+        std::function<void()> body;
+        if (kernel == "add") {
+            arrays = 2;
+            body = [=] {
+                parallel([=](size_t b, size_t e, int) {
+                    if (is_auto)
+                        auto_add(x + b, e - b, 1e-3f);
+                    else
+                        simd::add(x + b, e - b, 1e-3f, isa);
+                });
+            };
+        } else if (kernel == "axpy") {
+            arrays = 3;
+            body = [=] {
+                parallel([=](size_t b, size_t e, int) {
+                    if (is_auto)
+                        auto_axpy(e - b, 1e-3f, x + b, y + b);
+                    else
+                        simd::axpy(e - b, 1e-3f, x + b, y + b, isa);
+                });
+            };
+        } else if (kernel == "sum" || kernel == "read") {
+            body = [=] {
+                parallel([=](size_t b, size_t e, int tid) {
+                    partial[tid * stride] = is_auto
+                            ? auto_sum(x + b, e - b)
+                            : simd::sum(x + b, e - b, isa);
+                });
+            };
+        } else if (kernel == "max") {
+            body = [=] {
+                parallel([=](size_t b, size_t e, int tid) {
+                    partial[tid * stride] = is_auto
+                            ? auto_max(x + b, e - b)
+                            : simd::max(x + b, e - b, isa);
+                });
+            };
+        } else {
+            fprintf(stderr, "unknown kernel %s\n", kernel.c_str());
+            return 0.;
+        }
+
+        const topology::CpuInfo &topo = topology::info();
+        bench::Case c(name);
+        c.param("version", version)
+                .param("threads", team_.size())
+                .param("ws_kb", bytes() / 1024)
+                .param("level", topo.label(bytes()))
+                .set_ops(n_)
+                .set_bytes(arrays * bytes());
+        const bench::Result &r = runner.run(c, [&] {
+            body();
+            bench::do_not_optimize(partial[0]);
+        });
+        return r.metric("GB/s");
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("simd_kernels", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+
+    // one array per level that matters: inside L2, and well beyond the LLC
+    // (capped on small machines)
+    size_t phys = static_cast<size_t>(sysconf(_SC_PHYS_PAGES))
+            * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t l2 = topo.cache_size(2) ? topo.cache_size(2) : 256 * 1024;
+    std::vector<long> sizes {static_cast<long>(l2 / 4 / 1024),
+            static_cast<long>(std::min(4 * topo.llc_size(), phys / 16) / 1024)};
+    sizes = opts.get_list("sizes-kb", sizes, "bytes per array in KiB");
+    int max_threads = static_cast<int>(topo.cpus.size());
+    std::vector<long> threads = opts.get_list("threads",
+            max_threads > 1 ? std::vector<long> {1, max_threads}
+                            : std::vector<long> {1},
+            "thread counts to sweep");
+    std::string kernels_str = opts.get_string(
+            "kernels", "add,axpy,sum,max", "kernels to run");
+    std::string versions_str = opts.get_string("versions",
+            "auto,scalar,avx2,avx512", "auto and/or ISA versions");
+    if (opts.help()) return 0;
+
+    auto split = [](const std::string &s) {
+        std::vector<std::string> items;
+        std::stringstream ss(s);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            items.push_back(item);
+        return items;
+    };
+    std::vector<std::string> kernels = split(kernels_str);
+    std::vector<std::string> versions = split(versions_str);
+
+    // GB/s per (kernel, version, threads, ws) out of the caches, and the
+    // dram-read bandwidth of the same threads and array
+    struct Row {
+        double gbs;
+        double dram;
+    };
+    std::map<std::string, Row> summary;
+    for (long t : threads) {
+        thread_team::ThreadTeam team(static_cast<int>(t));
+        for (long kb : sizes) {
+            SimdBench sb(kb * 1024 / sizeof(float), team);
+            if (!sb.valid()) {
+                fprintf(stderr, "cannot allocate 2 x %ld KiB\n", kb);
+                return 1;
+            }
+            bool in_memory = sb.bytes() > topo.llc_size();
+            double dram = 0.;
+            if (in_memory)
+                dram = sb.run(runner, "read", simd::isa_name(simd::best_isa()),
+                        "dram-read");
+            for (const auto &kernel : kernels)
+                for (const auto &version : versions) {
+                    double gbs = sb.run(runner, kernel, version, kernel);
+                    if (gbs <= 0. || !in_memory) continue;
+                    summary[kernel + " " + version + " " + std::to_string(t)
+                            + " " + std::to_string(kb)]
+                            = {gbs, dram};
+                }
+        }
+    }
+
+    // how close each kernel gets to the memory bandwidth
+    if (runner.format() == "text" && !summary.empty()) {
+        printf("\n%28s%12s%12s%10s\n", "kernel version threads ws_kb", "GB/s",
+                "dram GB/s", "% dram");
+        for (const auto &row : summary) {
+            const Row &r = row.second;
+            printf("%28s%12.2f%12.2f%10.1f\n", row.first.c_str(), r.gbs,
+                    r.dram, r.dram > 0. ? 100. * r.gbs / r.dram : 0.);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+// This is to compare the size-dispatched copy and fill of mem_ops.hpp with
+// glibc memcpy / memset from 16 B to 1 GiB.
+//
+// Versions:
+//  * glibc: memcpy / memset
+//  * auto: mem_ops with the strategy picked by size
+//  * inline, vector, rep, nt: mem_ops with one strategy forced
+// Small sizes are repeated on the same (cached) buffers until a repetition
+// moves --bytes-per-rep bytes, so the time per call is measurable; large
+// sizes run once per repetition and come from memory. In text mode a table
+// gives GB/s per size and version.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "mem_ops.hpp"
+#include "topology.hpp"
+
+class MemOpsBench {
+private:
+    size_t bytes_;
+    char *src_ {nullptr};
+    char *dst_ {nullptr};
+
+    static char *alloc(size_t n) {
+        void *p = nullptr;
+        if (posix_memalign(&p, 4096, std::max<size_t>(n, 64))) return nullptr;
+        memset(p, 1, n);
+        return static_cast<char *>(p);
+    }
+
+public:
+    explicit MemOpsBench(size_t bytes) : bytes_(bytes) {
+        src_ = alloc(bytes_);
+        dst_ = alloc(bytes_);
+    }
+
+    ~MemOpsBench() {
+        free(src_);
+        free(dst_);
+    }
+
+    bool valid() const { return src_ && dst_; }
+
+    // returns GB/s
+    double run(bench::Runner &runner, const std::string &op,
+            const std::string &version, size_t bytes_per_rep) {
+        size_t calls = std::max<size_t>(1, bytes_per_rep / bytes_);
+        char *src = src_, *dst = dst_;
+        size_t n = bytes_;
+        bool copy = op == "copy";
+        std::function<void()> body;
+        if (version == "glibc") {
+            body = [=] {
+                for (size_t i = 0; i < calls; ++i) {
+                    if (copy)
+                        memcpy(dst, src, n);
+                    else
+                        memset(dst, static_cast<int>(i), n);
+                    bench::clobber_memory();
+                }
+            };
+        } else {
+            int s = mem_ops::AUTO;
+            while (s < mem_ops::NUM_STRATEGIES
+                    && version
+                            != mem_ops::strategy_name(
+                                    static_cast<mem_ops::Strategy>(s)))
+                ++s;
+            if (s == mem_ops::NUM_STRATEGIES) {
+                fprintf(stderr, "unknown version %s\n", version.c_str());
+                return 0.;
+            }
+            mem_ops::Strategy strategy = static_cast<mem_ops::Strategy>(s);
+            // forced strategies only where they apply
+            if (strategy == mem_ops::INLINE && n > MEMOPS_INLINE_MAX) return 0.;
+            if ((strategy == mem_ops::VECTOR || strategy == mem_ops::NT)
+                    && n <= 64)
+                return 0.;
+            body = [=] {
+                for (size_t i = 0; i < calls; ++i) {
+                    if (copy)
+                        mem_ops::copy(dst, src, n, strategy);
+                    else
+                        mem_ops::fill(dst, static_cast<int>(i), n, strategy);
+                    bench::clobber_memory();
+                }
+            };
+        }
+        const topology::CpuInfo &topo = topology::info();
+        bench::Case c(op);
+        c.param("version", version)
+                .param("bytes", n)
+                .param("level", topo.label(copy ? 2 * n : n))
+                .set_ops(calls)
+                .set_bytes(static_cast<double>(calls) * n);
+        return runner.run(c, body).metric("GB/s");
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("mem_ops", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+
+    // 16 B to 1 GiB in steps of 4x, capped at 1/8 of the memory for the two
+    // buffers
+    size_t phys = static_cast<size_t>(sysconf(_SC_PHYS_PAGES))
+            * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    std::vector<long> sizes;
+    for (size_t n = 16; n <= (1ul << 30) && 2 * n <= phys / 8; n *= 4)
+        sizes.push_back(static_cast<long>(n));
+    sizes = opts.get_list("sizes", sizes, "buffer sizes in bytes");
+    std::string ops_str
+            = opts.get_string("ops", "copy,fill", "copy and/or fill");
+    std::string versions_str = opts.get_string("versions",
+            "glibc,auto,inline,vector,rep,nt", "versions to compare");
+    size_t bytes_per_rep = opts.get_int("bytes-per-rep", 64 * 1024 * 1024,
+            "bytes moved per repetition for small sizes");
+    if (opts.help()) return 0;
+
+    auto split = [](const std::string &s) {
+        std::vector<std::string> items;
+        std::stringstream ss(s);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            items.push_back(item);
+        return items;
+    };
+    std::vector<std::string> ops = split(ops_str);
+    std::vector<std::string> versions = split(versions_str);
+
+    // GB/s per (op, size), then version
+    std::map<std::pair<std::string, long>, std::map<std::string, double>>
+            summary;
+    for (long n : sizes) {
+        MemOpsBench mb(n);
+        if (!mb.valid()) {
+            fprintf(stderr, "cannot allocate 2 x %ld bytes\n", n);
+            continue;
+        }
+        for (const auto &op : ops)
+            for (const auto &version : versions) {
+                double gbs = mb.run(runner, op, version, bytes_per_rep);
+                if (gbs > 0.) summary[{op, n}][version] = gbs;
+            }
+    }
+
+    if (runner.format() == "text" && !summary.empty()) {
+        printf("\n%6s%12s", "op", "bytes");
+        for (const auto &v : versions)
+            printf("%10s", v.c_str());
+        printf("%10s\n", "auto is");
+        for (const auto &row : summary) {
+            printf("%6s%12ld", row.first.first.c_str(), row.first.second);
+            for (const auto &v : versions) {
+                auto it = row.second.find(v);
+                if (it == row.second.end())
+                    printf("%10s", "-");
+                else
+                    printf("%10.2f", it->second);
+            }
+            printf("%10s\n",
+                    mem_ops::strategy_name(
+                            mem_ops::choose(row.first.second)));
+        }
+    }
+    return 0;
+}
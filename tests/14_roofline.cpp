@@ -0,0 +1,254 @@
+// This is a roofline of the matmul examples: the peak FMA throughput of one
+// core and its read bandwidth from every cache level and from memory, with
+// each registered kernel placed by arithmetic intensity and GFLOP/s.
+//
+// Ceilings:
+//  * fma-<isa>: register-only multiply-add loops, widest ISA and scalar
+//  * L1, L2, ..., RAM: simd::sum over half of each cache, and over an array
+//    well beyond the LLC
+// Kernels:
+//  * the six loop orders of 3_spatial_locality, the blocked knm of
+//    4_temporal_locality and the recursive matmul of 6_cache_oblivious, on
+//    [n x n] floats
+//  * axpy on an array in L2 and in memory, for reference
+// The AI counts the bytes of the loads and stores each kernel issues. With
+// hardware counters, the AI against LLC misses is reported as well.
+// In text mode the ceilings and kernels are printed as a table and an ASCII
+// chart; --csv and --svg write them to files.
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "cache_oblivious.hpp"
+#include "cache_state.hpp"
+#include "matmul_kernels.hpp"
+#include "mem_ops.hpp"
+#include "roofline.hpp"
+#include "simd_kernels.hpp"
+#include "topology.hpp"
+
+using DTYPE = float;
+
+static float *alloc(size_t n) {
+    void *p = nullptr;
+    if (posix_memalign(&p, 64, std::max<size_t>(n, 1) * sizeof(float)))
+        return nullptr;
+    return static_cast<float *>(p);
+}
+
+// flops per second of the register-only loop
+double measure_peak(bench::Runner &runner, simd::Isa isa, size_t iters) {
+    float sink = 0.f;
+    bench::Case c("peak");
+    c.param("isa", simd::isa_name(isa))
+            .set_ops(iters * roofline::fma_flops_per_iter(isa));
+    const bench::Result &r = runner.run(c, [&] {
+        sink += roofline::fma_peak(iters, isa);
+        bench::do_not_optimize(sink);
+    });
+    return iters * roofline::fma_flops_per_iter(isa) / r.stats.median;
+}
+
+// read GB/s over bytes, repeated until a call reads at least min_bytes
+double measure_bandwidth(bench::Runner &runner, const std::string &level,
+        size_t bytes, size_t min_bytes) {
+    size_t n = bytes / sizeof(float);
+    float *x = alloc(n);
+    if (!x) return 0.;
+    for (size_t i = 0; i < n; ++i)
+        x[i] = static_cast<float>(i % 1000) * 1e-3f;
+    size_t passes = std::max<size_t>(1, min_bytes / bytes);
+    float sink = 0.f;
+    bench::Case c("bandwidth");
+    c.param("level", level)
+            .param("ws_kb", bytes / 1024)
+            .set_bytes(static_cast<double>(passes) * bytes);
+    const bench::Result &r = runner.run(c, [&] {
+        for (size_t p = 0; p < passes; ++p)
+            sink += simd::sum(x, n);
+        bench::do_not_optimize(sink);
+    });
+    free(x);
+    return r.metric("GB/s");
+}
+
+// the kernels to place on the roofline, their arrays live as long as the
+// returned vector is used
+class Kernels {
+private:
+    std::vector<float *> arrays_;
+
+    float *array(size_t n, float value) {
+        float *p = alloc(n);
+        if (!p) {
+            fprintf(stderr, "cannot allocate %zu floats\n", n);
+            exit(1);
+        }
+        std::fill(p, p + n, value);
+        arrays_.push_back(p);
+        return p;
+    }
+
+public:
+    std::vector<roofline::Kernel> all;
+
+    Kernels(int n, size_t l2_floats, size_t ram_floats,
+            cache_state::Buffers &buffers) {
+        const double iters = static_cast<double>(n) * n * n;
+        float *A = array(static_cast<size_t>(n) * n, 1.f);
+        float *B = array(static_cast<size_t>(n) * n, 1.f);
+        float *C = array(static_cast<size_t>(n) * n, 0.f);
+        float *packed = array(MM_BLOCK_SIZE * MM_BLOCK_SIZE, 0.f);
+        size_t mat_bytes = static_cast<size_t>(n) * n * sizeof(DTYPE);
+        buffers.add(A, mat_bytes).add(B, mat_bytes).add(C, mat_bytes);
+        auto setup = [=, &buffers] {
+            mem_ops::fill(C, 0, mat_bytes);
+            buffers.prepare();
+        };
+        auto matmul = [&](const std::string &name,
+                              void (*kernel)(float *, float *, float *, int)) {
+            all.push_back({name, 2 * iters,
+                    iters * matmul_kernels::accesses_per_iter(name)
+                            * sizeof(DTYPE),
+                    setup, [=] { kernel(A, B, C, n); }});
+        };
+        matmul("mnk", matmul_kernels::mnk<float *>);
+        matmul("nmk", matmul_kernels::nmk<float *>);
+        matmul("nkm", matmul_kernels::nkm<float *>);
+        matmul("knm", matmul_kernels::knm<float *>);
+        matmul("kmn", matmul_kernels::kmn<float *>);
+        matmul("mkn", matmul_kernels::mkn<float *>);
+        if (n % MM_BLOCK_SIZE == 0)
+            all.push_back({"block-knm", 2 * iters,
+                    iters * matmul_kernels::accesses_per_iter("block-knm")
+                            * sizeof(DTYPE),
+                    setup, [=] {
+                        matmul_kernels::block_knm(A, B, C, packed, n);
+                    }});
+        // the base case of the recursion is the mkn loop nest
+        all.push_back({"recursive", 2 * iters,
+                iters * matmul_kernels::accesses_per_iter("mkn")
+                        * sizeof(DTYPE),
+                setup, [=] { cache_oblivious::matmul(A, B, C, n); }});
+
+        // y += a * x: 2 flops, two loads and a store per element
+        auto axpy = [&](const std::string &name, size_t len) {
+            float *x = array(len, 1.f);
+            float *y = array(len, 0.f);
+            size_t passes = std::max<size_t>(1, (64 << 20) / (len * 12));
+            all.push_back({name, 2. * len * passes, 12. * len * passes,
+                    [] {}, [=] {
+                        for (size_t p = 0; p < passes; ++p)
+                            simd::axpy(len, 1e-6f, x, y);
+                        bench::clobber_memory();
+                    }});
+        };
+        axpy("axpy-l2", l2_floats);
+        axpy("axpy-ram", ram_floats);
+    }
+
+    ~Kernels() {
+        for (float *p : arrays_)
+            free(p);
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("roofline", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+
+    int n = opts.get_int("n", 512, "matrix dimension");
+    std::string names_str = opts.get_string("kernels",
+            "mnk,nmk,nkm,knm,kmn,mkn,block-knm,recursive,axpy-l2,axpy-ram",
+            "kernels to place on the roofline");
+    size_t fma_iters = opts.get_int(
+            "fma-iters", 10000000, "iterations of the peak FMA loop");
+    cache_state::State state = cache_state::option(opts);
+    std::string csv_path = opts.get_string("csv", "", "write the roofline "
+                                                      "as CSV to this file");
+    std::string svg_path = opts.get_string("svg", "", "write the roofline "
+                                                      "as SVG to this file");
+    int width = opts.get_int("chart-width", 64, "ASCII chart columns");
+    if (opts.help()) return 0;
+
+    std::vector<std::string> names;
+    {
+        std::stringstream ss(names_str);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            names.push_back(item);
+    }
+
+    roofline::Model model;
+
+    // compute ceilings: widest ISA and scalar
+    model.add_compute(std::string("fma-") + simd::isa_name(simd::best_isa()),
+            measure_peak(runner, simd::best_isa(), fma_iters));
+    if (simd::best_isa() != simd::SCALAR)
+        model.add_compute("scalar",
+                measure_peak(runner, simd::SCALAR, fma_iters / 4));
+
+    // bandwidth ceilings: half of every cache level, then memory (capped on
+    // small machines)
+    size_t phys = static_cast<size_t>(sysconf(_SC_PHYS_PAGES))
+            * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t ram_bytes = std::min(4 * topo.llc_size(), phys / 8);
+    for (const auto &cl : topo.caches)
+        model.add_bandwidth("L" + std::to_string(cl.level),
+                measure_bandwidth(runner, "L" + std::to_string(cl.level),
+                        cl.size / 2, 256 << 20));
+    model.add_bandwidth("RAM",
+            measure_bandwidth(runner, "RAM", ram_bytes, 256 << 20));
+
+    size_t l2 = topo.cache_size(2) ? topo.cache_size(2) : 256 * 1024;
+    cache_state::Buffers buffers(state);
+    Kernels kernels(n, l2 / 4 / sizeof(float), ram_bytes / 2 / sizeof(float),
+            buffers);
+    for (const auto &name : names) {
+        auto it = std::find_if(kernels.all.begin(), kernels.all.end(),
+                [&](const roofline::Kernel &k) { return k.name == name; });
+        if (it == kernels.all.end()) {
+            fprintf(stderr, "unknown kernel %s\n", name.c_str());
+            continue;
+        }
+        bench::Case c(name);
+        c.param("n", n)
+                .param("cache", buffers.name())
+                .set_ops(it->flops)
+                .set_bytes(it->bytes);
+        const bench::Result &r = runner.run(c, it->setup, it->body);
+        double gflops = it->flops / r.stats.median;
+        double llc_bytes = r.metric("llc-misses/op") * it->flops
+                * topo.line_size;
+        model.add_point(name, it->flops / it->bytes, gflops,
+                llc_bytes > 0. ? it->flops / llc_bytes : 0.);
+    }
+
+    if (!csv_path.empty()) std::ofstream(csv_path) << model.csv();
+    if (!svg_path.empty()) std::ofstream(svg_path) << model.svg();
+
+    if (runner.format() == "text") {
+        printf("\n%12s%10s%10s%12s%8s%8s%10s%10s\n", "kernel", "AI",
+                "GFLOP/s", "roof", "% roof", "level", "bound", "RAM AI");
+        for (const auto &p : model.points()) {
+            const roofline::Ceiling *b = model.level(p);
+            char ram_ai[32] = "-";
+            if (p.ram_ai > 0.) snprintf(ram_ai, sizeof(ram_ai), "%.3g", p.ram_ai);
+            printf("%12s%10.3f%10.2f%12.2f%8.1f%8s%10s%10s\n", p.name.c_str(),
+                    p.ai, p.gflops, model.roof(p.ai),
+                    100. * p.gflops / model.roof(p.ai),
+                    b ? b->name.c_str() : "-", model.bound(p).c_str(),
+                    ram_ai);
+        }
+        printf("\n%s", model.ascii(width).c_str());
+    }
+    return 0;
+}
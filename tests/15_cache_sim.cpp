@@ -0,0 +1,226 @@
+// This is to predict the cache and TLB misses of the matmul loop orders
+// (3_spatial_locality) and the blocked knm (4_temporal_locality) with the
+// trace-driven simulator of cache_sim.hpp, next to the measured run.
+//
+// For every version:
+//  * the kernel of matmul_kernels.hpp runs on TracedArrays, which record
+//    the address of every element into a compact trace; the trace is
+//    simulated chunk by chunk, or written to --trace-dir and read back
+//  * the same kernel runs on the raw arrays under the harness, from flushed
+//    caches as the simulated hierarchy starts cold
+// In text mode a table gives the simulated misses per innermost iteration
+// of every level, the measured time and, with hardware counters, the
+// measured misses per iteration.
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "cache_sim.hpp"
+#include "cache_state.hpp"
+#include "matmul_kernels.hpp"
+#include "mem_ops.hpp"
+#include "utils.hpp"
+
+using DTYPE = float;
+
+class SimBench {
+private:
+    int n_;
+    std::vector<DTYPE> A_;
+    std::vector<DTYPE> B_;
+    std::vector<DTYPE> C_;
+    std::vector<DTYPE> packed_;
+    double iters_;
+    cache_state::Buffers buffers_;
+
+    void reset() {
+        mem_ops::fill(C_.data(), 0, C_.size() * sizeof(DTYPE));
+    }
+
+    // false if the version is unknown
+    template <typename P>
+    static bool kernel(
+            const std::string &version, P A, P B, P C, P packed, int n) {
+        if (version == "mnk") matmul_kernels::mnk(A, B, C, n);
+        else if (version == "nmk") matmul_kernels::nmk(A, B, C, n);
+        else if (version == "nkm") matmul_kernels::nkm(A, B, C, n);
+        else if (version == "knm") matmul_kernels::knm(A, B, C, n);
+        else if (version == "kmn") matmul_kernels::kmn(A, B, C, n);
+        else if (version == "mkn") matmul_kernels::mkn(A, B, C, n);
+        else if (version == "block-knm")
+            matmul_kernels::block_knm(A, B, C, packed, n);
+        else return false;
+        return true;
+    }
+
+public:
+    SimBench(int n, cache_state::State state)
+        : n_(n), A_(n * n, 1), B_(n * n, 1), C_(n * n, 0),
+          packed_(MM_BLOCK_SIZE * MM_BLOCK_SIZE, 0), buffers_(state) {
+        iters_ = (double)n_ * n_ * n_;
+        buffers_.add(A_).add(B_).add(C_);
+    }
+
+    double iters() const { return iters_; }
+
+    bool valid(const std::string &version) const {
+        const char *versions[] = {
+                "mnk", "nmk", "nkm", "knm", "kmn", "mkn", "block-knm"};
+        return std::find(std::begin(versions), std::end(versions), version)
+                != std::end(versions)
+                && (version != "block-knm" || n_ % MM_BLOCK_SIZE == 0);
+    }
+
+    // the kernel on the raw arrays
+    const bench::Result &measure(
+            bench::Runner &runner, const std::string &version) {
+        bench::Case c(version);
+        c.param("n", n_).param("cache", buffers_.name()).set_ops(iters_);
+        return runner.run(
+                c,
+                [this] {
+                    reset();
+                    buffers_.prepare();
+                },
+                [&] {
+                    kernel(version, A_.data(), B_.data(), C_.data(),
+                            packed_.data(), n_);
+                });
+    }
+
+    // the kernel on traced arrays into h, through a trace file if path is
+    // set; returns the simulated accesses per second
+    double simulate(cache_sim::Hierarchy &h, const std::string &version,
+            const std::string &path, double *trace_bytes) {
+        reset();
+        h.reset();
+        FILE *f = nullptr;
+        if (!path.empty() && !(f = fopen(path.c_str(), "w+b"))) {
+            fprintf(stderr, "cannot open %s\n", path.c_str());
+            return 0.;
+        }
+        uint64_t t0 = ns_now();
+        uint64_t records;
+        {
+            cache_sim::TraceWriter trace(f ? cache_sim::TraceWriter::to_file(f)
+                                           : cache_sim::TraceWriter::to_hierarchy(h));
+            cache_sim::TracedArray<DTYPE> A {A_.data(), &trace},
+                    B {B_.data(), &trace}, C {C_.data(), &trace},
+                    packed {packed_.data(), &trace};
+            kernel(version, A, B, C, packed, n_);
+            trace.flush();
+            records = trace.records();
+            *trace_bytes = static_cast<double>(trace.bytes());
+        }
+        if (f) {
+            // time the replay only
+            rewind(f);
+            t0 = ns_now();
+            cache_sim::read_trace(f, cache_sim::TraceWriter::to_hierarchy(h));
+            fclose(f);
+            remove(path.c_str());
+        }
+        uint64_t t1 = ns_now();
+        return records * 1e9 / std::max<uint64_t>(t1 - t0, 1);
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("cache_sim", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    int n = opts.get_int("n", 256, "matrix dimension");
+    std::string versions_str = opts.get_string("versions",
+            "mnk,nmk,nkm,knm,kmn,mkn,block-knm", "loop orders to simulate");
+    std::string policy_str
+            = opts.get_string("policy", "lru", "replacement, lru or plru");
+    bool prefetch = opts.get_int("prefetch", 0, "next-line prefetch, 0 or 1");
+    std::string trace_dir = opts.get_string("trace-dir", "",
+            "write traces here and simulate them from the files");
+    cache_state::State state = cache_state::option(opts);
+    if (opts.help()) return 0;
+    cache_sim::Policy policy = cache_sim::parse_policy(policy_str);
+    if (policy == cache_sim::NUM_POLICIES) {
+        fprintf(stderr, "unknown policy %s\n", policy_str.c_str());
+        return 1;
+    }
+
+    cache_sim::Hierarchy h(cache_sim::topology_caches(policy, prefetch),
+            cache_sim::default_tlbs(policy));
+    SimBench sb(n, state);
+
+    struct Row {
+        std::string version;
+        std::vector<double> predicted;
+        double ns;
+        std::vector<double> measured;
+        double maccs;
+        double bytes_per_access;
+    };
+    std::vector<Row> rows;
+    // counters to compare with L1, the LLC and the dTLB
+    const char *counters[] = {"l1d-misses/op", "llc-misses/op",
+            "dtlb-misses/op"};
+
+    std::stringstream ss(versions_str);
+    std::string v;
+    while (std::getline(ss, v, ',')) {
+        if (!sb.valid(v)) {
+            fprintf(stderr, "unknown version %s (or n not a multiple of %d)\n",
+                    v.c_str(), MM_BLOCK_SIZE);
+            continue;
+        }
+        Row row;
+        row.version = v;
+        double trace_bytes = 0.;
+        row.maccs = 1e-6
+                * sb.simulate(h, v,
+                        trace_dir.empty() ? "" : trace_dir + "/" + v + ".trace",
+                        &trace_bytes);
+        double accesses = static_cast<double>(h.cache_stats(0).accesses);
+        row.bytes_per_access = accesses > 0. ? trace_bytes / accesses : 0.;
+        for (size_t i = 0; i < h.caches().size(); ++i)
+            row.predicted.push_back(h.cache_stats(i).misses / sb.iters());
+        for (size_t i = 0; i < h.tlbs().size(); ++i)
+            row.predicted.push_back(h.tlb_stats(i).misses / sb.iters());
+        if (runner.format() == "text") {
+            printf("%s: %.0f accesses, %.2f trace bytes per access\n",
+                    v.c_str(), accesses, row.bytes_per_access);
+            h.print();
+        }
+
+        const bench::Result &r = sb.measure(runner, v);
+        row.ns = r.metric("ns/op");
+        for (const char *c : counters)
+            row.measured.push_back(r.metric(c, -1.));
+        rows.push_back(row);
+    }
+
+    if (runner.format() == "text" && !rows.empty()) {
+        printf("\n%10s", "version");
+        for (const auto &c : h.caches())
+            printf("%10s", (c.config().name + " sim").c_str());
+        for (const auto &t : h.tlbs())
+            printf("%10s", (t.config().name + " sim").c_str());
+        printf("%10s%10s%10s%10s%12s\n", "ns", "L1D hw", "LLC hw", "dTLB hw",
+                "sim Macc/s");
+        for (const auto &row : rows) {
+            printf("%10s", row.version.c_str());
+            for (double p : row.predicted)
+                printf("%10.4f", p);
+            printf("%10.3f", row.ns);
+            for (double m : row.measured)
+                if (m < 0.)
+                    printf("%10s", "-");
+                else
+                    printf("%10.4f", m);
+            printf("%12.1f\n", row.maccs);
+        }
+        printf("(misses per innermost iteration, ns per iteration)\n");
+    }
+    return 0;
+}
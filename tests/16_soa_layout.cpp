@@ -0,0 +1,208 @@
+// This is to compare the record layouts of soa_vector.hpp on kernels written
+// once against its uniform API: particles of 8 floats (position, velocity,
+// mass, charge; 32 bytes) as AoS, SoA and AoSoA with 8- and 16-wide tiles.
+//
+// Kernels:
+//  * one: scale x, 1 of the 8 fields
+//  * all: increment every field
+//  * particle: x += vx * dt and so on, then gravity on vz (6 of 8 fields)
+// Each runs on a working set in L2 and one in memory; small sets are swept
+// several times per call. Bandwidth counts the bytes of the fields a kernel
+// touches, read and written, so an AoS pays for the rest of every line.
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "soa_vector.hpp"
+#include "topology.hpp"
+
+template <typename Layout>
+using Particles = soa::soa_vector<Layout, float, float, float, float, float,
+        float, float, float>;
+
+enum { X, Y, Z, VX, VY, VZ, MASS, CHARGE };
+
+// the kernels, one source for every layout
+
+template <typename V>
+void scale_x(V &v, float s) {
+    soa::for_each_block(v, [=](auto b, size_t n) {
+        auto x = soa::field<X>(b);
+        for (size_t j = 0; j < n; ++j)
+            x[j] *= s;
+    });
+}
+
+template <typename V>
+void touch_all(V &v) {
+    soa::for_each_block(v, [](auto b, size_t n) {
+        auto x = soa::field<X>(b);
+        auto y = soa::field<Y>(b);
+        auto z = soa::field<Z>(b);
+        auto vx = soa::field<VX>(b);
+        auto vy = soa::field<VY>(b);
+        auto vz = soa::field<VZ>(b);
+        auto m = soa::field<MASS>(b);
+        auto q = soa::field<CHARGE>(b);
+        for (size_t j = 0; j < n; ++j) {
+            x[j] += 1.f;
+            y[j] += 1.f;
+            z[j] += 1.f;
+            vx[j] += 1.f;
+            vy[j] += 1.f;
+            vz[j] += 1.f;
+            m[j] += 1.f;
+            q[j] += 1.f;
+        }
+    });
+}
+
+template <typename V>
+void advance(V &v, float dt) {
+    const float g = -9.81f;
+    soa::for_each_block(v, [=](auto b, size_t n) {
+        auto x = soa::field<X>(b);
+        auto y = soa::field<Y>(b);
+        auto z = soa::field<Z>(b);
+        auto vx = soa::field<VX>(b);
+        auto vy = soa::field<VY>(b);
+        auto vz = soa::field<VZ>(b);
+        for (size_t j = 0; j < n; ++j) {
+            x[j] += vx[j] * dt;
+            y[j] += vy[j] * dt;
+            z[j] += vz[j] * dt;
+            vz[j] += g * dt;
+        }
+    });
+}
+
+// bytes read and written per particle
+static double useful_bytes(const std::string &kernel) {
+    if (kernel == "one") return 2 * sizeof(float);
+    if (kernel == "all") return 16 * sizeof(float);
+    return 10 * sizeof(float);
+}
+
+// ns per particle of kernel over n particles laid out as Layout
+template <typename Layout>
+double run(bench::Runner &runner, const std::string &kernel,
+        const std::string &size, size_t n) {
+    Particles<Layout> v(n);
+    for (size_t i = 0; i < n; ++i)
+        v[i].set(i * 1e-3f, 0.f, 1.f, 1.f, 0.5f, 0.f, 1.f, -1.f);
+    // at least 64 MB touched per call
+    size_t passes = std::max<size_t>(1, (64 << 20) / (n * useful_bytes(kernel)));
+    double ops = static_cast<double>(n) * passes;
+
+    bench::Case c(kernel);
+    c.param("layout", Particles<Layout>::layout_name())
+            .param("size", size)
+            .param("n", n)
+            .set_ops(ops)
+            .set_bytes(ops * useful_bytes(kernel));
+    auto body = [&] {
+        for (size_t p = 0; p < passes; ++p) {
+            if (kernel == "one") scale_x(v, 0.999f);
+            else if (kernel == "all") touch_all(v);
+            else advance(v, 1e-3f);
+        }
+        bench::do_not_optimize(v.template get<X>(n / 2));
+        bench::clobber_memory();
+    };
+    return runner.run(c, body).metric("ns/op");
+}
+
+int main(int argc, char **argv) {
+    bench::Runner runner("soa_layout", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+    std::string kernels_str = opts.get_string("kernels", "one,all,particle",
+            "kernels: one, all, particle");
+    std::string layouts_str = opts.get_string(
+            "layouts", "aos,soa,aosoa8,aosoa16", "record layouts");
+    size_t l2 = topo.cache_size(2) ? topo.cache_size(2) : 256 * 1024;
+    size_t phys = static_cast<size_t>(sysconf(_SC_PHYS_PAGES))
+            * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t ram = std::min(4 * topo.llc_size(), phys / 16);
+    size_t l2_n = opts.get_int("l2-n", l2 / 2 / 32, "particles in L2");
+    size_t ram_n = opts.get_int("ram-n", ram / 32, "particles in memory");
+    if (opts.help()) return 0;
+
+    auto split = [](const std::string &list) {
+        std::vector<std::string> items;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            items.push_back(item);
+        return items;
+    };
+    std::vector<std::string> kernels = split(kernels_str);
+    std::vector<std::string> layouts = split(layouts_str);
+
+    const std::pair<std::string, size_t> sizes[] = {
+            {"L2", l2_n}, {"RAM", ram_n}};
+    // ns per particle by (kernel, size) and layout
+    std::map<std::string, std::map<std::string, double>> table;
+    for (const auto &kernel : kernels) {
+        if (kernel != "one" && kernel != "all" && kernel != "particle") {
+            fprintf(stderr, "unknown kernel %s\n", kernel.c_str());
+            continue;
+        }
+        for (const auto &size : sizes) {
+            for (const auto &layout : layouts) {
+                double ns;
+                if (layout == "aos")
+                    ns = run<soa::AoS>(runner, kernel, size.first, size.second);
+                else if (layout == "soa")
+                    ns = run<soa::SoA>(runner, kernel, size.first, size.second);
+                else if (layout == "aosoa8")
+                    ns = run<soa::AoSoA<8>>(
+                            runner, kernel, size.first, size.second);
+                else if (layout == "aosoa16")
+                    ns = run<soa::AoSoA<16>>(
+                            runner, kernel, size.first, size.second);
+                else {
+                    fprintf(stderr, "unknown layout %s\n", layout.c_str());
+                    continue;
+                }
+                table[kernel + "/" + size.first][layout] = ns;
+            }
+        }
+    }
+
+    if (runner.format() == "text" && !table.empty()) {
+        printf("\n%10s%6s", "kernel", "size");
+        for (const auto &layout : layouts)
+            printf("%18s", layout.c_str());
+        printf("\n");
+        for (const auto &kernel : kernels) {
+            for (const auto &size : sizes) {
+                auto it = table.find(kernel + "/" + size.first);
+                if (it == table.end()) continue;
+                printf("%10s%6s", kernel.c_str(), size.first.c_str());
+                for (const auto &layout : layouts) {
+                    auto l = it->second.find(layout);
+                    if (l == it->second.end()) {
+                        printf("%18s", "-");
+                        continue;
+                    }
+                    char cell[32];
+                    snprintf(cell, sizeof(cell), "%.2f (%.1f)", l->second,
+                            useful_bytes(kernel) / l->second);
+                    printf("%18s", cell);
+                }
+                printf("\n");
+            }
+        }
+        printf("(ns per particle, useful GB/s)\n");
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+// This is to hide the memory latency of lookups by interleaving them, where
+// 7_memory_latency only measures it.
+//
+// Structures, both well beyond the LLC by default:
+//  * hash: a chained hash table of uint64 keys, a bucket array and one node
+//    per key, about two nodes per chain
+//  * search: lower bound in a sorted uint64 array of several GB (capped by
+//    the memory of the machine)
+// Every structure is probed with random keys, sequentially (one lookup after
+// the other, K = 0 in the table) and with interleave::run keeping K lookups
+// in flight per thread. Results are checked against an untimed sequential
+// pass. In text mode a table gives ns per lookup and the speedup over the
+// sequential loop for every K; K = 0 is run even if --ks leaves it out.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "interleave.hpp"
+#include "thread_team.hpp"
+#include "topology.hpp"
+
+using Table = interleave::HashTable<uint64_t, uint64_t>;
+
+// ns per lookup of every k, k = 0 for the sequential loop
+template <typename Sequential, typename Machine>
+std::vector<double> sweep(bench::Runner &runner, thread_team::ThreadTeam &team,
+        const std::string &name, const std::string &ws,
+        const std::vector<size_t> &ks, const std::vector<uint64_t> &keys,
+        Sequential sequential, const Machine &machine) {
+    using Result = typename Machine::result_type;
+    const size_t n = keys.size();
+    // the reference, untimed, whatever ks holds
+    std::vector<Result> expect(n);
+    for (size_t i = 0; i < n; ++i)
+        expect[i] = sequential(keys[i]);
+    std::vector<Result> out(n);
+    std::vector<double> ns;
+    for (size_t k : ks) {
+        bench::Case c(name);
+        c.param("ws", ws).param("k", k).param("threads", team.size()).set_ops(n);
+        const bench::Result &r = runner.run(c, [&] {
+            team.run([&](int tid) {
+                auto range = thread_team::chunk(n, tid, team.size());
+                if (k == 0) {
+                    for (size_t i = range.first; i < range.second; ++i)
+                        out[i] = sequential(keys[i]);
+                } else {
+                    interleave::run(machine, keys.data() + range.first,
+                            range.second - range.first,
+                            out.data() + range.first, k);
+                }
+            });
+            bench::clobber_memory();
+        });
+        if (out != expect)
+            fprintf(stderr, "%s: K=%zu gives other results\n", name.c_str(), k);
+        ns.push_back(r.metric("ns/op"));
+    }
+    return ns;
+}
+
+static std::string mb(size_t bytes) {
+    return std::to_string(bytes >> 20) + "MB";
+}
+
+int main(int argc, char **argv) {
+    bench::Runner runner("interleaved_lookup", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+    size_t phys = static_cast<size_t>(sysconf(_SC_PHYS_PAGES))
+            * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t hash_bytes = opts.get_int("hash-mb",
+                                std::min(4 * topo.llc_size(), phys / 16) >> 20,
+                                "hash table size in MB")
+            << 20;
+    size_t search_bytes = opts.get_int("search-mb",
+                                  std::min<size_t>(4ull << 30, phys / 4) >> 20,
+                                  "sorted array size in MB")
+            << 20;
+    size_t lookups = opts.get_int("lookups", 1 << 18, "lookups per call");
+    std::string ks_str = opts.get_string(
+            "ks", "0,1,2,4,8,16,32",
+            "lookups in flight, 0 (sequential) is always run");
+    int threads = opts.get_int("threads", 1, "threads, each with K lookups");
+    std::string structures = opts.get_string(
+            "structures", "hash,search", "hash and/or search");
+    if (opts.help()) return 0;
+
+    std::vector<size_t> ks;
+    {
+        std::stringstream ss(ks_str);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            ks.push_back(std::stoul(item));
+        // the sequential loop first, it is what the speedup is against
+        ks.erase(std::remove(ks.begin(), ks.end(), 0), ks.end());
+        ks.insert(ks.begin(), 0);
+    }
+    thread_team::ThreadTeam team(threads);
+    std::mt19937_64 gen(42);
+    std::vector<uint64_t> keys(lookups);
+    std::vector<double> hash_ns;
+    std::vector<double> search_ns;
+
+    if (structures.find("hash") != std::string::npos) {
+        // one 8-byte bucket per two 24-byte nodes
+        size_t entries = hash_bytes / (sizeof(Table::Node) + 4);
+        Table table(entries);
+        std::vector<uint64_t> inserted;
+        inserted.reserve(entries);
+        while (table.size() < entries) {
+            uint64_t key = gen();
+            if (table.insert(key, key ^ 1)) inserted.push_back(key);
+        }
+        for (auto &key : keys)
+            key = inserted[gen() % inserted.size()];
+        std::vector<uint64_t>().swap(inserted);
+        hash_ns = sweep(runner, team, "hash", mb(table.bytes()), ks, keys,
+                [&](uint64_t key) { return table.find(key); }, table.lookup());
+    }
+
+    if (structures.find("search") != std::string::npos) {
+        size_t n = search_bytes / sizeof(uint64_t);
+        std::vector<uint64_t> a(n);
+        for (size_t i = 0; i < n; ++i)
+            a[i] = 2 * i;
+        for (auto &key : keys)
+            key = gen() % (2 * n);
+        interleave::SortedSearch<uint64_t> search(a.data(), n);
+        search_ns = sweep(runner, team, "search", mb(n * sizeof(uint64_t)), ks,
+                keys, [&](uint64_t key) { return search.lower_bound(key); },
+                search);
+    }
+
+    if (runner.format() == "text") {
+        printf("\n%6s%14s%10s%14s%10s\n", "K", "hash ns", "speedup",
+                "search ns", "speedup");
+        for (size_t i = 0; i < ks.size(); ++i) {
+            printf("%6zu", ks[i]);
+            const std::vector<double> *cols[] = {&hash_ns, &search_ns};
+            for (const auto *col : cols) {
+                if (col->empty())
+                    printf("%14s%10s", "-", "-");
+                else
+                    printf("%14.1f%10.2f", (*col)[i], (*col)[0] / (*col)[i]);
+            }
+            printf("\n");
+        }
+        printf("(ns per lookup; K = 0 is the sequential loop, speedup against "
+               "it)\n");
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+// This is to measure sparse matrix-vector multiply y = A x, where the
+// dense matmul examples have no gathers, and what reordering the matrix does
+// to the locality of the x[col] gathers.
+//
+// Matrices (spmv.hpp generators, nodes renamed at random like the ids of a
+// real graph):
+//  * banded: about --degree entries per row within --band of the diagonal
+//  * powerlaw: a graph with power-law degrees, a few hubs in most rows
+// Orders: original, rcm (reverse Cuthill-McKee), degree (hubs first).
+// Formats: CSR and SELL-C-sigma, rows (chunks) split over the threads by
+// nonzeros, or by count with --split=rows.
+// GFLOP/s counts 2 flops per nonzero, GB/s the minimum traffic (matrix, x
+// and y once; SELL padding included). The mean |row - col| shows how local
+// the gathers are.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "bench.hpp"
+#include "spmv.hpp"
+#include "thread_team.hpp"
+#include "topology.hpp"
+
+struct Row {
+    std::string matrix;
+    std::string order;
+    double distance;
+    double padding;
+    double csr_gflops, csr_gbs;
+    double sell_gflops, sell_gbs;
+};
+
+class SpmvBench {
+private:
+    thread_team::ThreadTeam &team_;
+    bool by_nnz_;
+
+    std::vector<size_t> split(const std::vector<size_t> &ptr) const {
+        if (by_nnz_) return spmv::partition(ptr, team_.size());
+        std::vector<size_t> bounds(team_.size() + 1);
+        for (int t = 0; t <= team_.size(); ++t)
+            bounds[t] = thread_team::chunk(ptr.size() - 1, t, team_.size())
+                                .first;
+        bounds[team_.size()] = ptr.size() - 1;
+        return bounds;
+    }
+
+public:
+    SpmvBench(thread_team::ThreadTeam &team, bool by_nnz)
+        : team_(team), by_nnz_(by_nnz) {}
+
+    // GFLOP/s and GB/s of y = A x on either format
+    template <typename Matrix>
+    std::pair<double, double> measure(bench::Runner &runner,
+            const std::string &format, const std::string &matrix,
+            const std::string &order, const Matrix &a, const float *x,
+            float *y) {
+        std::vector<size_t> bounds = split(a.ptr);
+        double flops = 2. * static_cast<double>(a.nnz());
+        bench::Case c(format);
+        c.param("matrix", matrix)
+                .param("order", order)
+                .param("threads", team_.size())
+                .param("split", by_nnz_ ? "nnz" : "rows")
+                .set_ops(flops)
+                .set_bytes(spmv::traffic(a));
+        const bench::Result &r = runner.run(c, [&] {
+            team_.run([&](int tid) {
+                spmv::multiply(a, x, y, bounds[tid], bounds[tid + 1]);
+            });
+            bench::clobber_memory();
+        });
+        return {flops / r.stats.median, r.metric("GB/s")};
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("spmv", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+    size_t n = opts.get_int("n", 1 << 20, "rows (and columns)");
+    size_t degree = opts.get_int("degree", 16, "average nonzeros per row");
+    size_t band = opts.get_int("band", 64, "half band of the banded matrix");
+    double skew = opts.get_double(
+            "skew", 3., "power-law skew, larger gives bigger hubs");
+    std::string matrices_str = opts.get_string(
+            "matrices", "banded,powerlaw", "banded and/or powerlaw");
+    std::string orders_str = opts.get_string(
+            "orders", "original,rcm,degree", "orderings to compare");
+    size_t sell_c = opts.get_int("sell-c", 8, "SELL chunk rows: 4, 8, 16, 32");
+    size_t sigma = opts.get_int("sell-sigma", 256, "SELL sorting window");
+    int threads = opts.get_int(
+            "threads", static_cast<int>(topo.cpus.size()), "threads");
+    std::string split = opts.get_string("split", "nnz", "nnz or rows");
+    if (opts.help()) return 0;
+    if (!spmv::sell_width_supported(sell_c)) {
+        fprintf(stderr, "unsupported SELL chunk size %zu\n", sell_c);
+        return 1;
+    }
+
+    auto list = [](const std::string &s) {
+        std::vector<std::string> items;
+        std::stringstream ss(s);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            items.push_back(item);
+        return items;
+    };
+
+    thread_team::ThreadTeam team(threads);
+    SpmvBench sb(team, split != "rows");
+    std::vector<Row> rows;
+    for (const auto &matrix : list(matrices_str)) {
+        spmv::Csr a;
+        if (matrix == "banded")
+            a = spmv::banded(n, band, degree, true);
+        else if (matrix == "powerlaw")
+            a = spmv::power_law(n, degree, skew, true);
+        else {
+            fprintf(stderr, "unknown matrix %s\n", matrix.c_str());
+            continue;
+        }
+        std::vector<float> x(n);
+        for (size_t i = 0; i < n; ++i)
+            x[i] = 0.01f * static_cast<float>(i % 97);
+        std::vector<float> expect(n);
+        spmv::multiply(a, x.data(), expect.data(), 0, n);
+
+        for (const auto &order_name : list(orders_str)) {
+            std::vector<spmv::index_t> order;
+            if (order_name == "rcm")
+                order = spmv::rcm(a);
+            else if (order_name == "degree")
+                order = spmv::degree_order(a);
+            else if (order_name != "original") {
+                fprintf(stderr, "unknown order %s\n", order_name.c_str());
+                continue;
+            }
+            spmv::Csr b = order.empty() ? a : spmv::permute(a, order);
+            // x and the expected y in the new order
+            std::vector<float> px(x);
+            std::vector<float> pexpect(expect);
+            for (size_t k = 0; k < order.size(); ++k) {
+                px[k] = x[order[k]];
+                pexpect[k] = expect[order[k]];
+            }
+            spmv::Sell s = spmv::to_sell(b, sell_c, sigma);
+
+            Row row;
+            row.matrix = matrix;
+            row.order = order_name;
+            row.distance = spmv::mean_distance(b);
+            row.padding = static_cast<double>(s.stored()) / s.nnz() - 1.;
+            std::vector<float> y(n);
+            std::tie(row.csr_gflops, row.csr_gbs) = sb.measure(
+                    runner, "csr", matrix, order_name, b, px.data(), y.data());
+            std::vector<float> ys(n);
+            std::tie(row.sell_gflops, row.sell_gbs) = sb.measure(
+                    runner, "sell", matrix, order_name, s, px.data(), ys.data());
+            for (size_t i = 0; i < n; ++i)
+                if (std::fabs(y[i] - pexpect[i]) > 1e-3f * (1.f + std::fabs(pexpect[i]))
+                        || std::fabs(ys[i] - pexpect[i])
+                                > 1e-3f * (1.f + std::fabs(pexpect[i]))) {
+                    fprintf(stderr, "%s %s: wrong y[%zu]\n", matrix.c_str(),
+                            order_name.c_str(), i);
+                    break;
+                }
+            rows.push_back(row);
+        }
+    }
+
+    if (runner.format() == "text" && !rows.empty()) {
+        printf("\n%10s%10s%12s%9s%10s%9s%10s%9s\n", "matrix", "order",
+                "mean dist", "padding", "CSR GF/s", "GB/s", "SELL GF/s",
+                "GB/s");
+        for (const auto &r : rows)
+            printf("%10s%10s%12.0f%8.0f%%%10.2f%9.2f%10.2f%9.2f\n",
+                    r.matrix.c_str(), r.order.c_str(), r.distance,
+                    100. * r.padding, r.csr_gflops, r.csr_gbs, r.sell_gflops,
+                    r.sell_gbs);
+        printf("(%zu rows, %d threads split by %s, SELL-%zu-%zu)\n", n,
+                team.size(), split.c_str(), sell_c, sigma);
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+// This is to compare the two forms of 2-D convolution of conv2d.hpp on the
+// layer shapes of ResNet, extending the blocked matmul of
+// 4_temporal_locality to the kernels that dominate CNNs.
+//
+// For every shape:
+//  * im2col: the lowering alone, and im2col-gemm, the lowering plus the
+//    [K x CRS] x [CRS x PQ] block_gemm
+//  * direct: the register-tiled kernel on NCHW16c input and output and
+//    blocked weights, and reorder, the conversion of the input to the
+//    blocked layout and of the output back (what a network that does not
+//    stay blocked pays around every layer)
+// The table gives ms per batch, GFLOP/s, the share of im2col in its path and
+// the memory the columns take on top of the tensors.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "conv2d.hpp"
+
+struct Layer {
+    const char *name;
+    conv2d::Shape shape;
+};
+
+static float *alloc(size_t n) {
+    void *p = nullptr;
+    if (posix_memalign(&p, 64, std::max<size_t>(n, 1) * sizeof(float))) {
+        fprintf(stderr, "cannot allocate %zu floats\n", n);
+        exit(1);
+    }
+    return static_cast<float *>(p);
+}
+
+class ConvBench {
+private:
+    conv2d::Shape sh_;
+    std::vector<float *> buffers_;
+    float *in_, *w_, *out_, *columns_, *packed_;
+    float *bin_, *bw_, *bout_;
+
+    float *buffer(size_t n, float value) {
+        float *p = alloc(n);
+        std::fill(p, p + n, value);
+        buffers_.push_back(p);
+        return p;
+    }
+
+public:
+    explicit ConvBench(const conv2d::Shape &sh) : sh_(sh) {
+        in_ = buffer(sh.input_size(), 0.f);
+        for (size_t i = 0; i < sh.input_size(); ++i)
+            in_[i] = static_cast<float>(i % 13) * 0.1f - 0.6f;
+        w_ = buffer(sh.weight_size(), 0.f);
+        for (size_t i = 0; i < sh.weight_size(); ++i)
+            w_[i] = static_cast<float>(i % 7) * 0.05f - 0.15f;
+        out_ = buffer(sh.output_size(), 0.f);
+        columns_ = buffer(sh.columns_size(), 0.f);
+        packed_ = buffer(MM_BLOCK_SIZE * MM_BLOCK_SIZE, 0.f);
+        bin_ = buffer(sh.blocked_input_size(), 0.f);
+        bw_ = buffer(sh.blocked_weight_size(), 0.f);
+        bout_ = buffer(sh.blocked_output_size(), 0.f);
+        conv2d::reorder_input(sh, in_, bin_);
+        conv2d::reorder_weights(sh, w_, bw_);
+    }
+
+    ~ConvBench() {
+        for (float *p : buffers_)
+            free(p);
+    }
+
+    // ms per batch of one of im2col, im2col-gemm, direct, reorder
+    double measure(bench::Runner &runner, const std::string &layer,
+            const std::string &kernel) {
+        bench::Case c(kernel);
+        c.param("layer", layer).param("batch", sh_.n);
+        if (kernel == "im2col-gemm" || kernel == "direct")
+            c.set_ops(sh_.flops());
+        const bench::Result &r = runner.run(c, [&] {
+            if (kernel == "im2col") {
+                for (int n = 0; n < sh_.n; ++n)
+                    if (!sh_.pointwise())
+                        conv2d::im2col(sh_,
+                                in_ + static_cast<size_t>(n) * sh_.c * sh_.h
+                                        * sh_.w,
+                                columns_);
+            } else if (kernel == "im2col-gemm") {
+                conv2d::im2col_gemm(sh_, in_, w_, out_, columns_, packed_);
+            } else if (kernel == "direct") {
+                conv2d::direct(sh_, bin_, bw_, bout_);
+            } else {
+                conv2d::reorder_input(sh_, in_, bin_);
+                conv2d::reorder_output(sh_, bout_, out_);
+            }
+            bench::clobber_memory();
+        });
+        return 1e-6 * r.stats.median;
+    }
+
+    // the two paths agree
+    bool check() {
+        std::vector<float> blocked(sh_.output_size());
+        conv2d::im2col_gemm(sh_, in_, w_, out_, columns_, packed_);
+        conv2d::direct(sh_, bin_, bw_, bout_);
+        conv2d::reorder_output(sh_, bout_, blocked.data());
+        for (size_t i = 0; i < blocked.size(); ++i)
+            if (std::abs(blocked[i] - out_[i]) > 1e-3f * (1.f + std::abs(out_[i])))
+                return false;
+        return true;
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("conv2d", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+    int batch = opts.get_int("batch", 1, "images per batch");
+    std::string names = opts.get_string("layers",
+            "stem,res2-1x1,res2,res3-s2,res3,res4,res5", "layers to run");
+    if (opts.help()) return 0;
+
+    // n, c, h, w, k, r, s, stride, pad
+    const Layer layers[] = {
+            {"stem", {batch, 3, 224, 224, 64, 7, 7, 2, 3}},
+            {"res2-1x1", {batch, 256, 56, 56, 64, 1, 1, 1, 0}},
+            {"res2", {batch, 64, 56, 56, 64, 3, 3, 1, 1}},
+            {"res3-s2", {batch, 128, 56, 56, 128, 3, 3, 2, 1}},
+            {"res3", {batch, 128, 28, 28, 128, 3, 3, 1, 1}},
+            {"res4", {batch, 256, 14, 14, 256, 3, 3, 1, 1}},
+            {"res5", {batch, 512, 7, 7, 512, 3, 3, 1, 1}},
+    };
+
+    struct Row {
+        std::string layer;
+        double gflop;
+        double im2col_ms, gemm_path_ms, direct_ms, reorder_ms;
+        double tensors_mb, columns_mb;
+    };
+    std::vector<Row> rows;
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        const Layer *l = std::find_if(std::begin(layers), std::end(layers),
+                [&](const Layer &x) { return name == x.name; });
+        if (l == std::end(layers)) {
+            fprintf(stderr, "unknown layer %s\n", name.c_str());
+            continue;
+        }
+        const conv2d::Shape &sh = l->shape;
+        ConvBench cb(sh);
+        if (!cb.check()) fprintf(stderr, "%s: the two paths differ\n", l->name);
+        Row row;
+        row.layer = l->name;
+        row.gflop = sh.flops() * 1e-9;
+        row.im2col_ms = cb.measure(runner, l->name, "im2col");
+        row.gemm_path_ms = cb.measure(runner, l->name, "im2col-gemm");
+        row.direct_ms = cb.measure(runner, l->name, "direct");
+        row.reorder_ms = cb.measure(runner, l->name, "reorder");
+        row.tensors_mb = (sh.input_size() + sh.weight_size() + sh.output_size())
+                * sizeof(float) / 1048576.;
+        row.columns_mb = sh.columns_size() * sizeof(float) / 1048576.;
+        rows.push_back(row);
+    }
+
+    if (runner.format() == "text" && !rows.empty()) {
+        printf("\n%10s%8s%16s%9s%12s%16s%10s%16s\n", "layer", "GFLOP",
+                "im2col+gemm ms", "GF/s", "im2col %", "+columns MB",
+                "direct ms", "GF/s (+reorder)");
+        for (const auto &r : rows) {
+            char direct[32];
+            snprintf(direct, sizeof(direct), "%.1f (%.1f)",
+                    r.gflop / r.direct_ms * 1e3,
+                    r.gflop / (r.direct_ms + r.reorder_ms) * 1e3);
+            printf("%10s%8.3f%16.2f%9.1f%11.0f%%%9.1f/%-6.1f%10.2f%16s\n",
+                    r.layer.c_str(), r.gflop, r.gemm_path_ms,
+                    r.gflop / r.gemm_path_ms * 1e3,
+                    100. * r.im2col_ms / r.gemm_path_ms, r.columns_mb,
+                    r.tensors_mb, r.direct_ms, direct);
+        }
+        printf("(+columns MB: im2col buffer / input + weights + output)\n");
+    }
+    return 0;
+}
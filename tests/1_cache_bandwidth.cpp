@@ -5,77 +5,51 @@
 #include <iostream>
 #include <vector>
 
-#include "utils.hpp"
-
-/* Code to clear cache */
-/* This computer has 12288K L3 cache, which is 3072K ints */
-#define ASIZE ((1 << 21) + (1 << 20))
-static int stuff[ASIZE];
-static int sink;
-
-static void clear_cache() {
-    int x = sink;
-    for (int i = 0; i < ASIZE; i += 16 /*cache line size: 64bytes*/)
-        x += stuff[i];
-    sink = x;
-}
+#include "bench.hpp"
+#include "cache_state.hpp"
+#include "topology.hpp"
 
 using DTYPE = float;
 
-// L1 cache
-#define KB1 (1 << 10)
-#define KB2 (1 << 11)
-#define KB4 (1 << 12)
-#define KB8 (1 << 13)
-#define KB16 (1 << 14)
-#define KB32 (1 << 15)
-// L2 cache
-#define KB64 (1 << 16)
-#define KB96 ((1 << 16) + (1 << 15))
-#define KB128 (1 << 17)
-#define KB160 ((1 << 17) + (1 << 15))
-#define KB256 (1 << 18)
-// L3 cache
-#define KB512 (1 << 19)
-#define KB1024 (1 << 20)
-#define KB2048 (1 << 21)
-#define KB4096 (1 << 22)
-#define KB8192 (1 << 23)
-#define KB12288 ((1 << 23) + (1 << 22))
-// RAM
-#define KB16384 (1 << 24)
-#define KB32768 (1 << 25)
-
-// computer clock (Hz)
-// queried from `lscpu`
-#define CLOCK (3600 * 1e6)
-
-int main() {
-    // define size of working set
-    std::vector<size_t> working_set {/*L1*/ KB1, KB2, KB4, KB8, KB16, KB32,
-            /*L2*/ KB64, /*KB96,*/ KB128, /*KB160,*/ KB256, /*L3*/ KB512,
-            KB1024, KB2048, KB4096, KB8192, KB12288, /*RAM*/ KB16384, KB32768};
-
+int main(int argc, char **argv) {
+    bench::Runner runner("cache_bandwidth", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+    // define size of working set, in KiB, derived from the detected caches
+    // by default: powers of two plus every cache size up to 4x of the LLC
+    std::vector<long> working_set;
+    for (size_t ws : topo.working_sets(1024, 4))
+        working_set.push_back(ws / 1024);
+    working_set = opts.get_list(
+            "sizes-kb", working_set, "working set sizes in KiB");
+    size_t steps = opts.get_int("steps", 64 * 1024 * 1024,
+            "number of updates per working set");
+    cache_state::State state = cache_state::option(opts);
+    if (opts.help()) return 0;
+
+    // touch one element per cache line
+    const size_t stride = topo.line_size / sizeof(DTYPE);
     for (auto ws : working_set) {
-        size_t num_elem = ws / sizeof(DTYPE);
+        size_t num_elem = ws * 1024 / sizeof(DTYPE);
         std::vector<DTYPE> data(num_elem, 1.);
-        size_t len_mod = num_elem - 1;
-        size_t steps = 64 * 1024 * 1024;
-        clear_cache();
-        double start = ms_now();
-        for (int j = 0; j < steps; ++j) {
-            data[(j * 16) & len_mod]++;
-        }
-        double end = ms_now();
-        double time_per_element = (end - start) / (double)steps;
-        // memory size in KiB
-        double total_size = (double)(num_elem * sizeof(DTYPE)) /
-            (/*1KiB = */1024.0);
-        double cycles_per_element = (time_per_element / 1000.0) *
-            ((double)/*clock = */CLOCK);
-        printf("Working set size: %.2f KiB,clear cycles per element is %.4f \n",
-            total_size, cycles_per_element);
-        fflush(stdout);
+        cache_state::Buffers buffers(state);
+        buffers.add(data);
+        bench::Case c("update");
+        c.param("ws_kb", ws)
+                .param("level", topo.label(ws * 1024))
+                .param("cache", buffers.name());
+        c.set_ops(steps);
+        // cycles per element is reported by the harness from the TSC
+        runner.run(c, [&] { buffers.prepare(); }, [&] {
+            // wrap around instead of masking, so working sets need not be
+            // powers of two
+            size_t idx = 0;
+            for (size_t j = 0; j < steps; ++j) {
+                data[idx]++;
+                idx += stride;
+                if (idx >= num_elem) idx -= num_elem;
+            }
+        });
     }
     return 0;
 }
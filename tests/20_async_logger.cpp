@@ -0,0 +1,198 @@
+// This is to compare what logging costs the calling thread: the asynchronous
+// logger of async_logger.hpp against the two synchronous ways a program
+// usually logs, under several threads logging at once.
+//
+// Loggers, all writing the same line (time, thread, message) to --out:
+//  * async: ASYNC_LOG, a copy of the raw arguments into the ring of the
+//    thread; the background thread formats and writes with writev
+//  * fprintf: fprintf and fflush on a shared FILE (stdio locks the FILE)
+//  * cout: the line formatted into a per-thread ostringstream, written with
+//    one std::cout << and flushed, with stdout sent to --out
+// Every call is timed on its own with the time stamp counter; the table gives
+// the percentiles of the caller-side latency over all threads, and the time
+// per message of the whole run (for async including the final flush).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "async_logger.hpp"
+#include "bench.hpp"
+#include "thread_team.hpp"
+#include "utils.hpp"
+
+struct Row {
+    std::string logger;
+    double p50, p99, p999, max;
+    double ns_per_message;
+    uint64_t dropped;
+};
+
+class LogBench {
+private:
+    thread_team::ThreadTeam &team_;
+    size_t messages_;
+    std::string out_;
+    // caller-side ticks of every call of every thread, last repetition
+    std::vector<std::vector<uint64_t>> ticks_;
+
+    void clear() {
+        for (auto &t : ticks_)
+            t.clear();
+    }
+
+    // time each call of log(tid, i) on every thread
+    template <typename Log>
+    void run(Log log) {
+        team_.run([&](int tid) {
+            std::vector<uint64_t> &ticks = ticks_[tid];
+            for (size_t i = 0; i < messages_; ++i) {
+                uint64_t t0 = tsc_begin();
+                log(tid, static_cast<int>(i));
+                uint64_t t1 = tsc_end();
+                ticks.push_back(t1 - t0);
+            }
+        });
+    }
+
+    void percentiles(Row &row) const {
+        std::vector<uint64_t> all;
+        for (const auto &t : ticks_)
+            all.insert(all.end(), t.begin(), t.end());
+        if (all.empty()) return;
+        std::sort(all.begin(), all.end());
+        double ns_per_tick = 1. / tsc_ghz();
+        // nearest rank
+        auto at = [&](double q) {
+            size_t rank = static_cast<size_t>(std::ceil(q * all.size()));
+            return all[std::max<size_t>(rank, 1) - 1] * ns_per_tick;
+        };
+        row.p50 = at(0.5);
+        row.p99 = at(0.99);
+        row.p999 = at(0.999);
+        row.max = all.back() * ns_per_tick;
+    }
+
+public:
+    LogBench(thread_team::ThreadTeam &team, size_t messages,
+            const std::string &out)
+        : team_(team), messages_(messages), out_(out), ticks_(team.size()) {
+        for (auto &t : ticks_)
+            t.reserve(messages);
+    }
+
+    Row measure(bench::Runner &runner, const std::string &logger) {
+        Row row {logger, 0., 0., 0., 0., 0., 0};
+        bench::Case c(logger);
+        c.param("threads", team_.size())
+                .param("messages", messages_)
+                .set_ops(static_cast<double>(messages_) * team_.size());
+        int fd = open(out_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            perror(out_.c_str());
+            return row;
+        }
+        const char *tags[] = {"worker0", "worker1", "worker2", "worker3"};
+        uint64_t start = ns_now();
+        auto seconds = [&] { return (ns_now() - start) * 1e-9; };
+        const bench::Result *r = nullptr;
+        if (logger == "async") {
+            async_log::Logger log(fd);
+            r = &runner.run(c, [&] { clear(); }, [&] {
+                run([&](int tid, int i) {
+                    ASYNC_LOG(log, "%s i=%d x=%.1f c=%c", tags[tid % 4], i,
+                            0.5 * i, 'a' + tid % 26);
+                });
+                log.flush();
+            });
+            row.dropped = log.dropped();
+        } else if (logger == "fprintf") {
+            FILE *f = fdopen(dup(fd), "a");
+            r = &runner.run(c, [&] { clear(); }, [&] {
+                run([&](int tid, int i) {
+                    fprintf(f, "%.6f [%d] %s i=%d x=%.1f c=%c\n", seconds(),
+                            tid, tags[tid % 4], i, 0.5 * i, 'a' + tid % 26);
+                    fflush(f);
+                });
+            });
+            fclose(f);
+        } else if (logger == "cout") {
+            // stdout goes to the sink while the loggers run, back to the
+            // terminal before the runner reports
+            std::cout.flush();
+            fflush(stdout);
+            int saved = dup(STDOUT_FILENO);
+            r = &runner.run(c,
+                    [&] {
+                        clear();
+                        dup2(fd, STDOUT_FILENO);
+                    },
+                    [&] {
+                        run([&](int tid, int i) {
+                            // the format state of std::cout is shared, each
+                            // thread formats its own line
+                            thread_local std::ostringstream line;
+                            line.str("");
+                            line << std::fixed << std::setprecision(6)
+                                 << seconds() << " [" << tid << "] "
+                                 << tags[tid % 4] << " i=" << i << " x="
+                                 << std::setprecision(1) << 0.5 * i << " c="
+                                 << static_cast<char>('a' + tid % 26) << '\n';
+                            std::cout << line.str() << std::flush;
+                        });
+                    },
+                    [&] {
+                        std::cout.flush();
+                        dup2(saved, STDOUT_FILENO);
+                    });
+            close(saved);
+        } else {
+            fprintf(stderr, "unknown logger %s\n", logger.c_str());
+        }
+        close(fd);
+        if (!r) return row;
+        row.ns_per_message = r->metric("ns/op");
+        percentiles(row);
+        return row;
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("async_logger", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    int threads = opts.get_int("threads", 4, "logging threads");
+    size_t messages = opts.get_int("messages", 10000, "messages per thread");
+    std::string out = opts.get_string("out", "/dev/null", "file to log to");
+    std::string loggers_str = opts.get_string(
+            "loggers", "async,fprintf,cout", "async, fprintf and/or cout");
+    if (opts.help()) return 0;
+
+    thread_team::ThreadTeam team(threads);
+    LogBench lb(team, messages, out);
+    std::vector<Row> rows;
+    std::stringstream ss(loggers_str);
+    std::string logger;
+    while (std::getline(ss, logger, ','))
+        rows.push_back(lb.measure(runner, logger));
+
+    if (runner.format() == "text" && !rows.empty()) {
+        printf("\n%10s%10s%10s%10s%12s%12s%10s\n", "logger", "p50 ns",
+                "p99 ns", "p99.9 ns", "max ns", "ns/message", "dropped");
+        for (const auto &r : rows)
+            printf("%10s%10.0f%10.0f%10.0f%12.0f%12.1f%10llu\n",
+                    r.logger.c_str(), r.p50, r.p99, r.p999, r.max,
+                    r.ns_per_message,
+                    static_cast<unsigned long long>(r.dropped));
+        printf("(%d threads x %zu messages to %s)\n", team.size(), messages,
+                out.c_str());
+    }
+    return 0;
+}
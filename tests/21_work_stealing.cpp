@@ -0,0 +1,232 @@
+// This is to measure what the work-stealing scheduler of work_stealing.hpp
+// costs, and what it buys over the static chunks of ThreadTeam.
+//
+// Overheads:
+//  * spawn: a TaskGroup spawns --tasks empty tasks and waits, ns per task
+//  * small: parallel_for over --sizes elements of trivial work with grain 1,
+//    against one ThreadTeam::run with static chunks and a plain loop; ns
+//    per call, so the fixed cost of going parallel shows
+// Load balance on --items items whose cost varies (--work):
+//  * uniform: every item costs the same
+//  * linear: item i costs in proportion to i, a triangular loop
+//  * clustered: 1 in 16 items costs 64 times more, all in one stretch
+// Each item is scheduled by static chunking and by parallel_for with every
+// --grains. The table gives ms and the balance, the most work any thread did
+// over the mean: the time on one core per thread is at least balance x the
+// ideal, whatever the measured ms on fewer cores.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "sharded_counter.hpp"
+#include "thread_team.hpp"
+#include "topology.hpp"
+#include "work_stealing.hpp"
+
+// units dependent multiply-adds, a few ns each
+static double burn(size_t units, double x) {
+    for (size_t i = 0; i < units; ++i)
+        x = x * 0.999999 + 0.5;
+    return x;
+}
+
+struct Row {
+    std::string work;
+    std::string schedule;
+    double ms;
+    double balance;
+    uint64_t steals;
+};
+
+class Balance {
+private:
+    int threads_;
+    work_stealing::Scheduler &sched_;
+    std::vector<size_t> cost_;
+    size_t total_ {0};
+    // work units done by every thread in the last run
+    std::vector<concurrent::padded<size_t>> done_;
+
+    double run_items(size_t b, size_t e) {
+        double x = 0.;
+        size_t units = 0;
+        for (size_t i = b; i < e; ++i) {
+            x = burn(cost_[i], x);
+            units += cost_[i];
+        }
+        bench::do_not_optimize(x);
+        return static_cast<double>(units);
+    }
+
+    double balance() const {
+        size_t most = 0;
+        for (const auto &d : done_)
+            most = std::max(most, *d);
+        return static_cast<double>(most) * done_.size() / total_;
+    }
+
+public:
+    Balance(int threads, work_stealing::Scheduler &sched,
+            const std::string &work, size_t items, size_t unit)
+        : threads_(threads), sched_(sched), cost_(items),
+          done_(std::max(threads, sched.size())) {
+        for (size_t i = 0; i < items; ++i) {
+            if (work == "linear")
+                cost_[i] = unit * 2 * (i + 1) / items;
+            else if (work == "clustered")
+                cost_[i] = (i >= items / 4 && i < items / 4 + items / 16)
+                        ? 64 * unit
+                        : unit;
+            else
+                cost_[i] = unit;
+            total_ += cost_[i];
+        }
+    }
+
+    Row measure(bench::Runner &runner, const std::string &work, size_t grain) {
+        Row row {work, grain ? "steal/" + std::to_string(grain) : "static",
+                0., 0., 0};
+        bench::Case c(grain ? "steal" : "static");
+        c.param("work", work).param("items", cost_.size()).param("grain", grain);
+        auto reset = [&] {
+            for (auto &d : done_)
+                *d = 0;
+            sched_.reset_stats();
+        };
+        // the team only while it is measured, its idle threads spin
+        std::unique_ptr<thread_team::ThreadTeam> team;
+        if (grain == 0) team.reset(new thread_team::ThreadTeam(threads_));
+        const bench::Result &r = runner.run(c, reset, [&] {
+            if (grain == 0) {
+                team->run([&](int tid) {
+                    auto range = thread_team::chunk(
+                            cost_.size(), tid, team->size());
+                    *done_[tid] += static_cast<size_t>(
+                            run_items(range.first, range.second));
+                });
+            } else {
+                sched_.parallel_for(0, cost_.size(), grain,
+                        [&](size_t b, size_t e) {
+                            *done_[sched_.worker_index()] +=
+                                    static_cast<size_t>(run_items(b, e));
+                        });
+            }
+        });
+        row.ms = 1e-6 * r.stats.median;
+        row.balance = balance();
+        for (int w = 0; w < sched_.size(); ++w)
+            row.steals += sched_.steals(w);
+        return row;
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("work_stealing", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+    int threads = opts.get_int(
+            "threads", static_cast<int>(topo.cpus.size()), "workers");
+    size_t tasks = opts.get_int("tasks", 100000, "empty tasks to spawn");
+    std::vector<long> sizes = opts.get_list(
+            "sizes", {1, 16, 256, 4096, 65536}, "small parallel_for ranges");
+    size_t items = opts.get_int("items", 4096, "items of irregular work");
+    size_t unit = opts.get_int("unit", 256, "work units of an average item");
+    std::string work_str = opts.get_string(
+            "work", "uniform,linear,clustered", "cost of the items");
+    std::vector<long> grains = opts.get_list(
+            "grains", {1, 16, 256}, "parallel_for grain sizes");
+    if (opts.help()) return 0;
+
+    work_stealing::Scheduler sched(threads);
+
+    // the cost of a task
+    bench::Case spawn("spawn");
+    spawn.param("threads", sched.size()).param("tasks", tasks).set_ops(tasks);
+    double spawn_ns = runner.run(spawn, [&] {
+        work_stealing::TaskGroup g(sched);
+        for (size_t i = 0; i < tasks; ++i)
+            g.spawn([] {});
+        g.wait();
+    }).metric("ns/op");
+
+    // the fixed cost of a parallel loop
+    std::vector<double> data(*std::max_element(sizes.begin(), sizes.end()), 1.);
+    struct Small {
+        long n;
+        double loop_ns, team_ns, steal_ns;
+    };
+    std::vector<Small> small;
+    for (long n : sizes) {
+        auto sum = [&](size_t b, size_t e) {
+            double s = 0.;
+            for (size_t i = b; i < e; ++i)
+                s += data[i];
+            bench::do_not_optimize(s);
+        };
+        Small row {n, 0., 0., 0.};
+        bench::Case c("loop");
+        c.param("n", n);
+        row.loop_ns = runner.run(c, [&] { sum(0, n); }).stats.median;
+        {
+            thread_team::ThreadTeam team(threads);
+            c = bench::Case("team");
+            c.param("n", n).param("threads", team.size());
+            row.team_ns = runner.run(c, [&] {
+                team.run([&](int tid) {
+                    auto range = thread_team::chunk(n, tid, team.size());
+                    sum(range.first, range.second);
+                });
+            }).stats.median;
+        }
+        c = bench::Case("parallel_for");
+        c.param("n", n).param("threads", sched.size()).param("grain", 1);
+        row.steal_ns = runner.run(c, [&] {
+            sched.parallel_for(0, n, 1, sum);
+        }).stats.median;
+        small.push_back(row);
+    }
+
+    // load balance on irregular work
+    std::vector<Row> rows;
+    std::stringstream ss(work_str);
+    std::string work;
+    while (std::getline(ss, work, ',')) {
+        if (work != "uniform" && work != "linear" && work != "clustered") {
+            fprintf(stderr, "unknown work %s\n", work.c_str());
+            continue;
+        }
+        Balance bal(threads, sched, work, items, unit);
+        rows.push_back(bal.measure(runner, work, 0));
+        for (long g : grains)
+            if (g > 0) rows.push_back(bal.measure(runner, work, g));
+    }
+
+    if (runner.format() == "text") {
+        printf("\nspawn: %.1f ns per empty task (%d workers)\n", spawn_ns,
+                sched.size());
+        printf("\n%10s%12s%12s%16s\n", "n", "loop ns", "team ns",
+                "parallel_for ns");
+        for (const auto &r : small)
+            printf("%10ld%12.0f%12.0f%16.0f\n", r.n, r.loop_ns, r.team_ns,
+                    r.steal_ns);
+        if (!rows.empty()) {
+            printf("\n%10s%12s%10s%10s%10s\n", "work", "schedule", "ms",
+                    "balance", "steals");
+            for (const auto &r : rows)
+                printf("%10s%12s%10.2f%10.2f%10llu\n", r.work.c_str(),
+                        r.schedule.c_str(), r.ms, r.balance,
+                        static_cast<unsigned long long>(r.steals));
+            printf("(%zu items, %d threads; balance: most work of a thread / "
+                   "mean)\n",
+                    items, threads);
+        }
+    }
+    return 0;
+}
@@ -3,47 +3,41 @@
 #include <algorithm>
 #include <vector>
 
-#include "utils.hpp"
-
-/* Code to clear cache */
-/* This computer has 12288K L3 cache, which is 3072K ints */
-#define ASIZE ((1 << 21) + (1 << 20))
-static int stuff[ASIZE];
-static int sink;
-
-static void clear_cache() {
-    int x = sink;
-    for (int i = 0; i < ASIZE; i += 16 /*cache line size: 64bytes*/)
-        x += stuff[i];
-    sink = x;
-}
-
-#define NUM_ITERS (200)
-#define NUM_ELEM (16 * 1024 * 1024)
+#include "bench.hpp"
+#include "cache_state.hpp"
+#include "topology.hpp"
 
 using DTYPE = float;
 
-void run(std::vector<DTYPE> &src) {
+void run(bench::Runner &runner, std::vector<DTYPE> &src,
+        const std::vector<long> &steps, cache_state::State state) {
+    cache_state::Buffers buffers(state);
+    buffers.add(src);
     // different skipping steps
-    std::vector<size_t> steps {1, 2, 4, 8, 16, 32, 64, 128, 256};
     for (size_t s : steps) {
-        double total_time = 0.;
-        // iterations
-        for (size_t i = 0; i < static_cast<size_t>(NUM_ITERS); ++i) {
-            clear_cache();
-            double start = ms_now();
-            for (size_t n = 0; n < static_cast<size_t>(NUM_ELEM); n += s) {
+        bench::Case c("stride");
+        c.param("step_bytes", s * sizeof(DTYPE))
+                .param("cache", buffers.name())
+                .set_ops(src.size() / s);
+        runner.run(c, [&] { buffers.prepare(); }, [&] {
+            for (size_t n = 0; n < src.size(); n += s) {
                 src[n] += 1.1;
             }
-            total_time += (ms_now() - start);
-        }
-        std::cout << "Step: " << (s * sizeof(DTYPE)) << "bytes, time cost: "
-            << (total_time / NUM_ITERS) << " msec\n";
+        });
     }
 }
 
-int main() {
-    std::vector<DTYPE> data(NUM_ELEM, 1);
-    run(data);
+int main(int argc, char **argv) {
+    bench::Runner runner("cache_line", argc, argv, /*reps=*/20);
+    auto &opts = runner.options();
+    size_t num_elem = opts.get_int("elems", 16 * 1024 * 1024,
+            "number of floats in the array");
+    std::vector<long> steps = opts.get_list("steps",
+            {1, 2, 4, 8, 16, 32, 64, 128, 256}, "element steps");
+    cache_state::State state = cache_state::option(opts);
+    if (opts.help()) return 0;
+
+    std::vector<DTYPE> data(num_elem, 1);
+    run(runner, data, steps, state);
     return 0;
-}
\ No newline at end of file
+}
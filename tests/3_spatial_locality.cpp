@@ -2,23 +2,15 @@
 // performance
 
 #include <iostream>
+#include <string>
 #include <vector>
 #include <algorithm>
 
-#include "utils.hpp"
-
-/* Code to clear cache */
-/* This computer has 12288K L3 cache, which is 3072K ints */
-#define ASIZE ((1 << 21) + (1 << 20))
-static int stuff[ASIZE];
-static int sink;
-
-static void clear_cache() {
-    int x = sink;
-    for (int i = 0; i < ASIZE; i += 16 /*cache line size: 64bytes*/)
-        x += stuff[i];
-    sink = x;
-}
+#include "bench.hpp"
+#include "cache_state.hpp"
+#include "matmul_kernels.hpp"
+#include "mem_ops.hpp"
+#include "topology.hpp"
 
 using DTYPE = float;
 
@@ -31,152 +23,66 @@ private:
     std::vector<DTYPE> B_;
     std::vector<DTYPE> C_;
     // total number of innermost loops
-    int iters_;
+    double iters_;
+    // cache state of A, B and C before each run
+    cache_state::Buffers buffers_;
 
     void reset() {
-        std::fill(C_.begin(), C_.end(), 0);
+        mem_ops::fill(C_.data(), 0, C_.size() * sizeof(DTYPE));
     }
 
 public:
-    matmul(int n) : n_(n) {
-        iters_ = n_ * n_ * n_;
+    matmul(int n, cache_state::State state = cache_state::FLUSHED)
+        : n_(n), buffers_(state) {
+        iters_ = (double)n_ * n_ * n_;
         A_ = std::vector<DTYPE>(n_ * n_, 1);
         B_ = std::vector<DTYPE>(n_ * n_, 1);
         C_ = std::vector<DTYPE>(n_ * n_, 0);
+        buffers_.add(A_).add(B_).add(C_);
     }
 
-    // loop M -> loop N -> loop K
-    void mnk() {
-        reset();
-        clear_cache();
-        double start = ms_now();
-        for (int i = 0; i < n_; ++i) {
-            for (int j = 0; j < n_; ++j) {
-                DTYPE sum = 0.;
-                for (int k = 0; k < n_; ++k) {
-                    sum += A_[i * n_ + k] * B_[k * n_ + j]; 
-                }
-                C_[i * n_ + j] = sum;
-            }
-        }
-        double elapsed = ms_now() - start;
-        printf("version: mnk, latency: %.2f ms, "
-            "time per innermost iter: %.2f ns\n", elapsed,
-            (elapsed / (double)iters_) * 1e6);
-        fflush(stdout);
-    }
-
-    // loop N -> loop M -> loop K
-    void nmk() {
-        reset();
-        clear_cache();
-        double start = ms_now();
-        for (int j = 0; j < n_; ++j) {
-            for (int i = 0; i < n_; ++i) {
-                DTYPE sum = 0.;
-                for (int k = 0; k < n_; ++k) {
-                    sum += A_[i * n_ + k] * B_[k * n_ + j]; 
-                }
-                C_[i * n_ + j] = sum;
-            }
-        }
-        double elapsed = ms_now() - start;
-        printf("version: nmk, latency: %.2f ms, "
-            "time per innermost iter: %.2f ns\n", elapsed,
-            (elapsed / (double)iters_) * 1e6);
-        fflush(stdout);
-    }
-
-    // loop N -> loop K -> loop M
-    void nkm() {
-        reset();
-        clear_cache();
-        double start = ms_now();
-        for (int j = 0; j < n_; ++j) {
-            for (int k = 0; k < n_; ++k) {
-                DTYPE tmp = B_[k * n_ + j];
-                for (int i = 0; i < n_; ++i) {
-                    C_[i * n_ + j] += A_[i * n_ + k] * tmp;
-                }
-            }
-        }
-        double elapsed = ms_now() - start;
-        printf("version: nkm, latency: %.2f ms, "
-            "time per innermost iter: %.2f ns\n", elapsed,
-            (elapsed / (double)iters_) * 1e6);
-        fflush(stdout);
-    }
-
-    // loop K -> loop N -> loop M
-    void knm() {
-        reset();
-        clear_cache();
-        double start = ms_now();
-        for (int k = 0; k < n_; ++k) {
-            for (int j = 0; j < n_; ++j) {
-                DTYPE tmp = B_[k * n_ + j];
-                for (int i = 0; i < n_; ++i) {
-                    C_[i * n_ + j] += A_[i * n_ + k] * tmp;
-                }
-            }
-        }
-        double elapsed = ms_now() - start;
-        printf("version: knm, latency: %.2f ms, "
-            "time per innermost iter: %.2f ns\n", elapsed,
-            (elapsed / (double)iters_) * 1e6);
-        fflush(stdout);
-    }
-
-    // loop K -> loop M -> loop N
-    void kmn() {
-        reset();
-        clear_cache();
-        double start = ms_now();
-        for (int k = 0; k < n_; ++k) {
-            for (int i = 0; i < n_; ++i) {
-                DTYPE tmp = A_[i * n_ + k];
-                for (int j = 0; j < n_; ++j) {
-                    C_[i * n_ + j] += tmp * B_[k * n_ + j];
-                }
-            }
-        }
-        double elapsed = ms_now() - start;
-        printf("version: kmn, latency: %.2f ms, "
-            "time per innermost iter: %.2f ns\n", elapsed,
-            (elapsed / (double)iters_) * 1e6);
-        fflush(stdout);
-    }
-
-    // loop M -> loop K -> loop N
+    // the loop orders, see matmul_kernels.hpp
+    void mnk() { matmul_kernels::mnk(A_.data(), B_.data(), C_.data(), n_); }
+    void nmk() { matmul_kernels::nmk(A_.data(), B_.data(), C_.data(), n_); }
+    void nkm() { matmul_kernels::nkm(A_.data(), B_.data(), C_.data(), n_); }
+    void knm() { matmul_kernels::knm(A_.data(), B_.data(), C_.data(), n_); }
+    void kmn() { matmul_kernels::kmn(A_.data(), B_.data(), C_.data(), n_); }
     // best spatial locality
-    void mkn() {
-        reset();
-        clear_cache();
-        double start = ms_now();
-        for (int i = 0; i < n_; ++i) {
-            for (int k = 0; k < n_; ++k) {
-                DTYPE tmp = A_[i * n_ + k];
-                for (int j = 0; j < n_; ++j) {
-                    C_[i * n_ + j] += tmp * B_[k * n_ + j];
-                }
-            }
-        }
-        double elapsed = ms_now() - start;
-        printf("version: mkn, latency: %.2f ms, "
-            "time per innermost iter: %.2f ns\n", elapsed,
-            (elapsed / (double)iters_) * 1e6);
-        fflush(stdout);
+    void mkn() { matmul_kernels::mkn(A_.data(), B_.data(), C_.data(), n_); }
+
+    // time one loop order, ops are innermost iterations
+    void run(bench::Runner &runner, const std::string &version) {
+        bench::Case c(version);
+        c.param("n", n_).param("cache", buffers_.name()).set_ops(iters_);
+        auto setup = [this] {
+            reset();
+            buffers_.prepare();
+        };
+        if (version == "mnk") runner.run(c, setup, [this] { mnk(); });
+        else if (version == "nmk") runner.run(c, setup, [this] { nmk(); });
+        else if (version == "nkm") runner.run(c, setup, [this] { nkm(); });
+        else if (version == "knm") runner.run(c, setup, [this] { knm(); });
+        else if (version == "kmn") runner.run(c, setup, [this] { kmn(); });
+        else if (version == "mkn") runner.run(c, setup, [this] { mkn(); });
+        else fprintf(stderr, "unknown version %s\n", version.c_str());
     }
 };
 
-int main() {
-    // [1024x1024] x [1024x1024]
-    matmul mm(1024);
-    mm.mnk();
-    mm.nmk();
-    mm.nkm();
-    mm.knm();
-    mm.kmn();
-    mm.mkn();
+int main(int argc, char **argv) {
+    bench::Runner runner("spatial_locality", argc, argv, /*reps=*/1,
+            /*warmup=*/0);
+    auto &opts = runner.options();
+    int n = opts.get_int("n", 1024, "matrix dimension");
+    std::string versions = opts.get_string("versions",
+            "mnk,nmk,nkm,knm,kmn,mkn", "comma separated loop orders");
+    cache_state::State state = cache_state::option(opts);
+    if (opts.help()) return 0;
+
+    // [n x n] x [n x n]
+    matmul mm(n, state);
+    std::stringstream ss(versions);
+    std::string v;
+    while (std::getline(ss, v, ','))
+        mm.run(runner, v);
     return 0;
-}
\ No newline at end of file
+}
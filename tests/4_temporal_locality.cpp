@@ -2,24 +2,16 @@
 // performance
 
 #include <iostream>
-#include <random>
 #include <vector>
 
-#include "utils.hpp"
-
-/* Code to clear cache */
-/* This computer has 12288K L3 cache, which is 3072K ints */
-#define NUM_INTS_IN_L3_CACHE ((1 << 21) + (1 << 20))
+#include "bench.hpp"
+#include "cache_state.hpp"
+#include "matmul_kernels.hpp"
+#include "mem_ops.hpp"
+#include "topology.hpp"
 
 using DTYPE = float;
 
-// This size should be:
-//  - not too large, make sure (2 * BLOCK_SIZE + BLOCK_SIZE^2) is smaller than
-//      the size of L1 cache
-//  - not too small, make full use of L1 cache and improve temporal locality
-//      as much as possible
-#define BLOCK_SIZE (64)
-
 class block_matmul {
 private:
     // dimensions
@@ -29,74 +21,60 @@ private:
     std::vector<DTYPE> B_;
     std::vector<DTYPE> C_;
     // total number of iterations for the three loops
-    int iters_;
+    double iters_;
+    // cache state of A, B and C before each run
+    cache_state::Buffers buffers_;
 
     void reset() {
-        std::fill(C_.begin(), C_.end(), 0);
-    }
-
-    void clear_cache() {
-        int array[NUM_INTS_IN_L3_CACHE];
-        std::random_device gen;
-        std::uniform_int_distribution<int> dist(0, 10);
-        for (int i = 0; i < NUM_INTS_IN_L3_CACHE; ++i)
-            array[i] = dist(gen);
-    }
-
-    // pack sub-block of B_ into a matrix that is small enough to be
-    // stored into L1 cache
-    void packBMatrix(DTYPE *dst, DTYPE *src) {
-        for (int i = 0; i < BLOCK_SIZE; ++i) {
-            for (int j = 0; j < BLOCK_SIZE; ++j) {
-                *(dst + i * BLOCK_SIZE + j) = *(src + i * n_ + j);
-            }
-        }
+        mem_ops::fill(C_.data(), 0, C_.size() * sizeof(DTYPE));
     }
 
 public:
-    block_matmul(int n) : n_(n) {
-        iters_ = n_ * n_ * n_;
+    block_matmul(int n, cache_state::State state = cache_state::FLUSHED)
+        : n_(n), buffers_(state) {
+        iters_ = (double)n_ * n_ * n_;
         A_ = std::vector<DTYPE>(n_ * n_, 1);
         B_ = std::vector<DTYPE>(n_ * n_, 1);
         C_ = std::vector<DTYPE>(n_ * n_, 0);
+        buffers_.add(A_).add(B_).add(C_);
     }
 
-    // loop K -> loop N -> loop M
+    // loop K -> loop N -> loop M on blocks, sub-blocks of B_ are packed into
+    // a buffer that is small enough to be stored into L1 cache
     void knm() {
-        reset();
-        clear_cache();
-        DTYPE packed_B[BLOCK_SIZE * BLOCK_SIZE];
-        double start = ms_now();
-        for (int k = 0; k < n_; k += BLOCK_SIZE) {
-            for (int j = 0; j < n_; j += BLOCK_SIZE) {
-                // pack B
-                packBMatrix(&packed_B[0], &B_[k * n_ + j]);
-                for (int i = 0; i < n_; ++i) {
-                    for (int kk = k; kk < k + BLOCK_SIZE; ++kk) {
-                        float tmp = A_[i * n_ + kk];
-                        for (int jj = j; jj < j + BLOCK_SIZE; ++jj) {
-                            C_[i * n_ + jj] += tmp
-                                    * packed_B[(kk - k) * BLOCK_SIZE
-                                            + (jj - j)];
-                            // may introduce more page faults if directly access
-                            // memory from B_
-                            // C_[i * n_ + jj] += tmp * B_[kk * n_ + jj];
-                        }
-                    }
-                }
-            }
-        }
-        double elapsed = ms_now() - start;
-        printf("version: block-knm, latency: %.2f ms, "
-            "time per innermost iter: %.2f ns\n", elapsed,
-                (elapsed / (double)iters_) * 1e6);
-        fflush(stdout);
+        DTYPE packed_B[MM_BLOCK_SIZE * MM_BLOCK_SIZE];
+        matmul_kernels::block_knm(
+                A_.data(), B_.data(), C_.data(), &packed_B[0], n_);
     }
 
+    void run(bench::Runner &runner) {
+        bench::Case c("block-knm");
+        c.param("n", n_)
+                .param("block", MM_BLOCK_SIZE)
+                .param("cache", buffers_.name())
+                .set_ops(iters_);
+        runner.run(
+                c,
+                [this] {
+                    reset();
+                    buffers_.prepare();
+                },
+                [this] { knm(); });
+    }
 };
 
-int main() {
-    block_matmul block_mm(1024);
-    block_mm.knm();
+int main(int argc, char **argv) {
+    bench::Runner runner("temporal_locality", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    int n = opts.get_int("n", 1024, "matrix dimension, multiple of 64");
+    cache_state::State state = cache_state::option(opts);
+    if (opts.help()) return 0;
+    if (n % MM_BLOCK_SIZE != 0) {
+        fprintf(stderr, "n must be a multiple of %d\n", MM_BLOCK_SIZE);
+        return 1;
+    }
+
+    block_matmul block_mm(n, state);
+    block_mm.run(runner);
     return 0;
 }
@@ -1,73 +1,288 @@
 // This example aims to benchmark the impact of page fault on the effectiveness
 // of accessing memory
+//
+// The suite separates three costs that the strided loop mixes together:
+//  * strided: the original loop, cache misses, TLB misses and prefetching
+//  * first-touch: page fault cost of a fresh mapping, per 4 KiB page
+//  * tlb: steady-state dependent loads, one random line per page, over spans
+//    that exceed the L1 dTLB and STLB reach. Only one line per page is used,
+//    so the cache footprint stays span / 64 and TLB misses dominate
+// for each backing: 4 KiB pages, transparent huge pages (THP) and hugetlbfs.
 
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <random>
+#include <string>
 #include <vector>
 
-#include "utils.hpp"
+#include <sys/mman.h>
 
-/* Code to clear cache */
-/* This computer has 12288K L3 cache, which is 3072K ints */
-#define NUM_INTS_IN_L3_CACHE ((1 << 21) + (1 << 20))
-
-// Maximum number of steps to run
-#define MAX_NUM_ITERS (64 * 1024 * 1024)
+#include "bench.hpp"
+#include "cache_state.hpp"
+#include "topology.hpp"
 
 using DTYPE = float;
 
+#define PAGE_4K (4096ul)
+#define PAGE_2M (2ul * 1024 * 1024)
+
+// anonymous mapping with a given page backing: "4k", "thp" or "hugetlb"
+class Mapping {
+private:
+    void *base_ {MAP_FAILED};
+    size_t mapped_ {0};
+    char *data_ {nullptr};
+
+public:
+    Mapping(size_t bytes, const std::string &backing) {
+        if (backing == "hugetlb") {
+#ifdef MAP_HUGETLB
+            mapped_ = (bytes + PAGE_2M - 1) / PAGE_2M * PAGE_2M;
+            base_ = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            data_ = static_cast<char *>(base_);
+#endif
+        } else if (backing == "thp") {
+            // over-allocate so the data starts on a 2 MiB boundary
+            mapped_ = (bytes + PAGE_2M - 1) / PAGE_2M * PAGE_2M + PAGE_2M;
+            base_ = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base_ != MAP_FAILED) {
+                uintptr_t p = reinterpret_cast<uintptr_t>(base_);
+                p = (p + PAGE_2M - 1) / PAGE_2M * PAGE_2M;
+                data_ = reinterpret_cast<char *>(p);
+                madvise(data_, mapped_ - PAGE_2M, MADV_HUGEPAGE);
+            }
+        } else {
+            mapped_ = (bytes + PAGE_4K - 1) / PAGE_4K * PAGE_4K;
+            base_ = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base_ != MAP_FAILED) {
+                data_ = static_cast<char *>(base_);
+                madvise(data_, mapped_, MADV_NOHUGEPAGE);
+            }
+        }
+        if (base_ == MAP_FAILED) data_ = nullptr;
+    }
+
+    ~Mapping() {
+        if (base_ != MAP_FAILED) munmap(base_, mapped_);
+    }
+
+    Mapping(const Mapping &) = delete;
+    Mapping &operator=(const Mapping &) = delete;
+
+    bool valid() const { return data_ != nullptr; }
+    char *data() { return data_; }
+};
+
 template <typename T>
 class BenchPageFault {
 private:
     std::vector<T> data_ {};
     // number of elements, a square array
     int num_elem_;
-    // number of benchmark iterations
-    int num_iter_;
+    // number of accesses per step size
+    size_t num_iter_;
+    // cache state of the array before each step size
+    cache_state::Buffers buffers_;
 
     void reset() {
         data_ = std::vector<T>(num_elem_ * num_elem_);
         T count = static_cast<T>(10);
         std::generate(
                 data_.begin(), data_.end(), [&count](void) { return count++; });
-    }
-
-    void clear_cache() {
-        int array[NUM_INTS_IN_L3_CACHE];
-        std::mt19937 gen;
-        std::uniform_int_distribution<int> dist(0, 10);
-        for (int i = 0; i < NUM_INTS_IN_L3_CACHE; ++i)
-            array[i] = dist(gen);
+        buffers_.clear();
+        buffers_.add(data_);
     }
 
 public:
-    BenchPageFault(int num_elem, int num_iter)
-        : num_elem_(num_elem), num_iter_(num_iter) {
+    BenchPageFault(int num_elem, size_t num_iter,
+            cache_state::State state = cache_state::FLUSHED)
+        : num_elem_(num_elem), num_iter_(num_iter), buffers_(state) {
         reset();
     }
 
-    void run() {
-        std::vector<size_t> step {100, 500, 2000};
+    void run(bench::Runner &runner, const std::vector<long> &step) {
         size_t len_mod = data_.size() - 1;
-        for (auto s : step) {
-            clear_cache();
-            double start = ms_now();
-            for (size_t i = 0; i < static_cast<size_t>(MAX_NUM_ITERS); ++i) {
-                data_[(i * s) & len_mod]++;
-            }
-            double elapsed = ms_now() - start;
-            printf("step size: %ld bytes, total time: %.6f msec, "
-                   "latency per access: %.6f ns\n",
-                    s * sizeof(T), elapsed,
-                    elapsed / (double)MAX_NUM_ITERS * 1e6f);
-            fflush(stdout);
+        for (size_t s : step) {
+            bench::Case c("strided");
+            c.param("step_bytes", s * sizeof(T))
+                    .param("cache", buffers_.name())
+                    .set_ops(num_iter_);
+            runner.run(
+                    c, [this] { buffers_.prepare(); },
+                    [&] {
+                        for (size_t i = 0; i < num_iter_; ++i) {
+                            data_[(i * s) & len_mod]++;
+                        }
+                    });
+        }
+    }
+};
+
+// page fault cost of touching a fresh mapping once per 4 KiB page
+class BenchFirstTouch {
+private:
+    size_t bytes_;
+    std::unique_ptr<Mapping> map_;
+
+public:
+    explicit BenchFirstTouch(size_t bytes) : bytes_(bytes) {}
+
+    void run(bench::Runner &runner, const std::string &backing) {
+        // the full size, a hugetlb reservation may hold one page but not all
+        if (!Mapping(bytes_, backing).valid()) {
+            fprintf(stderr, "%s pages unavailable, skipping\n",
+                    backing.c_str());
+            return;
         }
+        bool failed = false;
+        bench::Case c("first-touch");
+        c.param("backing", backing)
+                .param("bytes", bytes_)
+                .set_ops(bytes_ / PAGE_4K);
+        // a new mapping per repetition, mapping and unmapping is not timed
+        runner.run(
+                c,
+                [&] {
+                    map_.reset();
+                    map_.reset(new Mapping(bytes_, backing));
+                    if (!map_->valid()) failed = true;
+                },
+                [&] {
+                    if (!map_->valid()) return;
+                    char *p = map_->data();
+                    for (size_t i = 0; i < bytes_; i += PAGE_4K)
+                        p[i] = 1;
+                });
+        map_.reset();
+        if (failed)
+            fprintf(stderr, "%s mapping failed during the run, results invalid\n",
+                    backing.c_str());
+    }
+};
+
+// steady-state dependent loads, one random line per 4 KiB page
+class BenchTlbReach {
+private:
+    size_t loads_;
+    size_t line_;
+
+public:
+    BenchTlbReach(size_t loads, size_t line) : loads_(loads), line_(line) {}
+
+    // returns the median ns per load, 0 if the backing is unavailable
+    double run(bench::Runner &runner, const std::string &backing,
+            size_t span) {
+        Mapping map(span, backing);
+        if (!map.valid()) return 0.;
+        size_t pages = span / PAGE_4K;
+        std::mt19937_64 gen(7);
+        std::vector<size_t> order(pages);
+        for (size_t i = 0; i < pages; ++i)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), gen);
+        // random line inside every page, so the lines spread over all
+        // cache sets instead of aliasing on one
+        std::uniform_int_distribution<size_t> pick(0, PAGE_4K / line_ - 1);
+        std::vector<void **> nodes(pages);
+        for (size_t i = 0; i < pages; ++i)
+            nodes[i] = reinterpret_cast<void **>(
+                    map.data() + order[i] * PAGE_4K + pick(gen) * line_);
+        for (size_t i = 0; i < pages; ++i)
+            *nodes[i] = nodes[(i + 1) % pages];
+
+        bench::Case c("tlb");
+        c.param("backing", backing)
+                .param("span_kb", span / 1024)
+                .param("pages_4k", pages)
+                .set_ops(loads_);
+        void **head = nodes[0];
+        const bench::Result &r = runner.run(c, [&] {
+            void **p = head;
+            for (size_t i = 0; i < loads_; ++i)
+                p = static_cast<void **>(*p);
+            bench::do_not_optimize(p);
+        });
+        return r.stats.median / loads_;
     }
 };
 
-int main() {
-    BenchPageFault<float> bench(1024, 1);
-    bench.run();
+int main(int argc, char **argv) {
+    bench::Runner runner("page_fault", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+    int dim = opts.get_int("dim", 1024,
+            "square array dimension, dim * dim must be a power of two");
+    size_t accesses = opts.get_int("accesses", 64 * 1024 * 1024,
+            "accesses per step size");
+    std::vector<long> steps
+            = opts.get_list("steps", {100, 500, 2000}, "element steps");
+    std::string backings_str = opts.get_string(
+            "backings", "4k,thp,hugetlb", "page backings to compare");
+    size_t touch_bytes = opts.get_int(
+            "touch-bytes", 64 * 1024 * 1024, "mapping size for first-touch");
+    // 64 KiB covers 16 pages (inside any L1 dTLB), 256 MiB is 64K pages
+    // (beyond any STLB)
+    std::vector<long> spans = opts.get_list("spans-kb",
+            {64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536,
+                    131072, 262144},
+            "spans for the TLB reach sweep, in KiB");
+    size_t loads = opts.get_int(
+            "loads", 1024 * 1024, "dependent loads per TLB repetition");
+    cache_state::State state = cache_state::option(opts);
+    if (opts.help()) return 0;
+
+    std::vector<std::string> backings;
+    std::stringstream ss(backings_str);
+    std::string b;
+    while (std::getline(ss, b, ','))
+        backings.push_back(b);
+
+    BenchPageFault<DTYPE> bench(dim, accesses, state);
+    bench.run(runner, steps);
+
+    BenchFirstTouch first_touch(touch_bytes);
+    for (const auto &backing : backings)
+        first_touch.run(runner, backing);
+
+    // ns per load of each backing, per span
+    std::map<long, std::map<std::string, double>> summary;
+    BenchTlbReach tlb(loads, topology::info().line_size);
+    for (const auto &backing : backings) {
+        if (!Mapping(PAGE_2M, backing).valid()) continue;
+        for (long span : spans) {
+            // a span the backing cannot map stays out of the table
+            double ns = tlb.run(runner, backing, span * 1024);
+            if (ns > 0.) summary[span][backing] = ns;
+        }
+    }
+
+    // how much the huge page backings recover against 4 KiB pages
+    if (runner.format() == "text" && !summary.empty()) {
+        printf("\n%12s", "span_kb");
+        for (const auto &backing : backings)
+            printf("%12s", (backing + " ns").c_str());
+        printf("%12s\n", "4k/thp");
+        for (const auto &row : summary) {
+            printf("%12ld", row.first);
+            for (const auto &backing : backings) {
+                auto it = row.second.find(backing);
+                if (it == row.second.end())
+                    printf("%12s", "-");
+                else
+                    printf("%12.2f", it->second);
+            }
+            auto small = row.second.find("4k");
+            auto huge = row.second.find("thp");
+            if (small != row.second.end() && huge != row.second.end()
+                    && small->second > 0. && huge->second > 0.)
+                printf("%12.2f", small->second / huge->second);
+            printf("\n");
+        }
+    }
     return 0;
 }
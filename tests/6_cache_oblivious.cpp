@@ -0,0 +1,189 @@
+// This is an example to demonstrate cache-oblivious (recursive) kernels, which
+// adapt to every cache level at once, against the naive loop nests and the
+// fixed-size blocked kernel that is only tuned for one cache level
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "bench.hpp"
+#include "cache_state.hpp"
+#include "mem_ops.hpp"
+#include "cache_oblivious.hpp"
+#include "matmul_kernels.hpp"
+#include "topology.hpp"
+
+using DTYPE = float;
+
+class co_matmul {
+private:
+    // dimensions
+    int n_;
+    // arrays
+    std::vector<DTYPE> A_;
+    std::vector<DTYPE> B_;
+    std::vector<DTYPE> C_;
+    // total number of innermost loops
+    double iters_;
+    // cache state of A, B and C before each run
+    cache_state::Buffers buffers_;
+
+    void reset() {
+        mem_ops::fill(C_.data(), 0, C_.size() * sizeof(DTYPE));
+    }
+
+public:
+    co_matmul(int n, cache_state::State state = cache_state::FLUSHED)
+        : n_(n), buffers_(state) {
+        iters_ = (double)n_ * n_ * n_;
+        A_ = std::vector<DTYPE>(n_ * n_, 1);
+        B_ = std::vector<DTYPE>(n_ * n_, 1);
+        C_ = std::vector<DTYPE>(n_ * n_, 0);
+        buffers_.add(A_).add(B_).add(C_);
+    }
+
+    // loop M -> loop K -> loop N, the best loop order of 3_spatial_locality
+    void mkn() { matmul_kernels::mkn(A_.data(), B_.data(), C_.data(), n_); }
+
+    // blocked knm of 4_temporal_locality in its form for partial blocks, so
+    // that sizes which are not multiples of MM_BLOCK_SIZE can be compared
+    void block_knm() {
+        DTYPE packed[MM_BLOCK_SIZE * MM_BLOCK_SIZE];
+        matmul_kernels::block_gemm(
+                A_.data(), B_.data(), C_.data(), &packed[0], n_, n_, n_);
+    }
+
+    // recursive divide-and-conquer
+    void recursive(int cutoff) {
+        cache_oblivious::matmul(A_.data(), B_.data(), C_.data(), n_, cutoff);
+    }
+
+    // time one version, returns the median latency in ns
+    double run(bench::Runner &runner, const std::string &version,
+            int cutoff = CO_MATMUL_CUTOFF) {
+        bench::Case c("matmul-" + version);
+        c.param("n", n_).param("cache", buffers_.name()).set_ops(iters_);
+        if (version == "recursive") c.param("cutoff", cutoff);
+        auto setup = [this] {
+            reset();
+            buffers_.prepare();
+        };
+        if (version == "mkn")
+            return runner.run(c, setup, [this] { mkn(); }).stats.median;
+        if (version == "block-knm")
+            return runner.run(c, setup, [this] { block_knm(); }).stats.median;
+        return runner.run(c, setup, [&] { recursive(cutoff); }).stats.median;
+    }
+};
+
+class co_transpose {
+private:
+    // dimensions
+    int n_;
+    // arrays
+    std::vector<DTYPE> A_;
+    std::vector<DTYPE> B_;
+    // cache state of A and B before each run
+    cache_state::Buffers buffers_;
+
+public:
+    co_transpose(int n, cache_state::State state = cache_state::FLUSHED)
+        : n_(n), buffers_(state) {
+        A_ = std::vector<DTYPE>(n_ * n_, 1);
+        B_ = std::vector<DTYPE>(n_ * n_, 0);
+        buffers_.add(A_).add(B_);
+    }
+
+    // read rows of A, write columns of B
+    void naive() {
+        for (int i = 0; i < n_; ++i)
+            for (int j = 0; j < n_; ++j)
+                B_[j * n_ + i] = A_[i * n_ + j];
+    }
+
+    // fixed tiles of MM_BLOCK_SIZE x MM_BLOCK_SIZE
+    void blocked() {
+        for (int ii = 0; ii < n_; ii += MM_BLOCK_SIZE)
+            for (int jj = 0; jj < n_; jj += MM_BLOCK_SIZE)
+                for (int i = ii; i < std::min(ii + MM_BLOCK_SIZE, n_); ++i)
+                    for (int j = jj; j < std::min(jj + MM_BLOCK_SIZE, n_); ++j)
+                        B_[j * n_ + i] = A_[i * n_ + j];
+    }
+
+    void recursive() {
+        cache_oblivious::transpose(A_.data(), B_.data(), n_, n_, n_, n_);
+    }
+
+    void naive_inplace() {
+        for (int i = 0; i < n_; ++i)
+            for (int j = i + 1; j < n_; ++j)
+                std::swap(A_[i * n_ + j], A_[j * n_ + i]);
+    }
+
+    void recursive_inplace() {
+        cache_oblivious::transpose_inplace(A_.data(), n_, n_);
+    }
+
+    void run(bench::Runner &runner) {
+        // every element is read once and written once
+        double bytes = 2.0 * n_ * n_ * sizeof(DTYPE);
+        auto make_case = [&](const char *version) {
+            bench::Case c(std::string("transpose-") + version);
+            c.param("n", n_).param("cache", buffers_.name()).set_bytes(bytes);
+            return c;
+        };
+        auto setup = [this] { buffers_.prepare(); };
+        runner.run(make_case("naive"), setup, [this] { naive(); });
+        runner.run(make_case("blocked"), setup, [this] { blocked(); });
+        runner.run(make_case("recursive"), setup, [this] { recursive(); });
+        runner.run(make_case("naive-inplace"), setup,
+                [this] { naive_inplace(); });
+        runner.run(make_case("recursive-inplace"), setup,
+                [this] { recursive_inplace(); });
+    }
+};
+
+// pick the base-case cutoff with the lowest latency on a mid-sized problem
+int tune_cutoff(bench::Runner &runner, int n, cache_state::State state) {
+    std::vector<int> cutoffs {8, 16, 32, 64, 128};
+    co_matmul mm(n, state);
+    int best = CO_MATMUL_CUTOFF;
+    double best_time = 0.;
+    for (int c : cutoffs) {
+        double t = mm.run(runner, "recursive", c);
+        if (best_time == 0. || t < best_time) {
+            best_time = t;
+            best = c;
+        }
+    }
+    fprintf(stderr, "tuned cutoff: %d\n", best);
+    return best;
+}
+
+int main(int argc, char **argv) {
+    bench::Runner runner("cache_oblivious", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    int tune_n = opts.get_int("tune-n", 511, "matmul size to tune cutoff on");
+    // sizes deliberately not powers of two (or multiples of MM_BLOCK_SIZE)
+    std::vector<long> mm_sizes = opts.get_list(
+            "mm-sizes", {255, 511, 767, 1000}, "matmul dimensions");
+    std::vector<long> tr_sizes = opts.get_list(
+            "tr-sizes", {1000, 2047, 3001, 4097}, "transpose dimensions");
+    cache_state::State state = cache_state::option(opts);
+    if (opts.help()) return 0;
+
+    int cutoff = tune_cutoff(runner, tune_n, state);
+
+    for (long n : mm_sizes) {
+        co_matmul mm(n, state);
+        mm.run(runner, "mkn");
+        mm.run(runner, "block-knm");
+        mm.run(runner, "recursive", cutoff);
+    }
+
+    for (long n : tr_sizes) {
+        co_transpose tr(n, state);
+        tr.run(runner);
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+// This is to benchmark load-to-use latency of each level of the memory
+// hierarchy with dependent loads (pointer chasing).
+//
+// Unlike 1_cache_bandwidth, every address depends on the previous load and
+// the chain visits cache lines in a random order, so neither out-of-order
+// execution nor the hardware prefetcher can hide the latency.
+//  * page mode: random order of the lines within a page, pages in random
+//    order, so consecutive loads mostly hit the same TLB entry
+//  * random mode: one random cycle over all lines of the working set, so
+//    large working sets also pay for TLB misses
+// With N independent chains interleaved, up to N misses are in flight at
+// once, which shows the memory-level parallelism of the core.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "topology.hpp"
+
+#define PAGE_SIZE (4096)
+
+class PointerChase {
+private:
+    // working set
+    char *data_ {nullptr};
+    size_t bytes_;
+    size_t line_;
+    size_t num_lines_;
+    // first line of every chain
+    std::vector<void **> heads_;
+
+    void **line(size_t idx) {
+        return reinterpret_cast<void **>(data_ + idx * line_);
+    }
+
+    // link the lines in the given order into num_chains disjoint cycles
+    void link(const std::vector<size_t> &order, size_t num_chains) {
+        heads_.clear();
+        size_t len = order.size() / num_chains;
+        for (size_t c = 0; c < num_chains; ++c) {
+            size_t begin = c * len;
+            size_t end = c + 1 == num_chains ? order.size() : begin + len;
+            for (size_t i = begin; i + 1 < end; ++i)
+                *line(order[i]) = line(order[i + 1]);
+            *line(order[end - 1]) = line(order[begin]);
+            heads_.push_back(line(order[begin]));
+        }
+    }
+
+public:
+    PointerChase(size_t bytes, size_t line_size)
+        : bytes_(bytes), line_(line_size) {
+        num_lines_ = bytes_ / line_;
+        size_t alloc = (bytes_ + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        if (posix_memalign(reinterpret_cast<void **>(&data_), PAGE_SIZE, alloc))
+            data_ = nullptr;
+    }
+
+    ~PointerChase() { free(data_); }
+
+    bool valid() const { return data_ != nullptr && num_lines_ > 1; }
+
+    // build the chains for "page" or "random" mode
+    void build(const std::string &mode, size_t num_chains) {
+        std::mt19937_64 gen(42);
+        std::vector<size_t> order(num_lines_);
+        for (size_t i = 0; i < num_lines_; ++i)
+            order[i] = i;
+        size_t lines_per_page = std::max<size_t>(1, PAGE_SIZE / line_);
+        if (mode == "page" && num_lines_ > lines_per_page) {
+            size_t num_pages = num_lines_ / lines_per_page;
+            std::vector<size_t> pages(num_pages);
+            for (size_t p = 0; p < num_pages; ++p)
+                pages[p] = p;
+            std::shuffle(pages.begin(), pages.end(), gen);
+            order.clear();
+            std::vector<size_t> in_page(lines_per_page);
+            for (size_t p : pages) {
+                for (size_t l = 0; l < lines_per_page; ++l)
+                    in_page[l] = p * lines_per_page + l;
+                std::shuffle(in_page.begin(), in_page.end(), gen);
+                order.insert(order.end(), in_page.begin(), in_page.end());
+            }
+        } else {
+            std::shuffle(order.begin(), order.end(), gen);
+        }
+        link(order, std::min(num_chains, order.size()));
+    }
+
+    size_t num_chains() const { return heads_.size(); }
+
+    // follow one chain for a number of dependent loads
+    void *chase(size_t loads) {
+        void **p = heads_[0];
+        for (size_t i = 0; i < loads; ++i)
+            p = static_cast<void **>(*p);
+        return p;
+    }
+
+    // follow all chains in lockstep, loads per chain
+    template <size_t N>
+    void *chase_n(size_t loads) {
+        void **p[N];
+        for (size_t c = 0; c < N; ++c)
+            p[c] = heads_[c];
+        for (size_t i = 0; i < loads; ++i)
+            for (size_t c = 0; c < N; ++c)
+                p[c] = static_cast<void **>(*p[c]);
+        void *x = nullptr;
+        for (size_t c = 0; c < N; ++c)
+            x = reinterpret_cast<char *>(x) + reinterpret_cast<size_t>(p[c]);
+        return x;
+    }
+
+    void *chase_chains(size_t loads) {
+        switch (heads_.size()) {
+            case 1: return chase(loads);
+            case 2: return chase_n<2>(loads);
+            case 4: return chase_n<4>(loads);
+            case 8: return chase_n<8>(loads);
+            case 16: return chase_n<16>(loads);
+            case 32: return chase_n<32>(loads);
+            default: return nullptr;
+        }
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("memory_latency", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+
+    std::vector<long> working_set;
+    for (size_t ws : topo.working_sets(PAGE_SIZE, 2))
+        working_set.push_back(ws / 1024);
+    working_set = opts.get_list("sizes-kb", working_set,
+            "working set sizes in KiB, e.g. 4,64,1g for up to several GB");
+    std::string modes_str
+            = opts.get_string("modes", "page,random", "page and/or random");
+    size_t loads = opts.get_int(
+            "loads", 1024 * 1024, "dependent loads per repetition");
+    std::vector<long> chains = opts.get_list("chains", {1, 2, 4, 8, 16, 32},
+            "independent chains for the MLP sweep (1, 2, 4 ... 32)");
+    size_t mlp_kb = opts.get_int("mlp-kb",
+            4 * topo.llc_size() / 1024, "working set of the MLP sweep in KiB");
+    if (opts.help()) return 0;
+
+    std::vector<std::string> modes;
+    std::stringstream ss(modes_str);
+    std::string m;
+    while (std::getline(ss, m, ','))
+        modes.push_back(m);
+
+    // latency of each level
+    for (long ws : working_set) {
+        PointerChase pc(ws * 1024, topo.line_size);
+        if (!pc.valid()) continue;
+        for (const auto &mode : modes) {
+            pc.build(mode, 1);
+            bench::Case c("chase");
+            c.param("mode", mode)
+                    .param("ws_kb", ws)
+                    .param("level", topo.label(ws * 1024))
+                    .set_ops(loads);
+            runner.run(c, [&] { bench::do_not_optimize(pc.chase(loads)); });
+        }
+    }
+
+    // memory-level parallelism, ns/op is per load across all chains
+    PointerChase pc(mlp_kb * 1024, topo.line_size);
+    if (!pc.valid()) return 0;
+    for (long n : chains) {
+        if (n < 1 || n > 32 || (n & (n - 1))) {
+            fprintf(stderr, "skipping %ld chains, use a power of two up to "
+                            "32\n", n);
+            continue;
+        }
+        pc.build("random", n);
+        size_t per_chain = loads / pc.num_chains();
+        bench::Case c("mlp");
+        c.param("chains", pc.num_chains())
+                .param("ws_kb", mlp_kb)
+                .set_ops(per_chain * pc.num_chains());
+        runner.run(c,
+                [&] { bench::do_not_optimize(pc.chase_chains(per_chain)); });
+    }
+    return 0;
+}
@@ -0,0 +1,274 @@
+// This is a STREAM-style benchmark of sustainable memory bandwidth on 1..N
+// pinned threads.
+//
+// Kernels (s is a scalar):
+//  * copy:  c = a           * scale: b = s * c
+//  * add:   c = a + b       * triad: a = b + s * c
+//  * read:  sum += a        * write: a = s
+// Every kernel that stores comes in two versions:
+//  * regular stores, which read each destination line before writing it
+//    (write-allocate), so the real traffic is one array more than counted
+//  * non-temporal (streaming) stores, which write whole lines to memory
+//    without reading them and without polluting the caches
+// GB/s is counted the STREAM way, i.e. without write-allocate traffic, so the
+// gap between the two versions is the write-allocate cost.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <immintrin.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "thread_team.hpp"
+#include "topology.hpp"
+
+using DTYPE = float;
+
+// per-thread chunks start on a cache line
+#define CHUNK_ALIGN (64 / sizeof(DTYPE))
+
+// store 4 floats, streaming or regular
+template <bool NT>
+inline void store4(DTYPE *dst, __m128 v) {
+    if (NT)
+        _mm_stream_ps(dst, v);
+    else
+        _mm_store_ps(dst, v);
+}
+
+class StreamBench {
+private:
+    size_t n_;
+    DTYPE *a_ {nullptr};
+    DTYPE *b_ {nullptr};
+    DTYPE *c_ {nullptr};
+    thread_team::ThreadTeam team_;
+    // per-thread results of the read kernel, one cache line each
+    std::vector<DTYPE> sums_;
+
+    static DTYPE *alloc(size_t n) {
+        void *p = nullptr;
+        // untouched until first_touch(), so pages land near their thread
+        if (posix_memalign(&p, 4096, n * sizeof(DTYPE))) return nullptr;
+        return static_cast<DTYPE *>(p);
+    }
+
+    // each thread initializes the chunk it works on later
+    void first_touch() {
+        team_.run([this](int tid) {
+            auto r = thread_team::chunk(n_, tid, team_.size(), CHUNK_ALIGN);
+            for (size_t i = r.first; i < r.second; ++i) {
+                a_[i] = 1.0f;
+                b_[i] = 2.0f;
+                c_[i] = 0.0f;
+            }
+        });
+    }
+
+    // run kernel(begin, end) on every thread over its own chunk
+    template <typename F>
+    void parallel(F kernel) {
+        team_.run([&](int tid) {
+            auto r = thread_team::chunk(n_, tid, team_.size(), CHUNK_ALIGN);
+            kernel(r.first, r.second, tid);
+            // make streaming stores globally visible before the barrier
+            _mm_sfence();
+        });
+    }
+
+public:
+    StreamBench(size_t n, int num_threads)
+        : n_(n), team_(num_threads), sums_(num_threads * CHUNK_ALIGN, 0) {
+        a_ = alloc(n_);
+        b_ = alloc(n_);
+        c_ = alloc(n_);
+        if (valid()) first_touch();
+    }
+
+    ~StreamBench() {
+        free(a_);
+        free(b_);
+        free(c_);
+    }
+
+    bool valid() const { return a_ && b_ && c_; }
+
+    template <bool NT>
+    void copy() {
+        DTYPE *a = a_, *c = c_;
+        parallel([=](size_t b, size_t e, int) {
+            size_t i = b;
+            for (; i + 4 <= e; i += 4)
+                store4<NT>(c + i, _mm_load_ps(a + i));
+            for (; i < e; ++i)
+                c[i] = a[i];
+        });
+    }
+
+    template <bool NT>
+    void scale(DTYPE s) {
+        DTYPE *bb = b_, *c = c_;
+        parallel([=](size_t b, size_t e, int) {
+            __m128 vs = _mm_set1_ps(s);
+            size_t i = b;
+            for (; i + 4 <= e; i += 4)
+                store4<NT>(bb + i, _mm_mul_ps(vs, _mm_load_ps(c + i)));
+            for (; i < e; ++i)
+                bb[i] = s * c[i];
+        });
+    }
+
+    template <bool NT>
+    void add() {
+        DTYPE *a = a_, *bb = b_, *c = c_;
+        parallel([=](size_t b, size_t e, int) {
+            size_t i = b;
+            for (; i + 4 <= e; i += 4)
+                store4<NT>(c + i,
+                        _mm_add_ps(_mm_load_ps(a + i), _mm_load_ps(bb + i)));
+            for (; i < e; ++i)
+                c[i] = a[i] + bb[i];
+        });
+    }
+
+    template <bool NT>
+    void triad(DTYPE s) {
+        DTYPE *a = a_, *bb = b_, *c = c_;
+        parallel([=](size_t b, size_t e, int) {
+            __m128 vs = _mm_set1_ps(s);
+            size_t i = b;
+            for (; i + 4 <= e; i += 4)
+                store4<NT>(a + i,
+                        _mm_add_ps(_mm_load_ps(bb + i),
+                                _mm_mul_ps(vs, _mm_load_ps(c + i))));
+            for (; i < e; ++i)
+                a[i] = bb[i] + s * c[i];
+        });
+    }
+
+    template <bool NT>
+    void write(DTYPE s) {
+        DTYPE *a = a_;
+        parallel([=](size_t b, size_t e, int) {
+            __m128 vs = _mm_set1_ps(s);
+            size_t i = b;
+            for (; i + 4 <= e; i += 4)
+                store4<NT>(a + i, vs);
+            for (; i < e; ++i)
+                a[i] = s;
+        });
+    }
+
+    // four accumulators to hide the add latency
+    void read() {
+        DTYPE *a = a_;
+        DTYPE *sums = sums_.data();
+        parallel([=](size_t b, size_t e, int tid) {
+            __m128 s0 = _mm_setzero_ps(), s1 = s0, s2 = s0, s3 = s0;
+            size_t i = b;
+            for (; i + 16 <= e; i += 16) {
+                s0 = _mm_add_ps(s0, _mm_load_ps(a + i));
+                s1 = _mm_add_ps(s1, _mm_load_ps(a + i + 4));
+                s2 = _mm_add_ps(s2, _mm_load_ps(a + i + 8));
+                s3 = _mm_add_ps(s3, _mm_load_ps(a + i + 12));
+            }
+            float lanes[4];
+            _mm_storeu_ps(
+                    lanes, _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3)));
+            DTYPE sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            for (; i < e; ++i)
+                sum += a[i];
+            sums[tid * CHUNK_ALIGN] = sum;
+        });
+    }
+
+    void run(bench::Runner &runner, const std::string &kernel, bool nt) {
+        const DTYPE s = 3.0f;
+        // arrays touched per element, STREAM counting
+        size_t arrays = 0;
+        std::function<void()> body;
+        if (kernel == "copy") {
+            arrays = 2;
+            body = nt ? std::function<void()>([this] { copy<true>(); })
+                      : [this] { copy<false>(); };
+        } else if (kernel == "scale") {
+            arrays = 2;
+            body = nt ? std::function<void()>([=] { scale<true>(s); })
+                      : [=] { scale<false>(s); };
+        } else if (kernel == "add") {
+            arrays = 3;
+            body = nt ? std::function<void()>([this] { add<true>(); })
+                      : [this] { add<false>(); };
+        } else if (kernel == "triad") {
+            arrays = 3;
+            body = nt ? std::function<void()>([=] { triad<true>(s); })
+                      : [=] { triad<false>(s); };
+        } else if (kernel == "write") {
+            arrays = 1;
+            body = nt ? std::function<void()>([=] { write<true>(s); })
+                      : [=] { write<false>(s); };
+        } else if (kernel == "read") {
+            // nothing is stored, there is no streaming version
+            if (nt) return;
+            arrays = 1;
+            body = [this] { read(); };
+        } else {
+            fprintf(stderr, "unknown kernel %s\n", kernel.c_str());
+            return;
+        }
+        bench::Case c(kernel);
+        const char *stores = nt ? "nt" : kernel == "read" ? "none" : "regular";
+        c.param("stores", stores)
+                .param("threads", team_.size())
+                .param("elems", n_)
+                .set_bytes(static_cast<double>(arrays * n_ * sizeof(DTYPE)));
+        runner.run(c, body);
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("stream", argc, argv, /*reps=*/5);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+
+    // STREAM rule: each array at least 4x the LLC, but leave most of the
+    // memory of small machines alone
+    size_t phys = static_cast<size_t>(sysconf(_SC_PHYS_PAGES))
+            * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t bytes = std::min(4 * topo.llc_size(), phys / 16);
+    size_t n = opts.get_int("elems", bytes / sizeof(DTYPE),
+            "floats per array (three arrays)");
+
+    int max_threads = static_cast<int>(topo.cpus.size());
+    std::vector<long> threads;
+    for (int t = 1; t < max_threads; t *= 2)
+        threads.push_back(t);
+    threads.push_back(max_threads);
+    threads = opts.get_list("threads", threads, "thread counts to sweep");
+    std::string kernels_str = opts.get_string("kernels",
+            "copy,scale,add,triad,read,write", "kernels to run");
+    if (opts.help()) return 0;
+
+    std::vector<std::string> kernels;
+    std::stringstream ss(kernels_str);
+    std::string k;
+    while (std::getline(ss, k, ','))
+        kernels.push_back(k);
+
+    for (long t : threads) {
+        StreamBench sb(n, static_cast<int>(t));
+        if (!sb.valid()) {
+            fprintf(stderr, "cannot allocate 3 x %zu floats\n", n);
+            return 1;
+        }
+        for (const auto &kernel : kernels) {
+            sb.run(runner, kernel, false);
+            sb.run(runner, kernel, true);
+        }
+    }
+    return 0;
+}
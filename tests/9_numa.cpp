@@ -0,0 +1,151 @@
+// This is to benchmark local versus remote memory on NUMA machines: for every
+// pair (CPU node, memory node) the threads run on the CPU node while the data
+// is bound to the memory node.
+//  * latency: pointer chasing over a random cycle of cache lines, larger than
+//    the LLC, so every load goes to the memory of the node
+//  * bandwidth: all CPUs of the node read the buffer in parallel
+// The diagonal (CPU node == memory node) is local access, everything else
+// crosses the interconnect. On single-node machines only the local pair is
+// measured.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "numa.hpp"
+#include "thread_team.hpp"
+#include "topology.hpp"
+
+class NodeBuffer {
+private:
+    char *data_ {nullptr};
+    size_t bytes_;
+    size_t line_;
+    bool bound_ {false};
+    void **head_ {nullptr};
+
+    void **line(size_t idx) {
+        return reinterpret_cast<void **>(data_ + idx * line_);
+    }
+
+public:
+    NodeBuffer(size_t bytes, size_t line_size, int mem_node)
+        : bytes_(bytes / line_size * line_size), line_(line_size) {
+        data_ = static_cast<char *>(
+                numa::alloc_on_node(bytes_, mem_node, &bound_));
+        if (!data_) return;
+        // the first touch places the pages, on the bound node if binding
+        // worked, otherwise on the node the caller runs on
+        std::mt19937_64 gen(42);
+        size_t num_lines = bytes_ / line_;
+        std::vector<size_t> order(num_lines);
+        for (size_t i = 0; i < num_lines; ++i)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), gen);
+        for (size_t i = 0; i < num_lines; ++i)
+            *line(order[i]) = line(order[(i + 1) % num_lines]);
+        head_ = line(order[0]);
+    }
+
+    ~NodeBuffer() { numa::free_on_node(data_, bytes_); }
+
+    bool valid() const { return data_ != nullptr && bytes_ >= 2 * line_; }
+    bool bound() const { return bound_; }
+    size_t bytes() const { return bytes_; }
+
+    // node the pages actually landed on, -1 if the kernel does not say
+    int placed() const { return numa::node_of(data_); }
+
+    void *chase(size_t loads) {
+        void **p = head_;
+        for (size_t i = 0; i < loads; ++i)
+            p = static_cast<void **>(*p);
+        return p;
+    }
+
+    // sum the words of [begin, end), four accumulators
+    uint64_t read(size_t begin, size_t end) const {
+        const uint64_t *a = reinterpret_cast<const uint64_t *>(data_);
+        uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            s0 += a[i];
+            s1 += a[i + 1];
+            s2 += a[i + 2];
+            s3 += a[i + 3];
+        }
+        for (; i < end; ++i)
+            s0 += a[i];
+        return s0 + s1 + s2 + s3;
+    }
+};
+
+int main(int argc, char **argv) {
+    bench::Runner runner("numa", argc, argv, /*reps=*/3);
+    auto &opts = runner.options();
+    const topology::CpuInfo &topo = topology::info();
+
+    size_t mb = opts.get_int("size-mb",
+            std::max<size_t>(64, 4 * topo.llc_size() / (1024 * 1024)),
+            "buffer size per node pair in MiB");
+    size_t loads = opts.get_int(
+            "loads", 1024 * 1024, "dependent loads per repetition");
+    long threads = opts.get_int(
+            "threads", 0, "reader threads per node, 0 for all CPUs of the node");
+    if (opts.help()) return 0;
+
+    std::vector<int> nodes = numa::nodes();
+    if (nodes.size() < 2)
+        fprintf(stderr, "single NUMA node, measuring local memory only\n");
+
+    for (int cpu_node : nodes) {
+        std::vector<int> cpus = numa::node_cpus(cpu_node);
+        // the main thread leaves the node again after this iteration
+        thread_team::AffinityGuard affinity;
+        if (!numa::run_on_node(cpu_node))
+            fprintf(stderr, "cannot run on node %d, results are not "
+                            "placed\n", cpu_node);
+        int nthreads = threads > 0 ? static_cast<int>(threads)
+                                   : static_cast<int>(cpus.size());
+        thread_team::ThreadTeam team(nthreads, cpus);
+        std::vector<uint64_t> sums(nthreads * 8, 0);
+
+        for (int mem_node : nodes) {
+            NodeBuffer buf(mb * 1024 * 1024, topo.line_size, mem_node);
+            if (!buf.valid()) {
+                fprintf(stderr, "cannot allocate %zu MiB on node %d\n", mb,
+                        mem_node);
+                continue;
+            }
+            auto make_case = [&](const char *name) {
+                bench::Case c(name);
+                c.param("cpu_node", cpu_node)
+                        .param("mem_node", mem_node)
+                        .param("distance", numa::distance(cpu_node, mem_node))
+                        .param("bound", buf.bound() ? "yes" : "no")
+                        .param("placed", buf.placed());
+                return c;
+            };
+
+            bench::Case lat = make_case("latency");
+            lat.set_ops(loads);
+            runner.run(lat, [&] { bench::do_not_optimize(buf.chase(loads)); });
+
+            size_t words = buf.bytes() / sizeof(uint64_t);
+            bench::Case bw = make_case("bandwidth");
+            bw.param("threads", team.size()).set_bytes(buf.bytes());
+            runner.run(bw, [&] {
+                team.run([&](int tid) {
+                    auto r = thread_team::chunk(words, tid, team.size(), 8);
+                    sums[tid * 8] = buf.read(r.first, r.second);
+                });
+                bench::clobber_memory();
+            });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_logger.hpp"
+#include "ring_buffer.hpp"
+
+// SpscRing: wrap-around, refusal when full, FIFO between two threads
+static bool test_ring() {
+    ring_buffer::SpscRing<256> ring;
+    char rec[40] = {};
+    int pushed = 0;
+    while (ring.push(rec, sizeof(rec)))
+        ++pushed;
+    // 48 bytes per record
+    if (pushed != 5 || ring.consume([](const char *, size_t) {}) != 5
+            || !ring.empty()) {
+        std::cout << "FAILED: ring capacity " << pushed << "\n";
+        return false;
+    }
+
+    const uint32_t count = 50000;
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < count;) {
+            // sizes 4 to 60 bytes, so records wrap at every offset
+            uint32_t n = 4 + (i % 15) * 4;
+            char *p = ring.prepare(n);
+            if (!p) {
+                std::this_thread::yield();
+                continue;
+            }
+            memset(p, 0, n);
+            memcpy(p, &i, sizeof(i));
+            ring.commit();
+            ++i;
+        }
+    });
+    uint32_t expect = 0;
+    bool ok = true;
+    while (expect < count && ok) {
+        size_t got = ring.consume([&](const char *p, size_t n) {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            if (v != expect || n != 4 + (v % 15) * 4) ok = false;
+            ++expect;
+        });
+        if (!got) std::this_thread::yield();
+    }
+    producer.join();
+    if (!ok) std::cout << "FAILED: ring order at " << expect << "\n";
+    return ok;
+}
+
+int main() {
+    if (!test_ring()) return 1;
+
+    FILE *f = tmpfile();
+    const int threads = 4, per_thread = 20000;
+    uint64_t dropped;
+    {
+        async_log::Logger logger(fileno(f));
+        std::vector<std::thread> ts;
+        for (int t = 0; t < threads; ++t)
+            ts.emplace_back([&, t] {
+                std::string tag = "thread" + std::to_string(t);
+                for (int i = 0; i < per_thread; ++i)
+                    ASYNC_LOG(logger, "%s i=%d x=%.1f c=%c", tag, i, 0.5 * i,
+                            'a' + t);
+            });
+        for (auto &t : ts)
+            t.join();
+        ASYNC_LOG(logger, "done");
+        logger.flush();
+        dropped = logger.dropped();
+    }
+
+    // every line well-formed, in order within its thread
+    rewind(f);
+    std::vector<int> next(threads, 0);
+    char line[256];
+    int lines = 0;
+    bool done = false;
+    while (fgets(line, sizeof(line), f)) {
+        ++lines;
+        double ts;
+        unsigned idx;
+        char tag[32];
+        int i;
+        double x;
+        char c;
+        if (sscanf(line, "%lf [%u] %31s i=%d x=%lf c=%c", &ts, &idx, tag, &i,
+                    &x, &c) == 6) {
+            int t = tag[6] - '0';
+            if (t < 0 || t >= threads || i < next[t] || x != 0.5 * i
+                    || c != 'a' + t) {
+                std::cout << "FAILED: line " << line;
+                return 1;
+            }
+            next[t] = i + 1;
+        } else if (strstr(line, "] done\n")) {
+            done = true;
+        } else {
+            std::cout << "FAILED: malformed line " << line;
+            return 1;
+        }
+    }
+    fclose(f);
+    if (!done || lines + dropped != threads * per_thread + 1) {
+        std::cout << "FAILED: " << lines << " lines, " << dropped
+                  << " dropped\n";
+        return 1;
+    }
+
+    // threads beyond LOG_MAX_THREADS have no ring, their records are counted
+    FILE *null = fopen("/dev/null", "w");
+    {
+        async_log::Logger logger(fileno(null));
+        const int extra = 4;
+        std::atomic<int> arrived {0};
+        std::vector<std::thread> ts;
+        for (int t = 0; t < LOG_MAX_THREADS + extra; ++t)
+            ts.emplace_back([&, t] {
+                // all alive at once, so no thread reuses the ring of another
+                arrived.fetch_add(1);
+                while (arrived.load() < LOG_MAX_THREADS + extra)
+                    std::this_thread::yield();
+                ASYNC_LOG(logger, "thread %d", t);
+            });
+        for (auto &t : ts)
+            t.join();
+        logger.flush();
+        if (logger.dropped() != extra) {
+            std::cout << "FAILED: " << logger.dropped()
+                      << " dropped beyond the thread limit\n";
+            return 1;
+        }
+    }
+    fclose(null);
+    std::cout << "PASSED (" << dropped << " dropped)\n";
+    return 0;
+}
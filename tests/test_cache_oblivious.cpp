@@ -0,0 +1,75 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "cache_oblivious.hpp"
+
+// compare recursive kernels against plain loop nests on odd shapes
+static bool check_matmul(int m, int n, int k, int cutoff) {
+    std::vector<float> A(m * k), B(k * n), C(m * n, 0), ref(m * n, 0);
+    for (int i = 0; i < m * k; ++i)
+        A[i] = static_cast<float>(i % 7) - 3.f;
+    for (int i = 0; i < k * n; ++i)
+        B[i] = static_cast<float>(i % 5) - 2.f;
+
+    for (int i = 0; i < m; ++i)
+        for (int kk = 0; kk < k; ++kk)
+            for (int j = 0; j < n; ++j)
+                ref[i * n + j] += A[i * k + kk] * B[kk * n + j];
+
+    cache_oblivious::matmul(
+            A.data(), B.data(), C.data(), m, n, k, k, n, n, cutoff);
+    for (int i = 0; i < m * n; ++i) {
+        if (std::fabs(C[i] - ref[i]) > 1e-3f) return false;
+    }
+    return true;
+}
+
+static bool check_transpose(int rows, int cols, int cutoff) {
+    std::vector<int> A(rows * cols), B(rows * cols);
+    for (int i = 0; i < rows * cols; ++i)
+        A[i] = i;
+    cache_oblivious::transpose(A.data(), B.data(), rows, cols, cols, rows,
+            cutoff);
+    for (int i = 0; i < rows; ++i)
+        for (int j = 0; j < cols; ++j)
+            if (B[j * rows + i] != A[i * cols + j]) return false;
+    return true;
+}
+
+static bool check_transpose_inplace(int n, int cutoff) {
+    std::vector<int> A(n * n);
+    for (int i = 0; i < n * n; ++i)
+        A[i] = i;
+    cache_oblivious::transpose_inplace(A.data(), n, n, cutoff);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            if (A[j * n + i] != i * n + j) return false;
+    return true;
+}
+
+int main() {
+    int failures = 0;
+    for (int cutoff : {0, 1, 4, 16}) {
+        if (!check_matmul(37, 53, 29, cutoff)) {
+            std::cout << "matmul mismatch, cutoff " << cutoff << "\n";
+            ++failures;
+        }
+        if (!check_matmul(64, 1, 100, cutoff)) {
+            std::cout << "matvec mismatch, cutoff " << cutoff << "\n";
+            ++failures;
+        }
+        if (!check_transpose(45, 77, cutoff)) {
+            std::cout << "transpose mismatch, cutoff " << cutoff << "\n";
+            ++failures;
+        }
+        if (!check_transpose_inplace(67, cutoff)) {
+            std::cout << "in-place transpose mismatch, cutoff " << cutoff
+                      << "\n";
+            ++failures;
+        }
+    }
+    std::cout << (failures ? "FAILED" : "All cache-oblivious checks passed")
+              << "\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "cache_sim.hpp"
+#include "matmul_kernels.hpp"
+
+using namespace cache_sim;
+
+static LevelConfig level(const char *name, size_t size, int ways,
+        Policy policy = LRU, bool prefetch = false) {
+    return {name, size, ways, 64, policy, prefetch};
+}
+
+int main() {
+    // A B A C in one 2-way set: C evicts B under both policies
+    for (Policy p : {LRU, PLRU}) {
+        Cache c(level("L1", 128, 2, p));
+        c.access(0);
+        c.access(1);
+        c.access(0);
+        c.access(2);
+        if (!c.contains(0) || c.contains(1) || !c.contains(2)) {
+            std::cout << "FAILED: replacement " << policy_name(p) << "\n";
+            return 1;
+        }
+    }
+
+    // sweeping twice the capacity: LRU misses every line every time, a
+    // next-line prefetcher halves the demand misses of the first sweep
+    const size_t lines = 2 * 32 * 1024 / 64;
+    Hierarchy lru({level("L1", 32 * 1024, 8)});
+    Hierarchy pf({level("L1", 32 * 1024, 8, LRU, true)});
+    for (int sweep = 0; sweep < 2; ++sweep)
+        for (size_t i = 0; i < lines; ++i)
+            lru.access(i * 64);
+    for (size_t i = 0; i < lines; ++i)
+        pf.access(i * 64);
+    if (lru.cache_stats(0).misses != 2 * lines
+            || pf.cache_stats(0).misses != lines / 2
+            || pf.cache_stats(0).prefetches != lines / 2) {
+        std::cout << "FAILED: sweep, " << lru.cache_stats(0).misses << " "
+                  << pf.cache_stats(0).misses << "\n";
+        return 1;
+    }
+
+    // the traced matmul, directly and through a trace file, gives the same
+    // counts; unit strides take one byte per access
+    const int n = 64;
+    std::vector<float> A(n * n, 1.f), B(n * n, 1.f), C(n * n, 0.f);
+    std::vector<LevelConfig> caches {level("L1", 4096, 4), level("L2", 65536, 8)};
+    Hierarchy direct(caches, default_tlbs()), replay(caches, default_tlbs());
+    FILE *f = tmpfile();
+    uint64_t records = 0, bytes = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        TraceWriter trace(pass == 0 ? TraceWriter::to_hierarchy(direct)
+                                    : TraceWriter::to_file(f),
+                /*chunk_bytes=*/4096);
+        TracedArray<float> a {A.data(), &trace}, b {B.data(), &trace},
+                c {C.data(), &trace};
+        matmul_kernels::mkn(a, b, c, n);
+        trace.flush();
+        records = trace.records();
+        bytes = trace.bytes();
+    }
+    rewind(f);
+    if (!read_trace(f, TraceWriter::to_hierarchy(replay))) {
+        std::cout << "FAILED: truncated trace\n";
+        return 1;
+    }
+    fclose(f);
+    if (records != 2ull * n * n * n + n * n
+            || direct.cache_stats(0).accesses != records
+            || bytes > records * 11 / 10) {
+        std::cout << "FAILED: trace, " << records << " records " << bytes
+                  << " bytes\n";
+        return 1;
+    }
+    for (size_t i = 0; i < 2; ++i)
+        if (direct.cache_stats(i).misses != replay.cache_stats(i).misses
+                || direct.tlb_stats(i).misses != replay.tlb_stats(i).misses) {
+            std::cout << "FAILED: replay differs at level " << i << "\n";
+            return 1;
+        }
+    // three 16 KiB matrices, not line aligned: 768 to 771 lines and at least
+    // 12 pages, all cold
+    uint64_t cold = 3 * n * n * sizeof(float) / 64;
+    if (direct.cache_stats(1).misses < cold
+            || direct.cache_stats(1).misses > cold + 3
+            || direct.tlb_stats(0).misses < 12) {
+        std::cout << "FAILED: cold misses\n";
+        return 1;
+    }
+    direct.print();
+    std::cout << "PASSED\n";
+    return 0;
+}
@@ -0,0 +1,33 @@
+#include <iostream>
+#include <vector>
+
+#include "cache_state.hpp"
+
+int main() {
+    cache_state::State s = cache_state::WARM;
+    if (!cache_state::parse_state("evicted", s) || s != cache_state::EVICTED
+            || cache_state::parse_state("cold", s)
+            || std::string(cache_state::state_name(cache_state::FLUSHED))
+                    != "flushed") {
+        std::cout << "FAILED: state names\n";
+        return 1;
+    }
+
+    // unaligned and odd-sized regions, contents survive every state
+    std::vector<float> a(1000003, 1.f);
+    std::vector<char> b(77, 2);
+    for (int i = cache_state::FLUSHED; i <= cache_state::WARM; ++i) {
+        cache_state::Buffers buffers(static_cast<cache_state::State>(i));
+        buffers.add(a).add(b.data() + 3, b.size() - 3);
+        buffers.prepare();
+        a[12345] += 1.f;
+        buffers.prepare();
+        if (a[12345] != 2.f + (i - cache_state::FLUSHED) || b[50] != 2) {
+            std::cout << "FAILED: data changed in state " << buffers.name()
+                      << "\n";
+            return 1;
+        }
+    }
+    std::cout << "PASSED\n";
+    return 0;
+}
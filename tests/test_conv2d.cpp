@@ -0,0 +1,58 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "conv2d.hpp"
+
+static bool close(const std::vector<float> &a, const std::vector<float> &b) {
+    for (size_t i = 0; i < a.size(); ++i)
+        if (std::fabs(a[i] - b[i]) > 1e-3f * (1.f + std::fabs(b[i])))
+            return false;
+    return a.size() == b.size();
+}
+
+// im2col + gemm and the direct kernel on the blocked layouts against the
+// definition, with channel counts that are not multiples of the block
+int main() {
+    conv2d::Shape shapes[] = {
+            // n, c, h, w, k, r, s, stride, pad
+            {1, 16, 9, 9, 16, 3, 3, 1, 1},
+            {2, 20, 11, 7, 24, 3, 3, 1, 1},
+            {1, 32, 12, 12, 16, 3, 3, 2, 1},
+            {1, 48, 6, 6, 40, 1, 1, 1, 0},
+            {1, 3, 17, 17, 16, 7, 7, 2, 3},
+    };
+    for (const auto &sh : shapes) {
+        std::vector<float> in(sh.input_size()), w(sh.weight_size());
+        for (size_t i = 0; i < in.size(); ++i)
+            in[i] = static_cast<float>(i % 13) * 0.1f - 0.6f;
+        for (size_t i = 0; i < w.size(); ++i)
+            w[i] = static_cast<float>(i % 7) * 0.05f - 0.15f;
+        std::vector<float> expect(sh.output_size());
+        conv2d::reference(sh, in.data(), w.data(), expect.data());
+
+        std::vector<float> out(sh.output_size(), -1.f);
+        std::vector<float> columns(sh.columns_size());
+        std::vector<float> packed(MM_BLOCK_SIZE * MM_BLOCK_SIZE);
+        conv2d::im2col_gemm(sh, in.data(), w.data(), out.data(),
+                columns.data(), packed.data());
+        if (!close(out, expect)) {
+            std::cout << "FAILED: im2col c=" << sh.c << " k=" << sh.k << "\n";
+            return 1;
+        }
+
+        std::vector<float> bin(sh.blocked_input_size()),
+                bw(sh.blocked_weight_size()), bout(sh.blocked_output_size());
+        conv2d::reorder_input(sh, in.data(), bin.data());
+        conv2d::reorder_weights(sh, w.data(), bw.data());
+        conv2d::direct(sh, bin.data(), bw.data(), bout.data());
+        std::fill(out.begin(), out.end(), -1.f);
+        conv2d::reorder_output(sh, bout.data(), out.data());
+        if (!close(out, expect)) {
+            std::cout << "FAILED: direct c=" << sh.c << " k=" << sh.k << "\n";
+            return 1;
+        }
+    }
+    std::cout << "PASSED\n";
+    return 0;
+}
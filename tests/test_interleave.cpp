@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "interleave.hpp"
+
+int main() {
+    std::mt19937_64 gen(7);
+
+    // hash table: hits and misses, for K below and above the number of keys
+    interleave::HashTable<uint64_t, uint32_t> table(5000, 1024);
+    std::vector<uint64_t> keys;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        uint64_t key = gen();
+        if (table.insert(key, i)) keys.push_back(key);
+    }
+    if (table.insert(keys[0], 0) || table.insert(1, 1)) {
+        std::cout << "FAILED: insert into a full table or a duplicate\n";
+        return 1;
+    }
+    for (int i = 0; i < 1000; ++i)
+        keys.push_back(gen());
+    std::shuffle(keys.begin(), keys.end(), gen);
+    for (size_t k : {1, 3, 8, 64, 10000}) {
+        std::vector<const uint32_t *> out(keys.size());
+        interleave::run(table.lookup(), keys.data(), keys.size(), out.data(), k);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (out[i] != table.find(keys[i])) {
+                std::cout << "FAILED: hash lookup " << i << " with K=" << k
+                          << "\n";
+                return 1;
+            }
+        }
+    }
+
+    // sorted search against std::lower_bound, also on tiny arrays
+    for (size_t n : {0, 1, 2, 3, 1000, 4097}) {
+        std::vector<int> a(n);
+        for (size_t i = 0; i < n; ++i)
+            a[i] = static_cast<int>(2 * i);
+        interleave::SortedSearch<int> search(a.data(), n);
+        std::vector<int> queries;
+        for (int q = -2; q <= static_cast<int>(2 * n) + 1; ++q)
+            queries.push_back(q);
+        for (size_t k : {1, 5, 16}) {
+            std::vector<size_t> out(queries.size());
+            interleave::run(search, queries.data(), queries.size(), out.data(), k);
+            for (size_t i = 0; i < queries.size(); ++i) {
+                size_t expect = std::lower_bound(a.begin(), a.end(), queries[i])
+                        - a.begin();
+                if (out[i] != expect || search.lower_bound(queries[i]) != expect) {
+                    std::cout << "FAILED: search " << queries[i] << " in " << n
+                              << " with K=" << k << "\n";
+                    return 1;
+                }
+            }
+        }
+    }
+    std::cout << "PASSED\n";
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "matmul_kernels.hpp"
+
+// an array that counts its accesses, as an analysis tool would use it
+struct CountingArray {
+    float *p;
+    size_t *count;
+    float &operator[](size_t i) const {
+        ++*count;
+        return p[i];
+    }
+    CountingArray operator+(size_t i) const { return {p + i, count}; }
+};
+
+using Kernel = void (*)(float *, float *, float *, int);
+
+// every loop order and the blocked knm against a plain loop nest, on raw
+// pointers and on counting arrays
+int main() {
+    const int n = 2 * MM_BLOCK_SIZE;
+    std::vector<float> A(n * n), B(n * n), C(n * n), ref(n * n, 0.f);
+    for (int i = 0; i < n * n; ++i) {
+        A[i] = static_cast<float>(i % 7) - 3.f;
+        B[i] = static_cast<float>(i % 5) - 2.f;
+    }
+    for (int i = 0; i < n; ++i)
+        for (int k = 0; k < n; ++k)
+            for (int j = 0; j < n; ++j)
+                ref[i * n + j] += A[i * n + k] * B[k * n + j];
+    auto check = [&](const char *name) {
+        for (int i = 0; i < n * n; ++i)
+            if (std::fabs(C[i] - ref[i]) > 1e-3f) {
+                std::cout << "FAILED: " << name << "\n";
+                return false;
+            }
+        return true;
+    };
+
+    const char *names[] = {"mnk", "nmk", "nkm", "knm", "kmn", "mkn"};
+    Kernel kernels[] = {matmul_kernels::mnk<float *>,
+            matmul_kernels::nmk<float *>, matmul_kernels::nkm<float *>,
+            matmul_kernels::knm<float *>, matmul_kernels::kmn<float *>,
+            matmul_kernels::mkn<float *>};
+    for (int v = 0; v < 6; ++v) {
+        std::fill(C.begin(), C.end(), 0.f);
+        kernels[v](A.data(), B.data(), C.data(), n);
+        if (!check(names[v])) return 1;
+    }
+    std::vector<float> packed(MM_BLOCK_SIZE * MM_BLOCK_SIZE);
+    std::fill(C.begin(), C.end(), 0.f);
+    matmul_kernels::block_knm(A.data(), B.data(), C.data(), packed.data(), n);
+    if (!check("block-knm")) return 1;
+
+    // one counted access per element reference: mnk reads A and B in the
+    // inner loop, mkn reads B and updates C (a load and a store for
+    // accesses_per_iter, one reference here)
+    size_t count = 0;
+    CountingArray a {A.data(), &count}, b {B.data(), &count},
+            c {C.data(), &count};
+    const size_t iters = static_cast<size_t>(n) * n * n;
+    std::fill(C.begin(), C.end(), 0.f);
+    count = 0;
+    matmul_kernels::mnk(a, b, c, n);
+    if (!check("mnk counted") || count != 2 * iters + n * n) {
+        std::cout << "FAILED: mnk count " << count << "\n";
+        return 1;
+    }
+    std::fill(C.begin(), C.end(), 0.f);
+    count = 0;
+    matmul_kernels::mkn(a, b, c, n);
+    if (!check("mkn counted") || count != 2 * iters + n * n) {
+        std::cout << "FAILED: mkn count " << count << "\n";
+        return 1;
+    }
+    CountingArray p {packed.data(), &count};
+    std::fill(C.begin(), C.end(), 0.f);
+    count = 0;
+    matmul_kernels::block_knm(a, b, c, p, n);
+    if (!check("block-knm counted") || count < 2 * iters) {
+        std::cout << "FAILED: block-knm count " << count << "\n";
+        return 1;
+    }
+
+    // block_gemm on sizes that leave partial blocks on every edge
+    const int m = 70, nn = 130, kk = 67;
+    std::vector<float> R(m * nn, 0.f), G(m * nn, 0.f);
+    for (int i = 0; i < m; ++i)
+        for (int k = 0; k < kk; ++k)
+            for (int j = 0; j < nn; ++j)
+                R[i * nn + j] += A[i * kk + k] * B[k * nn + j];
+    matmul_kernels::block_gemm(
+            A.data(), B.data(), G.data(), packed.data(), m, nn, kk);
+    for (int i = 0; i < m * nn; ++i)
+        if (std::fabs(G[i] - R[i]) > 1e-3f) {
+            std::cout << "FAILED: block_gemm\n";
+            return 1;
+        }
+    std::cout << "PASSED\n";
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "mem_ops.hpp"
+
+// every strategy against memcpy/memset, with guard bytes around the
+// destination
+int main() {
+    std::vector<size_t> sizes;
+    for (size_t n = 0; n <= 300; ++n)
+        sizes.push_back(n);
+    for (size_t n : {1000ul, 4095ul, 65537ul, 1000003ul})
+        sizes.push_back(n);
+
+    const size_t max_n = 1000003 + 64;
+    std::vector<char> src(max_n), dst(max_n + 64), ref(max_n + 64);
+    for (size_t i = 0; i < src.size(); ++i)
+        src[i] = static_cast<char>(i * 131 + 7);
+
+    for (int s = mem_ops::AUTO; s < mem_ops::NUM_STRATEGIES; ++s) {
+        mem_ops::Strategy strategy = static_cast<mem_ops::Strategy>(s);
+        for (size_t n : sizes) {
+            for (size_t off : {0ul, 1ul, 15ul, 33ul}) {
+                size_t len = n + off + 64;
+                memset(dst.data(), 0x5a, len);
+                memset(ref.data(), 0x5a, len);
+                mem_ops::copy(dst.data() + off, src.data() + 3, n, strategy);
+                memcpy(ref.data() + off, src.data() + 3, n);
+                if (memcmp(dst.data(), ref.data(), len) != 0) {
+                    std::cout << "FAILED: copy " << mem_ops::strategy_name(strategy)
+                              << " n " << n << " off " << off << "\n";
+                    return 1;
+                }
+                mem_ops::fill(dst.data() + off, 0xc3, n, strategy);
+                memset(ref.data() + off, 0xc3, n);
+                if (memcmp(dst.data(), ref.data(), len) != 0) {
+                    std::cout << "FAILED: fill " << mem_ops::strategy_name(strategy)
+                              << " n " << n << " off " << off << "\n";
+                    return 1;
+                }
+            }
+        }
+    }
+
+    // 5 x 7 block out of a 10 x 12 matrix
+    std::vector<int> a(10 * 12), block(5 * 7, -1);
+    for (size_t i = 0; i < a.size(); ++i)
+        a[i] = static_cast<int>(i);
+    mem_ops::pack(block.data(), 7 * sizeof(int), &a[2 * 12 + 3],
+            12 * sizeof(int), 5, 7 * sizeof(int));
+    for (int i = 0; i < 5; ++i)
+        for (int j = 0; j < 7; ++j)
+            if (block[i * 7 + j] != (2 + i) * 12 + 3 + j) {
+                std::cout << "FAILED: pack\n";
+                return 1;
+            }
+
+    std::cout << "erms " << mem_ops::has_erms() << ", fsrm "
+              << mem_ops::has_fsrm() << ", rep from "
+              << mem_ops::thresholds().rep_min << " B, nt from "
+              << mem_ops::thresholds().nt_min << " B\n";
+    std::cout << "PASSED\n";
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "buddy_memory_pool.hpp"
+#include "dynamic_memory_pool.hpp"
+#include "numa.hpp"
+
+int main() {
+    std::vector<int> nodes = numa::nodes();
+    if (nodes.empty() || numa::node_cpus(nodes[0]).empty()) {
+        std::cout << "FAILED: no node or no CPUs\n";
+        return 1;
+    }
+    std::cout << nodes.size() << " node(s), distance(" << nodes[0] << ", "
+              << nodes[0] << ") = " << numa::distance(nodes[0], nodes[0])
+              << "\n";
+
+    // memory bound to the first node is usable, binding may be refused
+    const size_t bytes = 1 << 20;
+    bool bound = false;
+    char *p = static_cast<char *>(numa::alloc_on_node(bytes, nodes[0], &bound));
+    if (!p) {
+        std::cout << "FAILED: alloc_on_node\n";
+        return 1;
+    }
+    memset(p, 1, bytes);
+    int placed = numa::node_of(p);
+    if (bound && placed != -1 && placed != nodes[0]) {
+        std::cout << "FAILED: bound to " << nodes[0] << " but placed on "
+                  << placed << "\n";
+        return 1;
+    }
+    numa::free_on_node(p, bytes);
+
+    // arena hands out aligned, disjoint blocks, also larger than a region
+    numa::Arena arena(nodes[0], 4096);
+    char *a = static_cast<char *>(arena.allocate(100, 64));
+    char *b = static_cast<char *>(arena.allocate(10000, 128));
+    char *c = static_cast<char *>(arena.allocate(1, 64));
+    if (!a || !b || !c || reinterpret_cast<uintptr_t>(a) % 64
+            || reinterpret_cast<uintptr_t>(b) % 128
+            || reinterpret_cast<uintptr_t>(c) % 64
+            || (b < a + 100 && a < b + 10000)) {
+        std::cout << "FAILED: arena blocks\n";
+        return 1;
+    }
+    memset(b, 2, 10000);
+    arena.release();
+    if (arena.reserved() != 0) {
+        std::cout << "FAILED: arena not released\n";
+        return 1;
+    }
+
+    // per-node pools are distinct from the default pool
+    auto &dyn = dynamic_mempool::MemoryPool::Instance(nodes[0]);
+    if (&dyn == &dynamic_mempool::MemoryPool::Instance()
+            || dyn.node() != nodes[0]) {
+        std::cout << "FAILED: dynamic pool per node\n";
+        return 1;
+    }
+    void *q = dyn.allocate(200);
+    memset(q, 3, 200);
+    dyn.deallocate(q);
+
+    auto &buddy = buddy_mempool::MemoryPool::Instance(nodes[0]);
+    if (&buddy == &buddy_mempool::MemoryPool::Instance() || !buddy.data()
+            || buddy.node() != nodes[0]) {
+        std::cout << "FAILED: buddy pool per node\n";
+        return 1;
+    }
+    std::cout << "PASSED\n";
+    return 0;
+}
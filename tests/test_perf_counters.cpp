@@ -0,0 +1,62 @@
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "perf_counters.hpp"
+
+int main() {
+    perf::CounterGroup pc;
+    if (!pc.available()) {
+        // e.g. containers without perf permissions, benchmarks report time only
+        std::cout << "No performance counters available\n";
+        return 0;
+    }
+
+    // touch fresh pages so that at least page faults are counted
+    static const size_t bytes = 16 * 1024 * 1024;
+    pc.start();
+    char *buf = static_cast<char *>(malloc(bytes));
+    for (size_t i = 0; i < bytes; i += 4096)
+        buf[i] = static_cast<char>(i);
+    pc.stop();
+    volatile char keep = buf[bytes / 2];
+    (void)keep;
+    free(buf);
+
+    // threads created after the group are counted too
+    if (pc.has(perf::PAGE_FAULTS)) {
+        double before = pc.value(perf::PAGE_FAULTS);
+        pc.start();
+        std::thread([] {
+            char *p = static_cast<char *>(malloc(bytes));
+            for (size_t i = 0; i < bytes; i += 4096)
+                p[i] = static_cast<char>(i);
+            volatile char k = p[bytes / 2];
+            (void)k;
+            free(p);
+        }).join();
+        pc.stop();
+        if (pc.value(perf::PAGE_FAULTS) - before < bytes / 4096 / 2) {
+            std::cout << "FAILED: page faults of a child thread not counted\n";
+            return 1;
+        }
+    }
+
+    for (int e = 0; e < perf::NUM_EVENTS; ++e) {
+        std::cout << perf::event_name(e) << ": ";
+        if (pc.has(e))
+            std::cout << pc.value(e) << "\n";
+        else
+            std::cout << "n/a\n";
+    }
+
+    if (pc.has(perf::PAGE_FAULTS) && pc.value(perf::PAGE_FAULTS) <= 0.) {
+        std::cout << "FAILED: no page faults counted\n";
+        return 1;
+    }
+    if (pc.has(perf::INSTRUCTIONS) && pc.value(perf::INSTRUCTIONS) <= 0.) {
+        std::cout << "FAILED: no instructions counted\n";
+        return 1;
+    }
+    return 0;
+}
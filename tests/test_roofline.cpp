@@ -0,0 +1,53 @@
+#include <cmath>
+#include <iostream>
+
+#include "roofline.hpp"
+
+int main() {
+    // the peak loops run on every supported ISA and stay finite
+    for (int i = simd::SCALAR; i < simd::NUM_ISAS; ++i) {
+        simd::Isa isa = static_cast<simd::Isa>(i);
+        if (!simd::supported(isa)) continue;
+        float r = roofline::fma_peak(100000, isa);
+        if (!std::isfinite(r) || roofline::fma_flops_per_iter(isa) <= 0.) {
+            std::cout << "FAILED: fma_peak " << simd::isa_name(isa) << "\n";
+            return 1;
+        }
+    }
+
+    // 100 GFLOP/s, L1 at 200 GB/s and RAM at 10 GB/s
+    roofline::Model m;
+    m.add_bandwidth("RAM", 10.);
+    m.add_compute("scalar", 5.);
+    m.add_bandwidth("L1", 200.);
+    m.add_compute("fma", 100.);
+    m.add_point("streaming", 0.25, 2.);
+    m.add_point("cached", 0.25, 40.);
+    m.add_point("dense", 20., 80.);
+    if (m.peak() != 100. || m.bandwidth()[0].name != "L1"
+            || m.roof(0.25) != 50. || m.roof(1.) != 100.
+            || m.ridge(m.bandwidth()[1]) != 10.) {
+        std::cout << "FAILED: ceilings\n";
+        return 1;
+    }
+    const auto &p = m.points();
+    if (m.level(p[0])->name != "RAM" || m.level(p[1])->name != "L1"
+            || m.bound(p[1]) != "memory" || m.bound(p[2]) != "compute") {
+        std::cout << "FAILED: classification\n";
+        return 1;
+    }
+
+    std::string csv = m.csv(), svg = m.svg(), ascii = m.ascii();
+    size_t rows = 0;
+    for (char c : csv)
+        rows += c == '\n';
+    if (rows != 1 + 2 + 2 + 3 || csv.find("kernel,dense,") == std::string::npos
+            || svg.find("<svg") != 0 || svg.find("</svg>") == std::string::npos
+            || ascii.find('A') == std::string::npos
+            || ascii.find("dense") == std::string::npos) {
+        std::cout << "FAILED: output\n" << csv << ascii;
+        return 1;
+    }
+    std::cout << ascii << "PASSED\n";
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "dynamic_memory_pool.hpp"
+#include "sharded_counter.hpp"
+
+int main() {
+    // padded values never share a false sharing block
+    using P = concurrent::padded<std::atomic<long>>;
+    P arr[2];
+    if (sizeof(P) % FALSE_SHARING_SIZE != 0
+            || reinterpret_cast<char *>(&arr[1]) - reinterpret_cast<char *>(&arr[0])
+                    < FALSE_SHARING_SIZE
+            || arr[0]->load() != 0) {
+        std::cout << "FAILED: padded<T> layout\n";
+        return 1;
+    }
+
+    // concurrent adds are all counted once the writers have joined
+    concurrent::ShardedCounter counter(3);
+    if (counter.num_shards() != 4) {
+        std::cout << "FAILED: shards not rounded to a power of two\n";
+        return 1;
+    }
+    const int num_threads = 8;
+    const long per_thread = 100000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t)
+        threads.emplace_back([&] {
+            for (long i = 0; i < per_thread; ++i)
+                counter.add();
+            counter.sub(10);
+        });
+    for (auto &t : threads)
+        t.join();
+    if (counter.read() != num_threads * (per_thread - 10)) {
+        std::cout << "FAILED: counted " << counter.read() << "\n";
+        return 1;
+    }
+    counter.reset();
+    if (counter.read() != 0) {
+        std::cout << "FAILED: reset\n";
+        return 1;
+    }
+
+    // threads alive at the same time get distinct ids, and the ids of
+    // threads that exited are handed out again
+    size_t main_id = concurrent::ShardedCounter::thread_index();
+    for (int round = 0; round < 3; ++round) {
+        const int n = 4;
+        std::vector<size_t> ids(n);
+        std::atomic<int> arrived {0};
+        std::vector<std::thread> team;
+        for (int t = 0; t < n; ++t)
+            team.emplace_back([&, t] {
+                ids[t] = concurrent::ShardedCounter::thread_index();
+                arrived.fetch_add(1);
+                while (arrived.load() < n) std::this_thread::yield();
+            });
+        for (auto &t : team)
+            t.join();
+        ids.push_back(main_id);
+        std::sort(ids.begin(), ids.end());
+        if (std::unique(ids.begin(), ids.end()) != ids.end()
+                || ids.back() > static_cast<size_t>(n)) {
+            std::cout << "FAILED: thread ids not recycled\n";
+            return 1;
+        }
+    }
+
+    // memory pool statistics
+    auto &pool = dynamic_mempool::MemoryPool::Instance();
+    void *p = pool.allocate(100);
+    pool.allocate(200);
+    pool.deallocate(p);
+    if (pool.stats().allocations.read() != 2
+            || pool.stats().deallocations.read() != 1
+            || pool.stats().bytes_in_use.read() != 256) {
+        std::cout << "FAILED: pool stats\n";
+        return 1;
+    }
+    std::cout << "PASSED\n";
+    return 0;
+}
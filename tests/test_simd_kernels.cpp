@@ -0,0 +1,73 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "simd_kernels.hpp"
+
+// every ISA against a double precision reference, for all head/tail
+// combinations of offset and length
+int main() {
+    std::vector<float> x(1 << 16), y(1 << 16);
+    for (size_t i = 0; i < x.size(); ++i)
+        x[i] = static_cast<float>((i * 7919) % 1000) / 100.f - 5.f;
+
+    for (int i = simd::SCALAR; i < simd::NUM_ISAS; ++i) {
+        simd::Isa isa = static_cast<simd::Isa>(i);
+        if (!simd::supported(isa)) {
+            std::cout << simd::isa_name(isa) << " not supported, skipped\n";
+            continue;
+        }
+        for (size_t off = 0; off < 17; ++off) {
+            for (size_t n : {0ul, 1ul, 7ul, 15ul, 16ul, 33ul, 100ul, 4099ul}) {
+                const float *xs = x.data() + off;
+                double ref_sum = 0.;
+                float ref_max = -INFINITY;
+                for (size_t k = 0; k < n; ++k) {
+                    ref_sum += xs[k];
+                    ref_max = std::max(ref_max, xs[k]);
+                }
+                float s = simd::sum(xs, n, isa);
+                float m = simd::max(xs, n, isa);
+                if (std::fabs(s - ref_sum) > 1e-3 * (1. + std::fabs(ref_sum))
+                        || m != ref_max) {
+                    std::cout << "FAILED: " << simd::isa_name(isa)
+                              << " sum/max, off " << off << " n " << n << "\n";
+                    return 1;
+                }
+
+                // elements outside [off, off + n) must stay untouched
+                std::fill(y.begin(), y.end(), 1.f);
+                simd::axpy(n, 2.f, xs, y.data() + off, isa);
+                simd::add(y.data() + off, n, 0.5f, isa);
+                for (size_t k = 0; k < off + n + 32; ++k) {
+                    float expect = k >= off && k < off + n
+                            ? 1.f + 2.f * x[k] + 0.5f
+                            : 1.f;
+                    if (std::fabs(y[k] - expect) > 1e-5f) {
+                        std::cout << "FAILED: " << simd::isa_name(isa)
+                                  << " axpy/add, off " << off << " n " << n
+                                  << "\n";
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    // parallel versions agree with the serial ones
+    thread_team::ThreadTeam team(3);
+    std::vector<float> z(1000003, 0.25f);
+    z[777777] = 9.f;
+    simd::parallel_add(team, z.data(), z.size(), 1.f);
+    simd::parallel_axpy(team, z.size(), 1.f, z.data(), z.data());
+    float s = simd::parallel_sum(team, z.data(), z.size());
+    float m = simd::parallel_max(team, z.data(), z.size());
+    if (m != 20.f || std::fabs(s - 2.5 * (z.size() - 1) - 20.) > 1.) {
+        std::cout << "FAILED: parallel kernels, sum " << s << " max " << m
+                  << "\n";
+        return 1;
+    }
+    std::cout << "best ISA: " << simd::isa_name(simd::best_isa()) << "\n";
+    std::cout << "PASSED\n";
+    return 0;
+}
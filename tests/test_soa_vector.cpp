@@ -0,0 +1,84 @@
+#include <cstdint>
+#include <iostream>
+
+#include "soa_vector.hpp"
+
+// the same checks on every layout, through the uniform API
+template <typename Layout>
+static bool check(const char *expect_name) {
+    using V = soa::soa_vector<Layout, float, double, int16_t>;
+    V v;
+    for (int i = 0; i < 100; ++i)
+        v.push_back(i * 1.f, i * 2., static_cast<int16_t>(-i));
+    v.resize(150);
+    if (std::string(V::layout_name()) != expect_name || v.size() != 150
+            || V::record_bytes != 24) {
+        std::cout << "FAILED: " << expect_name << " sizes\n";
+        return false;
+    }
+
+    // proxies, views and blocks see the same records
+    auto x = soa::field<0>(v);
+    auto y = soa::field<1>(v);
+    for (int i = 0; i < 150; ++i) {
+        bool old = i < 100;
+        if (soa::get<0>(v[i]) != (old ? i * 1.f : 0.f)
+                || y[i] != (old ? i * 2. : 0.)
+                || soa::get<2>(v[i]) != (old ? -i : 0) || &x[i] != &v.template get<0>(i)) {
+            std::cout << "FAILED: " << expect_name << " record " << i << "\n";
+            return false;
+        }
+    }
+    size_t seen = 0;
+    soa::for_each_block(v, [&](auto b, size_t n) {
+        auto bx = soa::field<0>(b);
+        auto bz = soa::field<2>(b);
+        for (size_t j = 0; j < n; ++j) {
+            bx[j] += 1.f;
+            bz[j] = static_cast<int16_t>(b.first() + j);
+        }
+        seen += n;
+    });
+    v[7].set(7.5f, 0.25, 3);
+    auto r = v[7].load();
+    if (seen != 150 || x[8] != 9.f || x[120] != 1.f || soa::get<2>(v[140]) != 140
+            || std::get<0>(r) != 7.5f || std::get<1>(r) != 0.25) {
+        std::cout << "FAILED: " << expect_name << " blocks\n";
+        return false;
+    }
+
+    // growing moves the records, copies are deep
+    V w = v;
+    v.reserve(10000);
+    x = soa::field<0>(v);
+    if (x[8] != 9.f || soa::get<2>(v[149]) != 149 || w.template get<0>(8) != 9.f) {
+        std::cout << "FAILED: " << expect_name << " reserve\n";
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    if (!check<soa::AoS>("aos") || !check<soa::SoA>("soa")
+            || !check<soa::AoSoA<8>>("aosoa8")
+            || !check<soa::AoSoA<16>>("aosoa16"))
+        return 1;
+
+    // storage of each layout: field 1 of record 1 relative to record 0
+    soa::soa_vector<soa::AoS, float, double, int16_t> aos(32);
+    soa::soa_vector<soa::SoA, float, double, int16_t> soa_(32);
+    soa::soa_vector<soa::AoSoA<8>, float, double, int16_t> tiles(32);
+    auto step = [](const double &a, const double &b) {
+        return reinterpret_cast<const char *>(&b)
+                - reinterpret_cast<const char *>(&a);
+    };
+    if (step(aos.get<1>(0), aos.get<1>(1)) != 24
+            || step(soa_.get<1>(0), soa_.get<1>(1)) != 8
+            || step(tiles.get<1>(0), tiles.get<1>(1)) != 8
+            || step(tiles.get<1>(7), tiles.get<1>(8)) != 8 * 24 - 7 * 8) {
+        std::cout << "FAILED: storage\n";
+        return 1;
+    }
+    std::cout << "PASSED\n";
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "spmv.hpp"
+
+static std::vector<float> dense_multiply(
+        const spmv::Csr &a, const std::vector<float> &x) {
+    std::vector<double> y(a.rows, 0.);
+    for (size_t r = 0; r < a.rows; ++r)
+        for (size_t j = a.ptr[r]; j < a.ptr[r + 1]; ++j)
+            y[r] += static_cast<double>(a.val[j]) * x[a.idx[j]];
+    return std::vector<float>(y.begin(), y.end());
+}
+
+static bool close(const std::vector<float> &a, const std::vector<float> &b) {
+    for (size_t i = 0; i < a.size(); ++i)
+        if (std::fabs(a[i] - b[i]) > 1e-4f * (1.f + std::fabs(b[i])))
+            return false;
+    return a.size() == b.size();
+}
+
+static bool is_permutation(const std::vector<spmv::index_t> &order, size_t n) {
+    std::vector<char> seen(n, 0);
+    for (auto v : order) {
+        if (v >= n || seen[v]) return false;
+        seen[v] = 1;
+    }
+    return order.size() == n;
+}
+
+int main() {
+    const size_t n = 1003;
+    spmv::Csr band = spmv::banded(n, 5, 6, false);
+    spmv::Csr shuffled = spmv::banded(n, 5, 6, true);
+    spmv::Csr graph = spmv::power_law(n, 8, 3., true);
+    if (band.nnz() != shuffled.nnz() || spmv::mean_distance(band) > 5.
+            || spmv::mean_distance(shuffled) < 100.) {
+        std::cout << "FAILED: banded generator\n";
+        return 1;
+    }
+
+    std::vector<float> x(n);
+    for (size_t i = 0; i < n; ++i)
+        x[i] = 0.01f * static_cast<float>(i % 97);
+
+    for (const spmv::Csr *a : {&band, &shuffled, &graph}) {
+        std::vector<float> expect = dense_multiply(*a, x);
+
+        // CSR on uneven nnz-balanced ranges
+        std::vector<float> y(n, -1.f);
+        std::vector<size_t> bounds = spmv::partition(a->ptr, 7);
+        for (size_t t = 0; t < 7; ++t) {
+            if (bounds[t] > bounds[t + 1]) {
+                std::cout << "FAILED: partition\n";
+                return 1;
+            }
+            spmv::multiply(*a, x.data(), y.data(), bounds[t], bounds[t + 1]);
+        }
+        if (bounds[7] != n || !close(y, expect)) {
+            std::cout << "FAILED: csr\n";
+            return 1;
+        }
+
+        // SELL for every chunk width, sigma from 1 to all rows
+        for (size_t c : {4, 8, 16, 32}) {
+            for (size_t sigma : {1, 64, 100000}) {
+                spmv::Sell s = spmv::to_sell(*a, c, sigma);
+                std::fill(y.begin(), y.end(), -1.f);
+                spmv::multiply(s, x.data(), y.data(), 0, s.chunks());
+                if (!close(y, expect) || s.stored() < a->nnz()) {
+                    std::cout << "FAILED: sell C=" << c << " sigma=" << sigma
+                              << "\n";
+                    return 1;
+                }
+            }
+        }
+
+        // reordered: y'[k] = y[order[k]] for x'[k] = x[order[k]]
+        for (auto order : {spmv::rcm(*a), spmv::degree_order(*a)}) {
+            if (!is_permutation(order, n)) {
+                std::cout << "FAILED: not a permutation\n";
+                return 1;
+            }
+            spmv::Csr b = spmv::permute(*a, order);
+            std::vector<float> px(n);
+            std::vector<float> pexpect(n);
+            for (size_t k = 0; k < n; ++k) {
+                px[k] = x[order[k]];
+                pexpect[k] = expect[order[k]];
+            }
+            spmv::multiply(b, px.data(), y.data(), 0, n);
+            if (b.nnz() != a->nnz() || !close(y, pexpect)) {
+                std::cout << "FAILED: permuted product\n";
+                return 1;
+            }
+        }
+    }
+
+    // RCM finds the band of the shuffled matrix again
+    double d = spmv::mean_distance(spmv::permute(shuffled, spmv::rcm(shuffled)));
+    if (d > 20.) {
+        std::cout << "FAILED: rcm leaves a mean distance of " << d << "\n";
+        return 1;
+    }
+    std::cout << "PASSED\n";
+    return 0;
+}
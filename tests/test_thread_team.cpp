@@ -0,0 +1,60 @@
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+#include "thread_team.hpp"
+
+int main() {
+#ifdef __linux__
+    // the caller gets its affinity back when a team is gone
+    cpu_set_t before, after;
+    pthread_getaffinity_np(pthread_self(), sizeof(before), &before);
+    { thread_team::ThreadTeam pinned(2); }
+    pthread_getaffinity_np(pthread_self(), sizeof(after), &after);
+    if (!CPU_EQUAL(&before, &after)) {
+        std::cout << "FAILED: affinity not restored\n";
+        return 1;
+    }
+#endif
+
+    // chunks cover [0, n) without gaps and start on aligned boundaries
+    const size_t n = 1000003;
+    for (int nthreads : {1, 3, 4, 7}) {
+        size_t expect = 0;
+        for (int t = 0; t < nthreads; ++t) {
+            auto r = thread_team::chunk(n, t, nthreads, 16);
+            if (r.first != expect || (r.first % 16 != 0 && r.first != n)) {
+                std::cout << "FAILED: bad chunk for " << nthreads
+                          << " threads\n";
+                return 1;
+            }
+            expect = r.second;
+        }
+        if (expect != n) {
+            std::cout << "FAILED: chunks do not cover the range\n";
+            return 1;
+        }
+    }
+
+    // every thread of the team runs the task, repeatedly
+    thread_team::ThreadTeam team(4);
+    std::vector<int> hits(team.size(), 0);
+    std::atomic<int> total {0};
+    for (int round = 0; round < 100; ++round) {
+        team.run([&](int tid) {
+            hits[tid]++;
+            total.fetch_add(1);
+        });
+    }
+    for (int t = 0; t < team.size(); ++t) {
+        if (hits[t] != 100) {
+            std::cout << "FAILED: thread " << t << " ran " << hits[t]
+                      << " times\n";
+            return 1;
+        }
+    }
+
+    std::cout << "Team of " << team.size() << " ran " << total.load()
+              << " tasks\n";
+    return 0;
+}
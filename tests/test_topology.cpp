@@ -0,0 +1,26 @@
+#include <iostream>
+
+#include "topology.hpp"
+
+int main() {
+    const topology::CpuInfo &info = topology::info();
+    info.print();
+
+    std::cout << "Working sets:";
+    for (size_t ws : info.working_sets())
+        std::cout << " " << ws / 1024 << "K(" << info.label(ws) << ")";
+    std::cout << "\nFlush buffer: " << info.flush_size() / 1024 << " KiB\n";
+
+    if (info.caches.empty() || info.line_size == 0 || info.cpus.empty()
+            || info.tsc_ghz <= 0.) {
+        std::cout << "FAILED: incomplete topology\n";
+        return 1;
+    }
+    for (size_t i = 1; i < info.caches.size(); ++i) {
+        if (info.caches[i].level <= info.caches[i - 1].level) {
+            std::cout << "FAILED: cache levels not ordered\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "work_stealing.hpp"
+
+// Deque: LIFO for the owner, FIFO for thieves, growth, and every element
+// taken exactly once while thieves race the owner
+static bool test_deque() {
+    work_stealing::Deque<int *> dq(4);
+    std::vector<int> items(1000);
+    for (auto &i : items)
+        dq.push(&i);
+    if (dq.capacity() < items.size() || dq.size() != items.size()
+            || dq.pop() != &items.back() || dq.steal() != &items.front()) {
+        std::cout << "FAILED: deque order\n";
+        return false;
+    }
+    while (dq.pop()) {}
+    if (dq.size() != 0 || dq.steal() != nullptr) {
+        std::cout << "FAILED: deque not empty\n";
+        return false;
+    }
+
+    const int n = 200000;
+    std::vector<int> values(n, 0);
+    std::vector<std::atomic<int>> taken(n);
+    for (auto &t : taken)
+        t.store(0);
+    std::atomic<bool> done {false};
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; ++t)
+        thieves.emplace_back([&] {
+            while (!done.load())
+                if (int *p = dq.steal())
+                    taken[p - values.data()].fetch_add(1);
+                else
+                    std::this_thread::yield();
+        });
+    for (int i = 0; i < n; ++i) {
+        dq.push(&values[i]);
+        // the owner pops every other push
+        if (i % 2)
+            if (int *p = dq.pop()) taken[p - values.data()].fetch_add(1);
+    }
+    while (int *p = dq.pop())
+        taken[p - values.data()].fetch_add(1);
+    done.store(true);
+    for (auto &t : thieves)
+        t.join();
+    for (int i = 0; i < n; ++i)
+        if (taken[i].load() != 1) {
+            std::cout << "FAILED: element " << i << " taken " << taken[i].load()
+                      << " times\n";
+            return false;
+        }
+    return true;
+}
+
+int main() {
+    if (!test_deque()) return 1;
+
+#ifdef __linux__
+    // the caller gets its affinity back when the scheduler is gone
+    cpu_set_t before, after;
+    pthread_getaffinity_np(pthread_self(), sizeof(before), &before);
+    { work_stealing::Scheduler pinned(2); }
+    pthread_getaffinity_np(pthread_self(), sizeof(after), &after);
+    if (!CPU_EQUAL(&before, &after)) {
+        std::cout << "FAILED: affinity not restored\n";
+        return 1;
+    }
+#endif
+
+    work_stealing::Scheduler sched(4);
+    const size_t n = 100003;
+    std::vector<std::atomic<int>> hits(n);
+
+    // every element exactly once, pieces no larger than the grain, over
+    // repeated calls on the same workers
+    for (size_t grain : {1, 7, 1000, 200000}) {
+        for (auto &h : hits)
+            h.store(0);
+        std::atomic<size_t> largest {0};
+        for (int round = 0; round < 10; ++round)
+            sched.parallel_for(0, n, grain, [&](size_t b, size_t e) {
+                size_t m = largest.load();
+                while (e - b > m && !largest.compare_exchange_weak(m, e - b)) {}
+                for (size_t i = b; i < e; ++i)
+                    hits[i].fetch_add(1, std::memory_order_relaxed);
+            });
+        for (size_t i = 0; i < n; ++i)
+            if (hits[i].load() != 10) {
+                std::cout << "FAILED: grain " << grain << " element " << i
+                          << " hit " << hits[i].load() << " times\n";
+                return 1;
+            }
+        if (largest.load() > grain) {
+            std::cout << "FAILED: piece of " << largest.load()
+                      << " for grain " << grain << "\n";
+            return 1;
+        }
+    }
+
+    // nested parallel_for inside tasks, and spawned empty tasks
+    std::atomic<long> sum {0};
+    sched.parallel_for(0, 64, 1, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i)
+            sched.parallel_for(0, 1000, 10, [&](size_t bb, size_t ee) {
+                sum.fetch_add(static_cast<long>(ee - bb));
+            });
+    });
+    std::atomic<int> count {0};
+    {
+        work_stealing::TaskGroup g(sched);
+        for (int i = 0; i < 10000; ++i)
+            g.spawn([&] { count.fetch_add(1, std::memory_order_relaxed); });
+    }
+    if (sum.load() != 64 * 1000 || count.load() != 10000) {
+        std::cout << "FAILED: nested sum " << sum.load() << ", spawned "
+                  << count.load() << "\n";
+        return 1;
+    }
+
+    // a thread outside the scheduler runs its calls inline
+    long outside = 0;
+    std::thread([&] {
+        sched.parallel_for(0, 1000, 10, [&](size_t b, size_t e) {
+            outside += static_cast<long>(e - b);
+        });
+    }).join();
+    if (outside != 1000) {
+        std::cout << "FAILED: outside call covered " << outside << "\n";
+        return 1;
+    }
+
+    uint64_t executed = 0, steals = 0;
+    for (int w = 0; w < sched.size(); ++w) {
+        executed += sched.executed(w);
+        steals += sched.steals(w);
+    }
+    std::cout << "Scheduler of " << sched.size() << " ran " << executed
+              << " tasks, " << steals << " stolen\n";
+    std::cout << "PASSED\n";
+    return 0;
+}